@@ -0,0 +1,28 @@
+#ifndef ACQUISITION_CLOCK_HPP
+#define ACQUISITION_CLOCK_HPP
+
+#include <chrono>
+#include <thread>
+
+#include <stdint.h> // for uint8_t etc...
+
+/**
+ * @brief The monotonic clock shared by every acquisition thread, so samples from different devices compare directly.
+ */
+namespace AcquisitionClock
+{
+	//! Returns the current host time in nanoseconds since an arbitrary, fixed epoch
+	inline int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	//! Blocks the calling thread until the given host time [ns]
+	inline void sleepUntil(int64_t time)
+	{
+		std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(time))));
+	}
+}
+
+#endif // ACQUISITION_CLOCK_HPP
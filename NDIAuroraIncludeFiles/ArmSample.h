@@ -0,0 +1,30 @@
+#ifndef ARM_SAMPLE_HPP
+#define ARM_SAMPLE_HPP
+
+#include <stdint.h> // for uint8_t etc...
+
+/**
+ * @brief The state of the Kinova arm at one instant, stamped with AcquisitionClock.
+ * @details KinovaTypes.h declares a struct SystemStatus that collides with the SystemStatus namespace in
+ *          ToolData.h, so the Kinova and CAPI headers cannot share a translation unit. This struct
+ *          carries the arm state across that boundary without depending on either.
+ */
+struct ArmSample
+{
+	//! The largest number of actuators on a supported arm
+	static const int MAX_JOINTS = 7;
+
+	//! Host time [ns] at the midpoint of the reads that produced this sample
+	int64_t timestamp;
+
+	//! The end effector pose from GetCartesianPosition: X, Y, Z [m] and ThetaX, ThetaY, ThetaZ [rad]
+	double cartesian[6];
+
+	//! The actuator angles from GetAngularPosition [deg]
+	double joints[MAX_JOINTS];
+
+	//! The finger positions reported with the cartesian pose
+	double fingers[3];
+};
+
+#endif // ARM_SAMPLE_HPP
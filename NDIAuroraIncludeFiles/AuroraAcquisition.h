@@ -0,0 +1,348 @@
+#ifndef AURORA_ACQUISITION_HPP
+#define AURORA_ACQUISITION_HPP
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "CombinedApi.h"
+#include "DeviceClockModel.h"
+#include "FramePhaseScheduler.h"
+#include "LatencyHistogram.h"
+#include "PoseHistory.h"
+#include "PoseSample.h"
+#include "RealtimeThread.h"
+#include "ToolData.h"
+#include "TrackerSupervisor.h"
+#include "TrackingDemand.h"
+
+/**
+ * @brief Polls a tracking Aurora on a dedicated thread and publishes every new frame as a PoseSample.
+ * @details The device must already be in tracking mode, and no other code may use the CombinedApi while
+ *          the acquisition is running. Each BX transaction is stamped with AcquisitionClock; replies
+ *          that repeat the previous frame number are not published. Once the FramePhaseScheduler has
+ *          locked onto the device's frame clock, each request is timed to land just after the next frame
+ *          is ready, instead of polling back to back. Once the DeviceClockModel has locked, each published
+ *          sample's timestamp is the host time the model assigns to its frame number rather than the
+ *          jittery midpoint of its transaction; requestTime and replyTime keep the raw times. With a
+ *          TrackerSupervisor, a run of failed transactions makes the acquisition thread resynchronise the
+ *          device before polling again. A RealtimeConfig pins the thread, raises its priority and keeps its
+ *          memory resident; wakeupLatency() shows how late the thread wakes for each scheduled request.
+ */
+class AuroraAcquisition
+{
+public:
+	//! Called on the acquisition thread for every new frame
+	typedef std::function<void(const PoseSample&)> SampleCallback;
+
+	/**
+	 * @brief Creates an idle acquisition for the given device.
+	 * @param capi A connected CombinedApi that is already tracking.
+	 */
+	explicit AuroraAcquisition(CombinedApi& capi)
+		: capi_(capi), replyOptions_(TrackingReplyOption::TransformData | TrackingReplyOption::AllTransforms),
+		  history_(NULL), phaseLocking_(true), clockCorrection_(true), running_(false), hasSample_(false), samplesPublished_(0), failedTransactions_(0),
+		  duplicateFrames_(0), demand_(TrackingDemand::allTransforms()), supervisor_(NULL)
+	{
+	}
+
+	//! Stops the acquisition thread
+	~AuroraAcquisition()
+	{
+		stop();
+	}
+
+	//! Sets the callback invoked for every new frame. Must be called before start().
+	void setSampleCallback(SampleCallback callback)
+	{
+		callback_ = callback;
+	}
+
+	/**
+	 * @brief Records every new frame in a history, so other threads can look up poses by time.
+	 * @details Must be called before start(). The history must outlive the acquisition.
+	 */
+	void setHistory(PoseHistory* history)
+	{
+		history_ = history;
+	}
+
+	//! Sets the TrackingReplyOption flags used for BX. Must be called before start().
+	void setReplyOptions(uint16_t options)
+	{
+		replyOptions_ = options;
+	}
+
+	/**
+	 * @brief Asks the device only for what the consumers use, and publishes only the handles they want.
+	 * @details Replaces the reply options with demand.replyOptions(). Must be called before start().
+	 */
+	void setDemand(const TrackingDemand& demand)
+	{
+		demand_ = demand;
+		replyOptions_ = demand.replyOptions();
+	}
+
+	/**
+	 * @brief Lets a supervisor bring the device back after repeated failures.
+	 * @details Must be called before start(). Recovery then runs on the acquisition thread, which keeps the
+	 *          CombinedApi to itself; use TrackerSupervisor::recover(), not startRecovery(), elsewhere.
+	 */
+	void setSupervisor(TrackerSupervisor* supervisor)
+	{
+		supervisor_ = supervisor;
+	}
+
+	/**
+	 * @brief Sets the CPU, priority and memory locking of the acquisition thread. Must be called before start().
+	 * @details start() also prefaults the latest sample and the history, and the thread its stack.
+	 */
+	void setRealtimeConfig(const RealtimeConfig& config)
+	{
+		realtimeConfig_ = config;
+	}
+
+	//! Returns what start() managed to apply of the RealtimeConfig
+	const RealtimeStatus& realtimeStatus() const { return realtimeStatus_; }
+
+	/**
+	 * @brief Returns how late the thread woke for each request timed to the frame clock.
+	 * @details Only phase-locked requests sleep, so nothing is recorded while polling back to back.
+	 */
+	const LatencyHistogram& wakeupLatency() const { return wakeupLatency_; }
+
+	/**
+	 * @brief Chooses between requests timed to the device's frame clock (the default) and back to back polling.
+	 * @details Must be called before start().
+	 */
+	void setPhaseLocking(bool enable)
+	{
+		phaseLocking_ = enable;
+	}
+
+	/**
+	 * @brief Chooses between timestamps from the device clock model (the default) and raw transaction midpoints.
+	 * @details Must be called before start().
+	 */
+	void setClockCorrection(bool enable)
+	{
+		clockCorrection_ = enable;
+	}
+
+	/**
+	 * @brief Returns the host/device clock model, eg. to read the drift or jitter.
+	 * @details Only access the model while the acquisition is stopped.
+	 */
+	DeviceClockModel& clockModel() { return clockModel_; }
+
+	/**
+	 * @brief Returns the frame clock model, eg. to read its period or tune its guard time.
+	 * @details Only access the scheduler while the acquisition is stopped.
+	 */
+	FramePhaseScheduler& scheduler() { return scheduler_; }
+
+	/**
+	 * @brief Starts the acquisition thread.
+	 * @returns True if the thread was started, false if it was already running.
+	 */
+	bool start()
+	{
+		if (running_.exchange(true))
+		{
+			return false;
+		}
+		RealtimeThread::prefault(&latest_, sizeof(latest_));
+		if (history_ != NULL)
+		{
+			history_->prefault();
+		}
+		thread_ = std::thread(&AuroraAcquisition::run, this);
+		realtimeStatus_ = RealtimeThread::apply(thread_.native_handle(), realtimeConfig_);
+		return true;
+	}
+
+	//! Stops the acquisition thread and waits for the transaction in progress to finish
+	void stop()
+	{
+		running_ = false;
+		if (thread_.joinable())
+		{
+			thread_.join();
+		}
+	}
+
+	//! Returns true while the acquisition thread is running
+	bool isRunning() const { return running_; }
+
+	/**
+	 * @brief Copies the most recent frame.
+	 * @returns False if no frame has been acquired yet.
+	 */
+	bool latest(PoseSample& sample) const
+	{
+		std::lock_guard<std::mutex> lock(latestMutex_);
+		if (!hasSample_)
+		{
+			return false;
+		}
+		sample = latest_;
+		return true;
+	}
+
+	//! Returns the number of frames published so far
+	uint64_t samplesPublished() const { return samplesPublished_; }
+
+	//! Returns the number of BX transactions that returned no data
+	uint64_t failedTransactions() const { return failedTransactions_; }
+
+	//! Returns the number of BX transactions that repeated the previous frame
+	uint64_t duplicateFrames() const { return duplicateFrames_; }
+
+	/**
+	 * @brief Performs one BX transaction and converts the reply.
+	 * @returns False if the device returned no tool data.
+	 */
+	bool poll(PoseSample& sample)
+	{
+		sample.requestTime = AcquisitionClock::now();
+		std::vector<ToolData> tools = capi_.getTrackingDataBX(replyOptions_);
+		sample.replyTime = AcquisitionClock::now();
+		sample.timestamp = sample.requestTime + (sample.replyTime - sample.requestTime) / 2;
+		if (tools.empty())
+		{
+			return false;
+		}
+
+		sample.frameNumber = tools[0].frameNumber;
+		sample.numPoses = 0;
+		for (size_t i = 0; i < tools.size() && sample.numPoses < PoseSample::MAX_POSES; i++)
+		{
+			const Transform& transform = tools[i].transform;
+			if (!demand_.wantsHandle(transform.toolHandle))
+			{
+				continue;
+			}
+			TrackedPose& pose = sample.poses[sample.numPoses++];
+			pose.toolHandle = transform.toolHandle;
+			pose.status = transform.status;
+			pose.valid = (!transform.isMissing() && transform.q0 > MAX_NEGATIVE) ? 1 : 0;
+			pose.q[0] = transform.q0;
+			pose.q[1] = transform.qx;
+			pose.q[2] = transform.qy;
+			pose.q[3] = transform.qz;
+			pose.t[0] = transform.tx;
+			pose.t[1] = transform.ty;
+			pose.t[2] = transform.tz;
+			pose.error = transform.error;
+		}
+		return true;
+	}
+
+protected:
+	//! Stores a new frame as the latest and hands it to the callback
+	void publish(const PoseSample& sample)
+	{
+		{
+			std::lock_guard<std::mutex> lock(latestMutex_);
+			latest_ = sample;
+			hasSample_ = true;
+		}
+		if (history_ != NULL)
+		{
+			history_->push(sample);
+		}
+		samplesPublished_++;
+		if (callback_)
+		{
+			callback_(sample);
+		}
+	}
+
+	//! The body of the acquisition thread
+	void run()
+	{
+		RealtimeThread::prefaultStack(realtimeConfig_.prefaultStackBytes);
+		PoseSample sample;
+		scheduler_.reset();
+		clockModel_.reset();
+		while (running_)
+		{
+			if (phaseLocking_ && scheduler_.isLocked())
+			{
+				int64_t requestTime = scheduler_.nextRequestTime();
+				AcquisitionClock::sleepUntil(requestTime);
+				wakeupLatency_.record(AcquisitionClock::now() - requestTime);
+			}
+			bool polled = poll(sample);
+			if (supervisor_ != NULL)
+			{
+				supervisor_->report(polled);
+			}
+			if (!polled)
+			{
+				failedTransactions_++;
+				if (supervisor_ != NULL && supervisor_->needsRecovery())
+				{
+					// The device may come back with new frame numbers and a new frame phase
+					if (supervisor_->recover())
+					{
+						scheduler_.reset();
+						clockModel_.reset();
+						continue;
+					}
+					std::this_thread::sleep_for(std::chrono::milliseconds(TrackerSupervisor::RETRY_INTERVAL_MS));
+					continue;
+				}
+				// Don't hammer a device that isn't answering
+				std::this_thread::sleep_for(std::chrono::milliseconds(FAILURE_BACKOFF_MS));
+				continue;
+			}
+			if (!scheduler_.observe(sample.frameNumber, sample.requestTime))
+			{
+				duplicateFrames_++;
+				continue;
+			}
+			if (clockCorrection_)
+			{
+				sample.timestamp = clockModel_.observe(sample.frameNumber, sample.timestamp);
+			}
+			publish(sample);
+		}
+	}
+
+	//! The pause after a failed transaction before the next attempt [ms]
+	enum { FAILURE_BACKOFF_MS = 5 };
+
+	CombinedApi& capi_;
+	uint16_t replyOptions_;
+	SampleCallback callback_;
+	PoseHistory* history_;
+	bool phaseLocking_;
+	FramePhaseScheduler scheduler_;
+	bool clockCorrection_;
+	DeviceClockModel clockModel_;
+
+	std::thread thread_;
+	std::atomic<bool> running_;
+
+	mutable std::mutex latestMutex_;
+	PoseSample latest_;
+	bool hasSample_;
+
+	std::atomic<uint64_t> samplesPublished_;
+	std::atomic<uint64_t> failedTransactions_;
+	std::atomic<uint64_t> duplicateFrames_;
+
+	TrackingDemand demand_;
+	TrackerSupervisor* supervisor_;
+
+	RealtimeConfig realtimeConfig_;
+	RealtimeStatus realtimeStatus_;
+	LatencyHistogram wakeupLatency_;
+};
+
+#endif // AURORA_ACQUISITION_HPP
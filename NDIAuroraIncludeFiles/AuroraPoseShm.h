@@ -0,0 +1,347 @@
+#ifndef AURORA_POSE_SHM_H
+#define AURORA_POSE_SHM_H
+
+/**
+ * @file AuroraPoseShm.h
+ * @brief Layout of the shared-memory segment written by PoseSharedMemoryPublisher, and a C API to read it.
+ * @details The process that owns the SCU publishes every frame into a named segment. Any number of
+ *          processes on the same host attach with auroraShmOpen() and read either the latest frame or every
+ *          frame in turn from a ring of the last AURORA_SHM_RING_SIZE frames, without a serial session of
+ *          their own. Each slot is protected by a sequence lock: the writer never waits for readers, and a
+ *          reader retries the copy of a slot the writer was changing.
+ *
+ *          This header is plain C so vision, logging or MATLAB MEX code can use it directly. On Linux link
+ *          readers with -lrt if the C library does not provide shm_open.
+ *
+ *          Typical reader:
+ *              AuroraShmReader reader;
+ *              AuroraShmFrame frame;
+ *              if (auroraShmOpen(&reader, AURORA_SHM_DEFAULT_NAME) == 0)
+ *              {
+ *                  while (running)
+ *                      while (auroraShmReadNext(&reader, &frame) > 0)
+ *                          use(&frame);
+ *                  auroraShmClose(&reader);
+ *              }
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include <stdint.h> // for uint8_t etc...
+
+#ifdef _WIN32
+// #include <windows.h> causes naming conflicts with TcpConnection's includes
+#include <winsock2.h>
+#else
+#include <fcntl.h>    // for O_RDONLY
+#include <sys/mman.h> // for shm_open() and mmap()
+#include <sys/stat.h>
+#include <unistd.h>   // for close()
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_MSC_VER) && !defined(__cplusplus)
+#define AURORA_SHM_INLINE static __inline
+#else
+#define AURORA_SHM_INLINE static inline
+#endif
+
+//! Identifies a segment written by PoseSharedMemoryPublisher ("AURP")
+#define AURORA_SHM_MAGIC 0x50525541u
+
+//! Incremented whenever the layout below changes
+#define AURORA_SHM_VERSION 1u
+
+//! The largest number of handles in a frame
+#define AURORA_SHM_MAX_POSES 16
+
+//! The number of recent frames kept in the ring
+#define AURORA_SHM_RING_SIZE 64
+
+//! The segment name used when none is given
+#ifdef _WIN32
+#define AURORA_SHM_DEFAULT_NAME "Local\\auroraPoses"
+#else
+#define AURORA_SHM_DEFAULT_NAME "/auroraPoses"
+#endif
+
+/**
+ * @brief The pose of one port handle.
+ */
+typedef struct AuroraShmPose
+{
+	uint16_t toolHandle; //!< The handle that uniquely identifies the tool
+	uint16_t status;     //!< The TransformStatus as a two byte integer
+	uint8_t valid;       //!< Nonzero if the pose holds a measurement
+	uint8_t reserved[3];
+	double q[4];         //!< The quaternion [q0, qx, qy, qz]
+	double t[3];         //!< The position [mm]
+	double error;        //!< The RMS error in the measurement [mm]
+} AuroraShmPose;
+
+/**
+ * @brief All tool poses from one tracker frame.
+ */
+typedef struct AuroraShmFrame
+{
+	int64_t timestamp;    //!< Host time [ns] of the frame, see PoseSample::timestamp
+	int64_t requestTime;  //!< Host time [ns] the request was written
+	int64_t replyTime;    //!< Host time [ns] the reply was fully read
+	uint32_t frameNumber; //!< The device frame number
+	int32_t numPoses;     //!< The number of valid entries in poses
+	AuroraShmPose poses[AURORA_SHM_MAX_POSES];
+} AuroraShmFrame;
+
+/**
+ * @brief A frame guarded by a sequence lock. The sequence is odd while the writer is changing the slot.
+ */
+typedef struct AuroraShmSlot
+{
+	volatile uint32_t sequence;
+	uint32_t index; //!< The publication index of the frame, counted from 0
+	AuroraShmFrame frame;
+} AuroraShmSlot;
+
+/**
+ * @brief The whole segment.
+ */
+typedef struct AuroraShmSegment
+{
+	uint32_t magic;      //!< AURORA_SHM_MAGIC, written last when the segment is created
+	uint32_t version;    //!< AURORA_SHM_VERSION
+	uint32_t frameSize;  //!< sizeof(AuroraShmFrame), to catch readers built with a different layout
+	uint32_t ringSize;   //!< AURORA_SHM_RING_SIZE
+	volatile uint32_t framesWritten; //!< The number of frames published; frame n is in ring[n % ringSize]
+	uint32_t writerAlive; //!< Nonzero while the publisher has the segment open
+	AuroraShmSlot latest;
+	AuroraShmSlot ring[AURORA_SHM_RING_SIZE];
+} AuroraShmSegment;
+
+/*
+ * Memory ordering
+ */
+AURORA_SHM_INLINE uint32_t auroraShmLoadAcquire(const volatile uint32_t* value)
+{
+#if defined(_MSC_VER)
+	uint32_t result = *value;
+	MemoryBarrier();
+	return result;
+#else
+	return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+AURORA_SHM_INLINE void auroraShmStoreRelease(volatile uint32_t* value, uint32_t newValue)
+{
+#if defined(_MSC_VER)
+	MemoryBarrier();
+	*value = newValue;
+#else
+	__atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+#endif
+}
+
+AURORA_SHM_INLINE void auroraShmFence(void)
+{
+#if defined(_MSC_VER)
+	MemoryBarrier();
+#else
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * @brief Writes a frame into a slot. Only the publisher calls this.
+ */
+AURORA_SHM_INLINE void auroraShmSlotWrite(AuroraShmSlot* slot, const AuroraShmFrame* frame, uint32_t index)
+{
+	uint32_t sequence = slot->sequence;
+	slot->sequence = sequence + 1;
+	auroraShmFence();
+	slot->index = index;
+	memcpy(&slot->frame, frame, sizeof(AuroraShmFrame));
+	auroraShmStoreRelease(&slot->sequence, sequence + 2);
+}
+
+/**
+ * @brief Makes one attempt to copy a consistent frame out of a slot.
+ * @returns 1 on success, 0 if the writer was changing the slot.
+ */
+AURORA_SHM_INLINE int auroraShmSlotTryRead(const AuroraShmSlot* slot, AuroraShmFrame* frame, uint32_t* index)
+{
+	uint32_t before = auroraShmLoadAcquire(&slot->sequence);
+	if (before & 1u)
+	{
+		return 0;
+	}
+	*index = slot->index;
+	memcpy(frame, &slot->frame, sizeof(AuroraShmFrame));
+	auroraShmFence();
+	return auroraShmLoadAcquire(&slot->sequence) == before;
+}
+
+/*
+ * Reader API
+ */
+
+/**
+ * @brief A process's attachment to the segment.
+ */
+typedef struct AuroraShmReader
+{
+	const AuroraShmSegment* segment;
+	uint32_t nextIndex; //!< The publication index auroraShmReadNext() returns next
+	uint32_t missed;    //!< The number of frames overwritten before auroraShmReadNext() got to them
+#ifdef _WIN32
+	HANDLE mapping;
+#endif
+} AuroraShmReader;
+
+/**
+ * @brief Attaches to a published segment.
+ * @param reader The reader to initialize.
+ * @param name The segment name, usually AURORA_SHM_DEFAULT_NAME.
+ * @returns 0 on success, -1 if no segment is published under the name, -2 if it has an incompatible layout.
+ */
+AURORA_SHM_INLINE int auroraShmOpen(AuroraShmReader* reader, const char* name)
+{
+	const AuroraShmSegment* segment = NULL;
+	reader->segment = NULL;
+	reader->nextIndex = 0;
+	reader->missed = 0;
+#ifdef _WIN32
+	reader->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+	if (reader->mapping == NULL)
+	{
+		return -1;
+	}
+	segment = (const AuroraShmSegment*)MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0, sizeof(AuroraShmSegment));
+	if (segment == NULL)
+	{
+		CloseHandle(reader->mapping);
+		return -1;
+	}
+#else
+	struct stat info;
+	void* address;
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(AuroraShmSegment))
+	{
+		close(fd);
+		return -2;
+	}
+	address = mmap(NULL, sizeof(AuroraShmSegment), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (address == MAP_FAILED)
+	{
+		return -1;
+	}
+	segment = (const AuroraShmSegment*)address;
+#endif
+	reader->segment = segment;
+	if (auroraShmLoadAcquire(&segment->magic) != AURORA_SHM_MAGIC || segment->version != AURORA_SHM_VERSION ||
+		segment->frameSize != sizeof(AuroraShmFrame) || segment->ringSize != AURORA_SHM_RING_SIZE)
+	{
+		return -2;
+	}
+	// Start with the frames published from now on
+	reader->nextIndex = auroraShmLoadAcquire(&segment->framesWritten);
+	return 0;
+}
+
+/**
+ * @brief Detaches from the segment.
+ */
+AURORA_SHM_INLINE void auroraShmClose(AuroraShmReader* reader)
+{
+	if (reader->segment == NULL)
+	{
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(reader->segment);
+	CloseHandle(reader->mapping);
+#else
+	munmap((void*)reader->segment, sizeof(AuroraShmSegment));
+#endif
+	reader->segment = NULL;
+}
+
+/**
+ * @brief Returns the number of frames published so far.
+ */
+AURORA_SHM_INLINE uint32_t auroraShmFramesWritten(const AuroraShmReader* reader)
+{
+	return auroraShmLoadAcquire(&reader->segment->framesWritten);
+}
+
+/**
+ * @brief Returns nonzero while the publisher has the segment open.
+ */
+AURORA_SHM_INLINE int auroraShmWriterAlive(const AuroraShmReader* reader)
+{
+	return auroraShmLoadAcquire(&reader->segment->writerAlive) != 0;
+}
+
+/**
+ * @brief Copies the most recent frame.
+ * @returns 1 if a frame was copied, 0 if nothing has been published yet.
+ */
+AURORA_SHM_INLINE int auroraShmReadLatest(const AuroraShmReader* reader, AuroraShmFrame* frame)
+{
+	uint32_t index;
+	if (auroraShmFramesWritten(reader) == 0)
+	{
+		return 0;
+	}
+	while (!auroraShmSlotTryRead(&reader->segment->latest, frame, &index))
+	{
+	}
+	return 1;
+}
+
+/**
+ * @brief Copies the next frame this reader has not seen, in publication order.
+ * @details A reader that falls more than AURORA_SHM_RING_SIZE frames behind skips to the oldest frame
+ *          still in the ring and adds the frames it lost to reader->missed.
+ * @returns 1 if a frame was copied, 0 if the reader has seen every published frame.
+ */
+AURORA_SHM_INLINE int auroraShmReadNext(AuroraShmReader* reader, AuroraShmFrame* frame)
+{
+	const AuroraShmSegment* segment = reader->segment;
+	for (;;)
+	{
+		uint32_t written = auroraShmLoadAcquire(&segment->framesWritten);
+		uint32_t index;
+		if (written == reader->nextIndex)
+		{
+			return 0;
+		}
+		if (written - reader->nextIndex > AURORA_SHM_RING_SIZE)
+		{
+			reader->missed += written - AURORA_SHM_RING_SIZE - reader->nextIndex;
+			reader->nextIndex = written - AURORA_SHM_RING_SIZE;
+		}
+		if (auroraShmSlotTryRead(&segment->ring[reader->nextIndex % AURORA_SHM_RING_SIZE], frame, &index) &&
+			index == reader->nextIndex)
+		{
+			reader->nextIndex++;
+			return 1;
+		}
+		// The slot was being overwritten with a newer frame: recheck how far behind the reader is
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AURORA_POSE_SHM_H
@@ -178,7 +178,7 @@ public:
 	* @param this function does not take any parameters
 	* @return this returns the error code associated with the response of the commandSent via sendCommand
 	*/
-	int CombinedApi::testFunction(std::string result);
+	int testFunction(std::string result);
 
 
 	/**
@@ -308,7 +308,7 @@ public:
 
 
 	//This is the custom function I made to convert all the data into double format
-	void returnTrackingDataFormated(std::string currentData, double returnFormattedDataArray[7][4], int sizeOfData,int sensorIndex,double previousPositions[3][4]) const;
+	void returnTrackingDataFormated(std::string currentData, double returnFormattedDataArray[7][4], int sizeOfData,int sensorIndex,double previousPositions[7][4]) const;
 
 
 
@@ -385,7 +385,7 @@ private:
 };
 
 //! These strings translate the warning code (the array index) to a descriptive message
-static const char* warningStrings[] =
+static const char* const warningStrings[] =
 {
 	"OKAY", // 0x0 not a warning
 	"Possible hardware fault",
@@ -396,7 +396,7 @@ static const char* warningStrings[] =
 };
 
 //! These strings translate the error code (the array index) to a descriptive message
-static const char* errorStrings[] =
+static const char* const errorStrings[] =
 {
 	"OKAY", // 0x00 not an error
 	"Invalid command.",
@@ -0,0 +1,482 @@
+#ifndef COMMAND_SESSION_HPP
+#define COMMAND_SESSION_HPP
+
+#include <cstring>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "CombinedApi.h"
+#include "Connection.h"
+#include "ReplyFramer.h"
+
+/**
+ * @brief The status of one port handle, as returned by PHSR.
+ */
+struct PortHandleStatus
+{
+	uint16_t handle; //!< The port handle
+	uint16_t status; //!< The port status flags (see PortHandleInfo)
+};
+
+/**
+ * @brief What PHINF reports about the tool in a port, without the five std::string members of PortHandleInfo.
+ */
+struct PortHandleDetails
+{
+	uint16_t handle;
+	char toolType[9];     //!< Eight characters, eg. "0A000000"
+	char toolId[13];      //!< The manufacturer's ID, twelve characters
+	char revision[4];     //!< The tool revision, three characters
+	char serialNumber[9]; //!< The serial number, eight hex characters
+	uint16_t status;      //!< The port status flags
+};
+
+/**
+ * @brief A command serialized once, with its CRC16 and CR, so that sending it is a single write.
+ */
+struct PrecompiledCommand
+{
+	//! The longest precompiled command, including the CRC16 and CR
+	static const int MAX_LENGTH = 48;
+
+	char bytes[MAX_LENGTH];
+	int length;
+};
+
+/**
+ * @brief Sends commands to the SCU over any Connection (eg. LowLatencySerialConnection) without allocating.
+ * @details CombinedApi takes every port handle as a std::string, builds each command from temporary strings
+ *          and returns PortHandleInfo objects holding five more. This session keeps one command buffer and
+ *          one reply buffer for its lifetime: port handles are uint16_t, commands are formatted into the
+ *          command buffer, and replies are framed and parsed in place in the buffer of a ReplyFramer.
+ *          Bring-up of any number of handles, and any per-frame per-handle query, performs no heap allocation.
+ *          Results follow CombinedApi: 0 (or a count) on success, the negated device error code for an ERROR
+ *          reply, or one of the negative transport errors below.
+ *          Recurring commands, above all the TX or BX sent every frame, are serialized once per option set
+ *          with their CRC16 and kept in a small cache; sending one is then a single Connection::write of a
+ *          fixed buffer.
+ *          The session and CombinedApi must not share a connection.
+ */
+class CommandSession
+{
+public:
+	//! The longest command, including the CR
+	static const int MAX_COMMAND_LENGTH = 128;
+
+	//! The longest reply, including the CRC16 and CR
+	static const int MAX_REPLY_LENGTH = ReplyFramer::CAPACITY;
+
+	//! The largest number of port handles the device reports
+	static const int MAX_PORT_HANDLES = 64;
+
+	//! The number of precompiled commands the cache keeps
+	static const int COMMAND_CACHE_SIZE = 8;
+
+	//! No complete reply arrived
+	static const int ERROR_TIMEOUT = ReplyFramer::ERROR_TIMEOUT;
+
+	//! The reply's CRC16 did not match its contents
+	static const int ERROR_CRC = ReplyFramer::ERROR_CRC;
+
+	//! The command could not be written
+	static const int ERROR_WRITE = -0x102;
+
+	//! The reply did not fit the reply buffer, or could not be parsed
+	static const int ERROR_REPLY = ReplyFramer::ERROR_REPLY;
+
+	explicit CommandSession(Connection& connection)
+		: connection_(connection), framer_(connection), lastWarning_(0), cacheUsed_(0), cacheNext_(0), cacheMisses_(0)
+	{
+		command_[0] = '\0';
+		reply_.data = "";
+		reply_.length = 0;
+		reply_.binary = false;
+	}
+
+	//! Sends INIT
+	int initialize()
+	{
+		return transact(begin("INIT "));
+	}
+
+	/**
+	 * @brief Sends RESET. The device answers RESET, then restarts with its ports freed.
+	 */
+	int reset()
+	{
+		return transact(begin("RESET "));
+	}
+
+	/**
+	 * @brief Sends COMM. The device switches to the new settings after its OKAY, so the host switches after it too.
+	 * @param baudRate The new baud rate.
+	 * @param enableHandshake Enables or disables hardware handshaking: { 0 = Off, 1 = On}
+	 */
+	int setCommParams(CommBaudRateEnum::value baudRate, int enableHandshake = 1)
+	{
+		char* end = begin("COMM ");
+		*end++ = static_cast<char>('0' + baudRate);
+		*end++ = '0'; // 8 data bits
+		*end++ = '0'; // no parity
+		*end++ = '0'; // 1 stop bit
+		*end++ = enableHandshake != 0 ? '1' : '0';
+		return transact(end);
+	}
+
+	/**
+	 * @brief Reads a reply the device sends unprompted, eg. RESET after a serial break.
+	 */
+	int awaitReply()
+	{
+		return readReply();
+	}
+
+	//! Drops the bytes the framer has buffered, eg. after the port was flushed
+	void discardReplies()
+	{
+		framer_.discard();
+	}
+
+	/**
+	 * @brief Sends PHSR and decodes the handles it lists.
+	 * @param handles Receives up to capacity handles.
+	 * @returns The number of handles reported (which may exceed capacity), or an error.
+	 */
+	int portHandleSearch(PortHandleSearchRequestOption::value option, PortHandleStatus* handles, int capacity)
+	{
+		char* end = begin("PHSR ");
+		end = writeHex(end, option, 2);
+		int result = transact(end);
+		if (result < 0)
+		{
+			return result;
+		}
+		// nn, then hhsss for each handle
+		int count = parseHex(reply_.data, 2);
+		if (count < 0 || reply_.length < 2 + 5 * count)
+		{
+			return ERROR_REPLY;
+		}
+		for (int i = 0; i < count && i < capacity; i++)
+		{
+			const char* record = reply_.data + 2 + 5 * i;
+			handles[i].handle = static_cast<uint16_t>(parseHex(record, 2));
+			handles[i].status = static_cast<uint16_t>(parseHex(record + 2, 3));
+		}
+		return count;
+	}
+
+	//! Sends PHF for the handle
+	int portHandleFree(uint16_t handle)
+	{
+		return transact(writeHex(begin("PHF "), handle, 2));
+	}
+
+	//! Sends PINIT for the handle
+	int portHandleInitialize(uint16_t handle)
+	{
+		return transact(writeHex(begin("PINIT "), handle, 2));
+	}
+
+	//! Sends PENA for the handle
+	int portHandleEnable(uint16_t handle, ToolTrackingPriority::value priority = ToolTrackingPriority::Dynamic)
+	{
+		char* end = writeHex(begin("PENA "), handle, 2);
+		*end++ = static_cast<char>(priority);
+		return transact(end);
+	}
+
+	/**
+	 * @brief Sends PHINF (option 0001) for the handle and decodes the tool information.
+	 */
+	int portHandleInfo(uint16_t handle, PortHandleDetails& details)
+	{
+		char* end = writeHex(begin("PHINF "), handle, 2);
+		end = writeHex(end, 0x0001, 4);
+		int result = transact(end);
+		if (result < 0)
+		{
+			return result;
+		}
+		// Tool type (8), manufacturer ID (12), revision (3), serial number (8), port status (2)
+		if (reply_.length < 33)
+		{
+			return ERROR_REPLY;
+		}
+		details.handle = handle;
+		copyField(details.toolType, reply_.data, 8);
+		copyField(details.toolId, reply_.data + 8, 12);
+		copyField(details.revision, reply_.data + 20, 3);
+		copyField(details.serialNumber, reply_.data + 23, 8);
+		details.status = static_cast<uint16_t>(parseHex(reply_.data + 31, 2));
+		return 0;
+	}
+
+	//! Sends TSTART
+	int startTracking()
+	{
+		return transact(begin("TSTART "));
+	}
+
+	//! Sends TSTOP
+	int stopTracking()
+	{
+		return transact(begin("TSTOP "));
+	}
+
+	/**
+	 * @brief Sends a command and reads its reply.
+	 * @param command The command without its trailing CR, eg. "BEEP 1".
+	 * @returns 0 for OKAY or any other data reply, or an error.
+	 */
+	int sendCommand(const char* command)
+	{
+		size_t length = std::strlen(command);
+		if (length + 1 > static_cast<size_t>(MAX_COMMAND_LENGTH))
+		{
+			return ERROR_WRITE;
+		}
+		std::memcpy(command_, command, length);
+		return transact(command_ + length);
+	}
+
+	/**
+	 * @brief Requests tracking data with TX and reads the ASCII reply into reply().
+	 * @param options The TrackingReplyOption flags.
+	 */
+	int trackingDataTX(uint16_t options = TrackingReplyOption::TransformData | TrackingReplyOption::AllTransforms)
+	{
+		return send(cachedCommand("TX", options));
+	}
+
+	/**
+	 * @brief Requests tracking data with BX and reads the binary reply: reply() then holds the body of the
+	 *        reply, after the header and without the CRC16.
+	 * @param options The TrackingReplyOption flags.
+	 */
+	int trackingDataBX(uint16_t options = TrackingReplyOption::TransformData | TrackingReplyOption::AllTransforms)
+	{
+		const PrecompiledCommand& command = cachedCommand("BX", options);
+		if (connection_.write(command.bytes, command.length) != command.length)
+		{
+			return ERROR_WRITE;
+		}
+		return readBinaryReply();
+	}
+
+	/**
+	 * @brief Serializes a command as NAME:PARAMETERS followed by its CRC16 and CR.
+	 * @returns False if the command does not fit a PrecompiledCommand.
+	 */
+	static bool precompile(const char* name, const char* parameters, PrecompiledCommand& command)
+	{
+		size_t nameLength = std::strlen(name);
+		size_t parametersLength = std::strlen(parameters);
+		if (nameLength + 1 + parametersLength + 5 > static_cast<size_t>(PrecompiledCommand::MAX_LENGTH))
+		{
+			command.length = 0;
+			return false;
+		}
+		char* end = command.bytes;
+		std::memcpy(end, name, nameLength);
+		end += nameLength;
+		*end++ = ':';
+		std::memcpy(end, parameters, parametersLength);
+		end += parametersLength;
+		end = writeHex(end, crc16(command.bytes, static_cast<int>(end - command.bytes)), 4);
+		*end++ = CR;
+		command.length = static_cast<int>(end - command.bytes);
+		return true;
+	}
+
+	/**
+	 * @brief Returns the precompiled form of a command with a four digit hex option, serializing it on first use.
+	 * @param name A command name of up to seven characters, eg. "BX".
+	 * @details The cache holds COMMAND_CACHE_SIZE commands and replaces the oldest when full.
+	 */
+	const PrecompiledCommand& cachedCommand(const char* name, uint16_t options)
+	{
+		for (int i = 0; i < cacheUsed_; i++)
+		{
+			if (cache_[i].options == options && std::strcmp(cache_[i].name, name) == 0)
+			{
+				return cache_[i].command;
+			}
+		}
+		cacheMisses_++;
+		CacheEntry& entry = cache_[cacheNext_];
+		cacheNext_ = (cacheNext_ + 1) % COMMAND_CACHE_SIZE;
+		if (cacheUsed_ < COMMAND_CACHE_SIZE)
+		{
+			cacheUsed_++;
+		}
+		std::strncpy(entry.name, name, sizeof(entry.name) - 1);
+		entry.name[sizeof(entry.name) - 1] = '\0';
+		entry.options = options;
+		char parameters[5];
+		writeHex(parameters, options, 4);
+		parameters[4] = '\0';
+		precompile(entry.name, parameters, entry.command);
+		return entry.command;
+	}
+
+	/**
+	 * @brief Sends a precompiled command with a single write and reads its ASCII reply.
+	 */
+	int send(const PrecompiledCommand& command)
+	{
+		if (connection_.write(command.bytes, command.length) != command.length)
+		{
+			return ERROR_WRITE;
+		}
+		return readReply();
+	}
+
+	//! Returns the number of commands serialized because they were not in the cache
+	uint64_t cacheMisses() const { return cacheMisses_; }
+
+	//! Returns the last reply without its CRC16 and CR (and without its header if binary). Valid until the next command
+	const char* reply() const { return reply_.data; }
+
+	//! Returns the length of reply()
+	int replyLength() const { return reply_.length; }
+
+	//! Returns true if the last reply was a binary (BX) reply
+	bool replyIsBinary() const { return reply_.binary; }
+
+	//! Returns true if the last reply was exactly text
+	bool replyIs(const char* text) const
+	{
+		return !reply_.binary && reply_.length == static_cast<int>(std::strlen(text)) && std::memcmp(reply_.data, text, reply_.length) == 0;
+	}
+
+	//! Returns the code of the last WARNING reply, or 0 if the last reply was not a warning
+	int lastWarning() const { return lastWarning_; }
+
+	//! Computes the CRC16 the device appends to its replies (see ReplyFramer::crc16())
+	static uint16_t crc16(const char* data, int length)
+	{
+		return ReplyFramer::crc16(data, length);
+	}
+
+	//! Writes value as width upper case hex digits and returns the end of the digits
+	static char* writeHex(char* out, unsigned int value, int width)
+	{
+		static const char digits[] = "0123456789ABCDEF";
+		for (int i = width - 1; i >= 0; i--)
+		{
+			out[i] = digits[value & 0xF];
+			value >>= 4;
+		}
+		return out + width;
+	}
+
+	//! Parses width hex digits, or returns -1 if one of them is not a hex digit
+	static int parseHex(const char* text, int width)
+	{
+		return ReplyFramer::parseHex(text, width);
+	}
+
+protected:
+	//! Starts a command with its name and returns where the parameters go
+	char* begin(const char* name)
+	{
+		size_t length = std::strlen(name);
+		std::memcpy(command_, name, length);
+		return command_ + length;
+	}
+
+	/**
+	 * @brief Terminates the command in the buffer at end with a CR, sends it and reads the reply.
+	 */
+	int transact(char* end)
+	{
+		*end++ = CR;
+		int length = static_cast<int>(end - command_);
+		if (connection_.write(command_, length) != length)
+		{
+			return ERROR_WRITE;
+		}
+		return readReply();
+	}
+
+	/**
+	 * @brief Reads an ASCII reply, checks its CRC16 and interprets OKAY, ERROR and WARNING.
+	 */
+	int readReply()
+	{
+		int result = framer_.next(reply_);
+		if (result != 0)
+		{
+			return result;
+		}
+		if (reply_.binary)
+		{
+			return ERROR_REPLY;
+		}
+		return interpret();
+	}
+
+	/**
+	 * @brief Reads a binary reply. The device answers with an ASCII ERROR reply instead when it rejects the
+	 *        command.
+	 */
+	int readBinaryReply()
+	{
+		int result = framer_.next(reply_);
+		if (result != 0 || reply_.binary)
+		{
+			return result;
+		}
+		return interpret();
+	}
+
+	//! Converts an OKAY, ERRORxx or WARNINGxx reply into a result
+	int interpret()
+	{
+		lastWarning_ = 0;
+		if (reply_.length == 7 && std::memcmp(reply_.data, "ERROR", 5) == 0)
+		{
+			int code = parseHex(reply_.data + 5, 2);
+			if (code <= 0)
+			{
+				return ERROR_REPLY;
+			}
+			return -code;
+		}
+		if (reply_.length == 9 && std::memcmp(reply_.data, "WARNING", 7) == 0)
+		{
+			lastWarning_ = parseHex(reply_.data + 7, 2);
+		}
+		return 0;
+	}
+
+	static void copyField(char* field, const char* text, int length)
+	{
+		std::memcpy(field, text, length);
+		field[length] = '\0';
+	}
+
+	//! Terminates every command
+	static const char CR = '\r';
+
+	struct CacheEntry
+	{
+		char name[8];
+		uint16_t options;
+		PrecompiledCommand command;
+	};
+
+	Connection& connection_;
+	ReplyFramer framer_;
+	char command_[MAX_COMMAND_LENGTH];
+	ReplyView reply_;
+	int lastWarning_;
+
+	CacheEntry cache_[COMMAND_CACHE_SIZE];
+	int cacheUsed_;
+	int cacheNext_;
+	uint64_t cacheMisses_;
+};
+
+#endif // COMMAND_SESSION_HPP
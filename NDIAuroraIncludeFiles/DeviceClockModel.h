@@ -0,0 +1,225 @@
+#ifndef DEVICE_CLOCK_MODEL_HPP
+#define DEVICE_CLOCK_MODEL_HPP
+
+#include <algorithm>
+#include <cmath>
+
+#include <stdint.h> // for uint8_t etc...
+
+/**
+ * @brief Maps device frame numbers to host time, so every frame gets a timestamp free of transport jitter.
+ * @details The host sees each frame after USB, driver and scheduling delays that vary by milliseconds, but
+ *          the SCU numbers its frames at a stable rate. The model fits host time = offset + period * frame
+ *          by least squares over a sliding window of recent frames, which estimates the offset between the
+ *          clocks and the drift of the device clock (the period differs slightly from the nominal 25 ms).
+ *          Observations whose residual is more than a few robust standard deviations (from the median
+ *          absolute residual) are left out of the fit, so a late reply does not bend the line. If the
+ *          observations keep disagreeing with the model, the device was probably reset and the model
+ *          starts over. Times are AcquisitionClock nanoseconds.
+ */
+class DeviceClockModel
+{
+public:
+	//! The Aurora measures at 40 Hz
+	static const int64_t NOMINAL_PERIOD_NS = 25000000;
+
+	//! The largest fit window
+	static const int MAX_WINDOW = 1024;
+
+	//! The number of frames fitted before timestamps are corrected
+	static const int LOCK_FRAMES = 16;
+
+	//! The number of consecutive outliers that make the model start over
+	static const int MAX_CONSECUTIVE_OUTLIERS = 8;
+
+	/**
+	 * @param window The number of recent frames fitted. Longer windows average out more jitter, shorter
+	 *               ones follow changes in drift (eg. as the SCU warms up) more quickly.
+	 * @param rejectThreshold Residuals beyond this many robust standard deviations are outliers.
+	 */
+	explicit DeviceClockModel(int window = 400, double rejectThreshold = 4.0)
+		: windowSize_(window < LOCK_FRAMES ? LOCK_FRAMES : (window > MAX_WINDOW ? MAX_WINDOW : window)),
+		  rejectThreshold_(rejectThreshold), minSigmaNs_(50000.0)
+	{
+		reset();
+	}
+
+	//! Sets the smallest residual spread assumed, so a run of very regular replies cannot make the model reject everything [ns]
+	void setMinimumSigma(double nanoseconds) { minSigmaNs_ = nanoseconds; }
+
+	//! Forgets every observation
+	void reset()
+	{
+		hasFrame_ = false;
+		lastFrame_ = 0;
+		lastIndex_ = 0;
+		origin_ = 0;
+		count_ = 0;
+		offset_ = 0.0;
+		period_ = static_cast<double>(NOMINAL_PERIOD_NS);
+		sigma_ = 0.0;
+		consecutiveOutliers_ = 0;
+		outliers_ = 0;
+	}
+
+	/**
+	 * @brief Adds the host time at which a frame was observed and returns its corrected timestamp.
+	 * @param frameNumber The device frame number.
+	 * @param hostTime The host time of the observation [ns], eg. the midpoint of the request and reply.
+	 * @returns The host time the model assigns to the frame, or hostTime until the model has locked.
+	 */
+	int64_t observe(uint32_t frameNumber, int64_t hostTime)
+	{
+		int32_t delta = static_cast<int32_t>(frameNumber - lastFrame_);
+		if (hasFrame_ && delta == 0)
+		{
+			return isLocked() ? timestampOf(frameNumber) : hostTime;
+		}
+		// A frame number that goes backwards or jumps by more than the window means the device restarted
+		if (!hasFrame_ || delta < 0 || delta > windowSize_)
+		{
+			reset();
+			hasFrame_ = true;
+			origin_ = hostTime;
+			lastIndex_ = -1;
+			delta = 1;
+		}
+		int64_t index = lastIndex_ + delta;
+		lastFrame_ = frameNumber;
+		lastIndex_ = index;
+
+		double time = static_cast<double>(hostTime - origin_);
+		if (isLocked())
+		{
+			double residual = time - (offset_ + period_ * index);
+			double sigma = sigma_ > minSigmaNs_ ? sigma_ : minSigmaNs_;
+			if (std::fabs(residual) > rejectThreshold_ * sigma)
+			{
+				outliers_++;
+				if (++consecutiveOutliers_ >= MAX_CONSECUTIVE_OUTLIERS)
+				{
+					// The clocks have jumped apart: start over from this observation
+					reset();
+					hasFrame_ = true;
+					lastFrame_ = frameNumber;
+					origin_ = hostTime;
+					lastIndex_ = 0;
+					add(0, 0.0);
+					return hostTime;
+				}
+				return timestampOf(frameNumber);
+			}
+		}
+		consecutiveOutliers_ = 0;
+		add(index, time);
+		fit();
+		return isLocked() ? timestampOf(frameNumber) : hostTime;
+	}
+
+	//! Returns true once enough frames have been fitted to correct timestamps
+	bool isLocked() const { return count_ >= LOCK_FRAMES; }
+
+	//! Returns the host time the model assigns to a frame near the latest one [ns]
+	int64_t timestampOf(uint32_t frameNumber) const
+	{
+		int64_t index = lastIndex_ + static_cast<int32_t>(frameNumber - lastFrame_);
+		return origin_ + static_cast<int64_t>(std::floor(offset_ + period_ * index + 0.5));
+	}
+
+	//! Returns the estimated frame period in host time [ns]
+	double period() const { return period_; }
+
+	//! Returns how much faster the device clock runs than nominal [parts per million]
+	double driftPpm() const { return (static_cast<double>(NOMINAL_PERIOD_NS) / period_ - 1.0) * 1e6; }
+
+	//! Returns the robust standard deviation of the observations about the fit: the jitter removed [ns]
+	double jitter() const { return sigma_; }
+
+	//! Returns the number of observations rejected as outliers
+	uint64_t outliers() const { return outliers_; }
+
+private:
+	struct Observation
+	{
+		int64_t index;
+		double time; //!< Host time relative to origin_ [ns]
+	};
+
+	void add(int64_t index, double time)
+	{
+		Observation& observation = window_[count_ % MAX_WINDOW];
+		observation.index = index;
+		observation.time = time;
+		count_++;
+	}
+
+	//! Refits the line to the window and updates the residual spread
+	void fit()
+	{
+		int n = count_ < windowSize_ ? count_ : windowSize_;
+		if (n < 2)
+		{
+			offset_ = n == 1 ? window_[(count_ - 1) % MAX_WINDOW].time : 0.0;
+			return;
+		}
+		// Least squares about the mean, to keep the sums small
+		double meanIndex = 0.0;
+		double meanTime = 0.0;
+		for (int i = 0; i < n; i++)
+		{
+			const Observation& observation = window_[(count_ - 1 - i) % MAX_WINDOW];
+			meanIndex += observation.index;
+			meanTime += observation.time;
+		}
+		meanIndex /= n;
+		meanTime /= n;
+		double sxy = 0.0;
+		double sxx = 0.0;
+		for (int i = 0; i < n; i++)
+		{
+			const Observation& observation = window_[(count_ - 1 - i) % MAX_WINDOW];
+			double dx = observation.index - meanIndex;
+			sxy += dx * (observation.time - meanTime);
+			sxx += dx * dx;
+		}
+		// Accept the slope only near the nominal rate, so a burst of bad timing cannot derail the model
+		double slope = sxx > 0.0 ? sxy / sxx : period_;
+		if (slope > 0.5 * NOMINAL_PERIOD_NS && slope < 2.0 * NOMINAL_PERIOD_NS)
+		{
+			period_ = slope;
+		}
+		offset_ = meanTime - period_ * meanIndex;
+
+		// 1.4826 * median absolute residual estimates the standard deviation of normally distributed jitter
+		for (int i = 0; i < n; i++)
+		{
+			const Observation& observation = window_[(count_ - 1 - i) % MAX_WINDOW];
+			residuals_[i] = std::fabs(observation.time - (offset_ + period_ * observation.index));
+		}
+		std::nth_element(residuals_, residuals_ + n / 2, residuals_ + n);
+		sigma_ = 1.4826 * residuals_[n / 2];
+	}
+
+	int windowSize_;
+	double rejectThreshold_;
+	double minSigmaNs_;
+
+	bool hasFrame_;
+	uint32_t lastFrame_;
+	int64_t lastIndex_;
+
+	//! The host time of the first observation, subtracted from every time before it is fitted
+	int64_t origin_;
+
+	Observation window_[MAX_WINDOW];
+	double residuals_[MAX_WINDOW];
+	int count_;
+
+	double offset_;
+	double period_;
+	double sigma_;
+	int consecutiveOutliers_;
+	uint64_t outliers_;
+};
+
+#endif // DEVICE_CLOCK_MODEL_HPP
@@ -0,0 +1,213 @@
+#ifndef EVENT_LOG_HPP
+#define EVENT_LOG_HPP
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "AcquisitionClock.h"
+#include "RealtimeThread.h"
+
+/**
+ * @brief One diagnostic, recorded as a fixed-size binary record and formatted later.
+ */
+struct LogEvent
+{
+	LogEvent() : timestampNs(0), code(0), handle(0), value(0), detail(0.0) {}
+
+	int64_t timestampNs; //!< When the event was logged, on AcquisitionClock [ns]
+	uint16_t code;       //!< What happened, as defined by the formatter
+	uint16_t handle;     //!< The port handle concerned, or 0
+	int32_t value;       //!< An integer argument, eg. an error code or a count
+	double detail;       //!< A numeric argument, eg. a duration
+};
+
+/**
+ * @brief Writes the text of an event into text, without a line end.
+ * @returns The length written, or a negative value to drop the event.
+ */
+typedef int (*EventFormatter)(const LogEvent& event, char* text, int capacity);
+
+/**
+ * @brief Takes diagnostics off a real-time thread: log() copies a LogEvent into a lock-free ring, and a
+ *        background thread formats the events and writes them out.
+ * @details Writing a line with std::endl from a step formats a string and flushes the stream while the
+ *          step waits, which can take milliseconds when the output is a console. log() instead claims a
+ *          slot with one compare-and-swap and copies 24 bytes, without allocating or taking a lock, from
+ *          any number of threads. When the ring is full, the event is dropped and counted rather than
+ *          blocking the caller. The background thread wakes every FLUSH_INTERVAL_MS. It formats whatever
+ *          has been logged with the EventFormatter and flushes the stream once per batch. Events logged
+ *          before start() wait in the ring, and stop() writes everything logged before it.
+ */
+class EventLog
+{
+public:
+	enum
+	{
+		DEFAULT_CAPACITY = 256, //!< Events the ring holds, rounded up to a power of two
+		FLUSH_INTERVAL_MS = 10, //!< How often the background thread looks for events [ms]
+		MAX_LINE_LENGTH = 256   //!< The longest line the formatter may write, including its line end
+	};
+
+	explicit EventLog(EventFormatter formatter, std::ostream& out = std::cout, size_t capacity = DEFAULT_CAPACITY)
+		: formatter_(formatter), out_(out), slots_(roundUp(capacity)), mask_(slots_.size() - 1), tail_(0), head_(0),
+		  running_(false), dropped_(0), written_(0)
+	{
+		for (size_t i = 0; i < slots_.size(); i++)
+		{
+			slots_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	~EventLog()
+	{
+		stop();
+	}
+
+	//! Starts the background thread
+	void start()
+	{
+		if (thread_.joinable())
+		{
+			return;
+		}
+		RealtimeThread::prefault(slots_.data(), slots_.size() * sizeof(Slot));
+		running_ = true;
+		thread_ = std::thread(&EventLog::run, this);
+	}
+
+	//! Stops the background thread once it has written every event logged so far
+	void stop()
+	{
+		running_ = false;
+		if (thread_.joinable())
+		{
+			thread_.join();
+		}
+		drain();
+	}
+
+	/**
+	 * @brief Records an event without blocking. Safe from any thread.
+	 * @returns False if the ring was full and the event was dropped.
+	 */
+	bool log(uint16_t code, uint16_t handle = 0, int32_t value = 0, double detail = 0.0)
+	{
+		size_t position = tail_.load(std::memory_order_relaxed);
+		Slot* slot;
+		for (;;)
+		{
+			slot = &slots_[position & mask_];
+			size_t sequence = slot->sequence.load(std::memory_order_acquire);
+			if (sequence == position)
+			{
+				if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (sequence < position)
+			{
+				dropped_.fetch_add(1, std::memory_order_relaxed);
+				return false; // The writer hasn't caught up with the slot a lap ago
+			}
+			else
+			{
+				position = tail_.load(std::memory_order_relaxed);
+			}
+		}
+		slot->event.timestampNs = AcquisitionClock::now();
+		slot->event.code = code;
+		slot->event.handle = handle;
+		slot->event.value = value;
+		slot->event.detail = detail;
+		slot->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	//! Returns the number of events dropped because the ring was full
+	uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+	//! Returns the number of events written out
+	uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+
+private:
+	struct Slot
+	{
+		std::atomic<size_t> sequence; //!< Equals the position a writer may claim, or that position + 1 once the event is in
+		LogEvent event;
+	};
+
+	static size_t roundUp(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity)
+		{
+			size *= 2;
+		}
+		return size;
+	}
+
+	void run()
+	{
+		while (running_)
+		{
+			drain();
+			std::this_thread::sleep_for(std::chrono::milliseconds(FLUSH_INTERVAL_MS));
+		}
+	}
+
+	//! Formats and writes every event logged so far. Only the background thread, or stop() once it has joined, drains
+	void drain()
+	{
+		char line[MAX_LINE_LENGTH];
+		bool wrote = false;
+		for (;;)
+		{
+			Slot& slot = slots_[head_ & mask_];
+			if (slot.sequence.load(std::memory_order_acquire) != head_ + 1)
+			{
+				break;
+			}
+			LogEvent event = slot.event;
+			slot.sequence.store(head_ + slots_.size(), std::memory_order_release);
+			head_++;
+
+			int length = formatter_(event, line, MAX_LINE_LENGTH - 1);
+			if (length < 0)
+			{
+				continue;
+			}
+			if (length > MAX_LINE_LENGTH - 2)
+			{
+				length = MAX_LINE_LENGTH - 2;
+			}
+			line[length++] = '\n';
+			out_.write(line, length);
+			written_.fetch_add(1, std::memory_order_relaxed);
+			wrote = true;
+		}
+		if (wrote)
+		{
+			out_.flush();
+		}
+	}
+
+	EventFormatter formatter_;
+	std::ostream& out_;
+	std::vector<Slot> slots_;
+	const size_t mask_;
+	std::atomic<size_t> tail_;
+	size_t head_;
+
+	std::thread thread_;
+	std::atomic<bool> running_;
+	std::atomic<uint64_t> dropped_;
+	std::atomic<uint64_t> written_;
+};
+
+#endif // EVENT_LOG_HPP
@@ -0,0 +1,266 @@
+#ifndef FRAME_PHASE_SCHEDULER_HPP
+#define FRAME_PHASE_SCHEDULER_HPP
+
+#include <stdint.h> // for uint8_t etc...
+
+/**
+ * @brief Locks tracking requests to the device's frame clock.
+ * @details The SCU measures a new frame every 25 ms (40 Hz) regardless of when the host asks for one, so a
+ *          request made at an arbitrary moment returns data between 0 and 25 ms old, and a request made too
+ *          soon repeats the previous frame. The scheduler models frame i as ready at phase + i * period
+ *          (host time) and learns both terms from the replies:
+ *            - a reply carrying a new frame F to a request made at time t means F was ready by t, and not
+ *              ready at the previous request,
+ *            - a reply repeating the previous frame means the next frame was not ready at t.
+ *          The period is a least squares fit of the narrow brackets among the last MAX_WINDOW frames;
+ *          the phase is the intersection of the brackets over the last few frames. Each request is aimed at the middle
+ *          of the phase bracket plus a small guard, which halves the bracket every frame until it is about
+ *          two guards wide; from then on every request lands just after its frame is ready. When the
+ *          lower bounds age out of the window the scheduler probes at most PROBE_SPAN_NS early, costing
+ *          one repeated frame now and then instead of letting the pose age creep up.
+ *          Times are AcquisitionClock nanoseconds, taken when each request is written.
+ */
+class FramePhaseScheduler
+{
+public:
+	//! The Aurora measures at 40 Hz
+	static const int64_t NOMINAL_PERIOD_NS = 25000000;
+
+	//! The number of frames used to fit the period
+	static const int MAX_WINDOW = 256;
+
+	//! The number of new frames observed before the model is trusted
+	static const int LOCK_FRAMES = 8;
+
+	//! The widest part of the phase bracket a request may probe [ns]
+	static const int64_t PROBE_SPAN_NS = 2000000;
+
+	/**
+	 * @param phaseWindow The number of recent frames whose brackets bound the phase. Longer windows give a
+	 *                    tighter phase, shorter ones follow drift of the device clock more quickly.
+	 */
+	explicit FramePhaseScheduler(int phaseWindow = 80)
+		: phaseWindow_(phaseWindow < 1 ? 1 : (phaseWindow > MAX_WINDOW ? MAX_WINDOW : phaseWindow)),
+		  guardNs_(250000), retryNs_(1000000)
+	{
+		reset();
+	}
+
+	//! Sets how long after the predicted frame time a request is made [ns]
+	void setGuard(int64_t nanoseconds) { guardNs_ = nanoseconds; }
+
+	//! Sets the delay before asking again after a repeated frame [ns]
+	void setRetryInterval(int64_t nanoseconds) { retryNs_ = nanoseconds; }
+
+	//! Forgets the model, eg. after the device was reset
+	void reset()
+	{
+		hasFrame_ = false;
+		lastWasDuplicate_ = false;
+		lastFrame_ = 0;
+		lastIndex_ = 0;
+		lastRequestTime_ = 0;
+		origin_ = 0;
+		count_ = 0;
+		period_ = static_cast<double>(NOMINAL_PERIOD_NS);
+		phaseLow_ = phaseHigh_ = 0.0;
+		newFrames_ = 0;
+		duplicates_ = 0;
+	}
+
+	/**
+	 * @brief Feeds the frame number returned by a request into the model.
+	 * @param frameNumber The frame number of the reply.
+	 * @param requestTime The host time the request was written [ns].
+	 * @returns True if the reply carried a new frame, false if it repeated the previous one.
+	 */
+	bool observe(uint32_t frameNumber, int64_t requestTime)
+	{
+		int32_t delta = static_cast<int32_t>(frameNumber - lastFrame_);
+		if (hasFrame_ && delta == 0)
+		{
+			duplicates_++;
+			lastWasDuplicate_ = true;
+			lastRequestTime_ = requestTime;
+			return false;
+		}
+
+		// A frame number that goes backwards or jumps by more than the window means the device restarted
+		if (!hasFrame_ || delta < 0 || delta > MAX_WINDOW)
+		{
+			reset();
+			hasFrame_ = true;
+			origin_ = requestTime;
+			lastIndex_ = -1;
+			delta = 1;
+		}
+
+		int64_t index = lastIndex_ + delta;
+		double upper = static_cast<double>(requestTime - origin_);
+		double lower = upper - period_;
+		if (count_ > 0 && static_cast<double>(lastRequestTime_ - origin_) > lower)
+		{
+			lower = static_cast<double>(lastRequestTime_ - origin_);
+		}
+
+		Bracket& bracket = window_[count_ % MAX_WINDOW];
+		bracket.index = index;
+		bracket.lower = lower;
+		bracket.upper = upper;
+		count_++;
+		newFrames_++;
+
+		lastFrame_ = frameNumber;
+		lastIndex_ = index;
+		lastRequestTime_ = requestTime;
+		lastWasDuplicate_ = false;
+		estimate();
+		return true;
+	}
+
+	//! Returns true once enough frames have been seen to schedule requests
+	bool isLocked() const { return count_ >= LOCK_FRAMES; }
+
+	//! Returns the estimated frame period [ns]
+	double period() const { return period_; }
+
+	//! Returns the width of the phase bracket: how precisely the frame times are known [ns]
+	double uncertainty() const { return phaseHigh_ - phaseLow_; }
+
+	//! Returns the time by which the given frame is expected to be ready [ns]
+	int64_t frameReadyTime(uint32_t frameNumber) const
+	{
+		int64_t index = lastIndex_ + static_cast<int32_t>(frameNumber - lastFrame_);
+		return origin_ + static_cast<int64_t>(phaseHigh_ + index * period_);
+	}
+
+	/**
+	 * @brief Returns the host time at which to request the frame after the last one observed [ns].
+	 * @details Before the model has locked this is the time of the last request, ie. ask again at once.
+	 */
+	int64_t nextRequestTime() const
+	{
+		if (!isLocked())
+		{
+			return lastRequestTime_;
+		}
+		double low = phaseLow_ > phaseHigh_ - PROBE_SPAN_NS ? phaseLow_ : phaseHigh_ - PROBE_SPAN_NS;
+		double phase = 0.5 * (low + phaseHigh_);
+		int64_t target = origin_ + static_cast<int64_t>(phase + (lastIndex_ + 1) * period_) + guardNs_;
+		if (lastWasDuplicate_ && target < lastRequestTime_ + retryNs_)
+		{
+			target = lastRequestTime_ + retryNs_;
+		}
+		return target;
+	}
+
+	//! Returns the number of replies that carried a new frame
+	uint64_t newFrames() const { return newFrames_; }
+
+	//! Returns the number of replies that repeated the previous frame
+	uint64_t duplicates() const { return duplicates_; }
+
+private:
+	//! The host time interval [ns, relative to origin_] in which frame index became ready
+	struct Bracket
+	{
+		int64_t index;
+		double lower;
+		double upper;
+	};
+
+	//! Refits the period and intersects the recent brackets to bound the phase
+	void estimate()
+	{
+		// Least squares slope of the midpoints of the tight brackets (narrower than a quarter period), about
+		// the mean to keep the sums small. Loose brackets are left out: their upper bound is the scheduled
+		// request time, so fitting them would only return the scheduler's own period
+		int fitCount = count_ < MAX_WINDOW ? count_ : MAX_WINDOW;
+		double tight = 0.25 * NOMINAL_PERIOD_NS;
+		int used = 0;
+		double meanIndex = 0.0;
+		double meanTime = 0.0;
+		for (int i = 0; i < fitCount; i++)
+		{
+			const Bracket& bracket = window_[(count_ - 1 - i) % MAX_WINDOW];
+			if (bracket.upper - bracket.lower < tight)
+			{
+				meanIndex += bracket.index;
+				meanTime += 0.5 * (bracket.lower + bracket.upper);
+				used++;
+			}
+		}
+		if (used >= 2)
+		{
+			meanIndex /= used;
+			meanTime /= used;
+			double sxy = 0.0;
+			double sxx = 0.0;
+			for (int i = 0; i < fitCount; i++)
+			{
+				const Bracket& bracket = window_[(count_ - 1 - i) % MAX_WINDOW];
+				if (bracket.upper - bracket.lower < tight)
+				{
+					double dx = bracket.index - meanIndex;
+					sxy += dx * (0.5 * (bracket.lower + bracket.upper) - meanTime);
+					sxx += dx * dx;
+				}
+			}
+			// Accept the fit only near the nominal rate, so a burst of bad timing cannot derail the model
+			double slope = sxx > 0.0 ? sxy / sxx : 0.0;
+			if (slope > 0.5 * NOMINAL_PERIOD_NS && slope < 2.0 * NOMINAL_PERIOD_NS)
+			{
+				period_ = slope;
+			}
+		}
+
+		int phaseCount = count_ < phaseWindow_ ? count_ : phaseWindow_;
+		double low = -1e300;
+		double high = 1e300;
+		for (int i = 0; i < phaseCount; i++)
+		{
+			const Bracket& bracket = window_[(count_ - 1 - i) % MAX_WINDOW];
+			double offset = bracket.index * period_;
+			if (bracket.lower - offset > low)
+			{
+				low = bracket.lower - offset;
+			}
+			if (bracket.upper - offset < high)
+			{
+				high = bracket.upper - offset;
+			}
+		}
+		// Jitter can leave the brackets without a common point: settle on the middle of the conflict
+		if (low > high)
+		{
+			low = high = 0.5 * (low + high);
+		}
+		phaseLow_ = low;
+		phaseHigh_ = high;
+	}
+
+	int phaseWindow_;
+	int64_t guardNs_;
+	int64_t retryNs_;
+
+	bool hasFrame_;
+	bool lastWasDuplicate_;
+	uint32_t lastFrame_;
+	int64_t lastIndex_;
+	int64_t lastRequestTime_;
+
+	//! The host time of the first request, subtracted from every time before it is fitted
+	int64_t origin_;
+
+	Bracket window_[MAX_WINDOW];
+	int count_;
+
+	double period_;
+	double phaseLow_;
+	double phaseHigh_;
+
+	uint64_t newFrames_;
+	uint64_t duplicates_;
+};
+
+#endif // FRAME_PHASE_SCHEDULER_HPP
@@ -0,0 +1,306 @@
+#ifndef FUSED_ACQUISITION_HPP
+#define FUSED_ACQUISITION_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "ArmSample.h"
+#include "AuroraAcquisition.h"
+#include "LatencyHistogram.h"
+#include "PoseSample.h"
+#include "RealtimeThread.h"
+
+/**
+ * @brief An Aurora frame paired with the arm sample closest to it in time.
+ */
+struct FusedSample
+{
+	ArmSample arm;
+	PoseSample sensors;
+
+	//! arm.timestamp - sensors.timestamp [ns]
+	int64_t skew;
+};
+
+/**
+ * @brief Polls a Kinova arm and the Aurora on parallel threads and pairs their samples on a shared clock.
+ * @details The arm is read through an ArmReader, normally a KinovaArmReader built in a translation unit
+ *          of its own (see ArmSample for why). Each Aurora frame is held until an arm sample
+ *          at or after its timestamp arrives, then paired with whichever of the two bracketing arm
+ *          samples is closer. Pairs further apart than the match tolerance are dropped. Matched pairs
+ *          are queued for hand-eye calibration, and the most recent one is kept for closed-loop control.
+ */
+class FusedAcquisition
+{
+public:
+	//! Fills in everything but the timestamp of an ArmSample, returning false if the arm could not be read
+	typedef std::function<bool(ArmSample&)> ArmReader;
+
+	/**
+	 * @brief Creates an idle fused acquisition.
+	 * @param capi A connected CombinedApi that is already tracking.
+	 * @param readArm Reads the arm state, eg. a KinovaArmReader.
+	 * @param queueCapacity The number of matched pairs kept for popPair() before the oldest is overwritten.
+	 *                      Values below 1 are taken as 1, so that the most recent pair can always be popped.
+	 */
+	FusedAcquisition(CombinedApi& capi, ArmReader readArm, int queueCapacity = 256)
+		: aurora_(capi), readArm_(readArm),
+		  armPeriodNs_(DEFAULT_ARM_PERIOD_NS), toleranceNs_(DEFAULT_TOLERANCE_NS), running_(false),
+		  hasArm_(false), hasPreviousArm_(false), hasPendingSensors_(false), hasLatestPair_(false),
+		  queue_(queueCapacity > 1 ? queueCapacity : 1), queueHead_(0), queueSize_(0), pairsMatched_(0), pairsDropped_(0), armFailures_(0)
+	{
+		aurora_.setSampleCallback(std::bind(&FusedAcquisition::onSensorSample, this, std::placeholders::_1));
+	}
+
+	//! Stops both threads
+	~FusedAcquisition()
+	{
+		stop();
+	}
+
+	//! Sets the interval between arm reads [ns]. Must be called before start().
+	void setArmPeriod(int64_t periodNs) { armPeriodNs_ = periodNs; }
+
+	//! Sets the largest arm/sensor timestamp difference accepted as a pair [ns]
+	void setMatchTolerance(int64_t toleranceNs) { toleranceNs_ = toleranceNs; }
+
+	//! Gives access to the Aurora side, eg. to change its reply options or RealtimeConfig before start()
+	AuroraAcquisition& aurora() { return aurora_; }
+
+	/**
+	 * @brief Sets the CPU, priority and memory locking of the arm thread. Must be called before start().
+	 * @details Give the arm and Aurora threads different CPUs, or the one with the lower priority only runs
+	 *          when the other sleeps.
+	 */
+	void setArmRealtimeConfig(const RealtimeConfig& config) { armRealtimeConfig_ = config; }
+
+	//! Returns what start() managed to apply of the arm thread's RealtimeConfig
+	const RealtimeStatus& armRealtimeStatus() const { return armRealtimeStatus_; }
+
+	//! Returns how late the arm thread woke for each read
+	const LatencyHistogram& armWakeupLatency() const { return armWakeupLatency_; }
+
+	/**
+	 * @brief Starts the arm and Aurora threads.
+	 * @returns True if the threads were started, false if they were already running.
+	 */
+	bool start()
+	{
+		if (running_.exchange(true))
+		{
+			return false;
+		}
+		RealtimeThread::prefault(queue_.data(), queue_.size() * sizeof(FusedSample));
+		armThread_ = std::thread(&FusedAcquisition::runArm, this);
+		armRealtimeStatus_ = RealtimeThread::apply(armThread_.native_handle(), armRealtimeConfig_);
+		aurora_.start();
+		return true;
+	}
+
+	//! Stops both threads
+	void stop()
+	{
+		aurora_.stop();
+		running_ = false;
+		if (armThread_.joinable())
+		{
+			armThread_.join();
+		}
+	}
+
+	/**
+	 * @brief Removes the oldest matched pair from the queue.
+	 * @returns False if the queue is empty.
+	 */
+	bool popPair(FusedSample& pair)
+	{
+		std::lock_guard<std::mutex> lock(matchMutex_);
+		if (queueSize_ == 0)
+		{
+			return false;
+		}
+		pair = queue_[queueHead_];
+		queueHead_ = (queueHead_ + 1) % queue_.size();
+		queueSize_--;
+		return true;
+	}
+
+	/**
+	 * @brief Copies the most recent matched pair without removing anything from the queue.
+	 * @returns False if no pair has been matched yet.
+	 */
+	bool latestPair(FusedSample& pair) const
+	{
+		std::lock_guard<std::mutex> lock(matchMutex_);
+		if (!hasLatestPair_)
+		{
+			return false;
+		}
+		pair = latestPair_;
+		return true;
+	}
+
+	//! Returns the number of pairs matched so far
+	uint64_t pairsMatched() const { return pairsMatched_; }
+
+	//! Returns the number of Aurora frames that had no arm sample within the tolerance
+	uint64_t pairsDropped() const { return pairsDropped_; }
+
+	//! Returns the number of arm reads that failed
+	uint64_t armFailures() const { return armFailures_; }
+
+private:
+	//! The Kinova USB API answers at about 100 Hz
+	static const int64_t DEFAULT_ARM_PERIOD_NS = 10000000;
+
+	//! Half of the Aurora's 25 ms frame period
+	static const int64_t DEFAULT_TOLERANCE_NS = 12500000;
+
+	void runArm()
+	{
+		RealtimeThread::prefaultStack(armRealtimeConfig_.prefaultStackBytes);
+		int64_t nextRead = AcquisitionClock::now();
+		ArmSample sample;
+		while (running_)
+		{
+			int64_t start = AcquisitionClock::now();
+			bool ok = readArm_(sample);
+			int64_t end = AcquisitionClock::now();
+			sample.timestamp = start + (end - start) / 2;
+			if (ok)
+			{
+				onArmSample(sample);
+			}
+			else
+			{
+				armFailures_++;
+			}
+
+			nextRead += armPeriodNs_;
+			int64_t now = AcquisitionClock::now();
+			if (nextRead > now)
+			{
+				AcquisitionClock::sleepUntil(nextRead);
+				armWakeupLatency_.record(AcquisitionClock::now() - nextRead);
+			}
+			else
+			{
+				// Fell behind; don't try to catch up with a burst of reads
+				nextRead = now;
+			}
+		}
+	}
+
+	void onArmSample(const ArmSample& sample)
+	{
+		std::lock_guard<std::mutex> lock(matchMutex_);
+		previousArm_ = arm_;
+		hasPreviousArm_ = hasArm_;
+		arm_ = sample;
+		hasArm_ = true;
+		if (hasPendingSensors_ && arm_.timestamp >= pendingSensors_.timestamp)
+		{
+			matchPending();
+		}
+	}
+
+	void onSensorSample(const PoseSample& sample)
+	{
+		std::lock_guard<std::mutex> lock(matchMutex_);
+		if (hasPendingSensors_)
+		{
+			// The arm stalled for a whole Aurora frame: pair the old frame with what we have
+			matchPending();
+		}
+		pendingSensors_ = sample;
+		hasPendingSensors_ = true;
+		if (hasArm_ && arm_.timestamp >= pendingSensors_.timestamp)
+		{
+			matchPending();
+		}
+	}
+
+	//! Pairs the pending Aurora frame with the closer of the two latest arm samples. Called with matchMutex_ held.
+	void matchPending()
+	{
+		hasPendingSensors_ = false;
+		if (!hasArm_)
+		{
+			pairsDropped_++;
+			return;
+		}
+
+		const ArmSample* best = &arm_;
+		int64_t skew = arm_.timestamp - pendingSensors_.timestamp;
+		if (hasPreviousArm_)
+		{
+			int64_t previousSkew = previousArm_.timestamp - pendingSensors_.timestamp;
+			if (absolute(previousSkew) < absolute(skew))
+			{
+				best = &previousArm_;
+				skew = previousSkew;
+			}
+		}
+		if (absolute(skew) > toleranceNs_)
+		{
+			pairsDropped_++;
+			return;
+		}
+
+		latestPair_.arm = *best;
+		latestPair_.sensors = pendingSensors_;
+		latestPair_.skew = skew;
+		hasLatestPair_ = true;
+
+		size_t tail = (queueHead_ + queueSize_) % queue_.size();
+		queue_[tail] = latestPair_;
+		if (queueSize_ < queue_.size())
+		{
+			queueSize_++;
+		}
+		else
+		{
+			queueHead_ = (queueHead_ + 1) % queue_.size();
+		}
+		pairsMatched_++;
+	}
+
+	static int64_t absolute(int64_t value) { return value < 0 ? -value : value; }
+
+	AuroraAcquisition aurora_;
+	ArmReader readArm_;
+	int64_t armPeriodNs_;
+	std::atomic<int64_t> toleranceNs_;
+
+	std::thread armThread_;
+	std::atomic<bool> running_;
+	RealtimeConfig armRealtimeConfig_;
+	RealtimeStatus armRealtimeStatus_;
+	LatencyHistogram armWakeupLatency_;
+
+	// Matching state, guarded by matchMutex_
+	mutable std::mutex matchMutex_;
+	ArmSample arm_;
+	ArmSample previousArm_;
+	bool hasArm_;
+	bool hasPreviousArm_;
+	PoseSample pendingSensors_;
+	bool hasPendingSensors_;
+	FusedSample latestPair_;
+	bool hasLatestPair_;
+	std::vector<FusedSample> queue_;
+	size_t queueHead_;
+	size_t queueSize_;
+
+	std::atomic<uint64_t> pairsMatched_;
+	std::atomic<uint64_t> pairsDropped_;
+	std::atomic<uint64_t> armFailures_;
+};
+
+#endif // FUSED_ACQUISITION_HPP
@@ -0,0 +1,380 @@
+#ifndef GBF_ARENA_TREE_HPP
+#define GBF_ARENA_TREE_HPP
+
+#include <sstream>
+#include <string>
+#include <cstring>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "Connection.h"
+#include "GbfComponent.h"
+#include "MonotonicArena.h"
+
+//! Mirrors the header fields of GbfComponent
+struct ArenaGbfComponent
+{
+	uint16_t componentType;
+	uint32_t componentSize;
+	uint16_t itemOption;
+	uint32_t itemCount;
+};
+
+//! The 6D transform fields of Transform, without the exported class' vtable
+struct ArenaGbfTransform
+{
+	uint16_t toolHandle;
+	uint16_t status;
+	double q0, qx, qy, qz;
+	double tx, ty, tz;
+	double error;
+
+	//! Returns true if status bit 8 is high, indicating the tool is missing.
+	bool isMissing() const { return (status & 0x0100) != 0; }
+};
+
+//! Mirrors GbfContainer: a version and a list of components
+struct ArenaGbfContainer
+{
+	uint16_t gbfVersion;
+	uint16_t componentCount;
+	ArenaGbfComponent** components;
+};
+
+//! Mirrors GbfFrameDataItem: the frame header followed by a nested container
+struct ArenaGbfFrameDataItem
+{
+	uint8_t frameType;
+	uint8_t frameSequenceIndex;
+	uint16_t frameStatus;
+	uint32_t frameNumber;
+	uint32_t timespec_s;
+	uint32_t timespec_ns;
+	ArenaGbfContainer* frameData;
+};
+
+//! Mirrors GbfFrame: itemCount frame data items
+struct ArenaGbfFrame : public ArenaGbfComponent
+{
+	ArenaGbfFrameDataItem* data;
+};
+
+//! Mirrors GbfData6D: itemCount tool transforms
+struct ArenaGbfData6D : public ArenaGbfComponent
+{
+	ArenaGbfTransform* toolTransforms;
+};
+
+/**
+ * @brief Parses BX2 replies into the GbfContainer/GbfFrame/GbfData6D object model, allocated in a MonotonicArena.
+ * @details GbfContainer builds its tree with new/delete and nested vectors, which fragments the heap when
+ *          it runs for every BX2 reply of a long session. GbfArenaTree parses the same replies into
+ *          trivially destructible nodes that all live in one arena, which is reset at the start of the
+ *          next frame. Component types other than Frame and Data6D keep their header and their payload
+ *          is skipped, like the default branch of GbfComponent::buildComponent().
+ */
+class GbfArenaTree
+{
+public:
+	/**
+	 * @brief Creates the tree and its arena.
+	 * @param arenaCapacity The initial arena size in bytes. The arena grows to fit the largest frame seen.
+	 */
+	explicit GbfArenaTree(size_t arenaCapacity = 16 * 1024)
+		: arena_(arenaCapacity), root_(NULL), data_(NULL), length_(0), index_(0), failed_(false)
+	{
+	}
+
+	/**
+	 * @brief Discards the previous frame's tree and parses a new one.
+	 * @param data The BX2 reply body: everything after the 6 byte header, without the trailing CRC.
+	 * @param length The number of bytes in data.
+	 * @returns The root container, or NULL if the reply was truncated or malformed.
+	 */
+	const ArenaGbfContainer* parse(const byte_t* data, size_t length)
+	{
+		arena_.reset();
+		data_ = data;
+		length_ = length;
+		index_ = 0;
+		failed_ = false;
+		root_ = readContainer();
+		if (failed_)
+		{
+			root_ = NULL;
+		}
+		return root_;
+	}
+
+	//! Returns the root of the last successfully parsed frame, or NULL.
+	const ArenaGbfContainer* root() const { return root_; }
+
+	//! Returns the arena so callers can inspect its sizing.
+	const MonotonicArena& arena() const { return arena_; }
+
+	/**
+	 * @brief Returns a string representation of the data for debugging purposes.
+	 */
+	std::string toString() const
+	{
+		std::stringstream stream;
+		if (root_ == NULL)
+		{
+			stream << "GbfArenaTree: <empty>" << std::endl;
+		}
+		else
+		{
+			printContainer(stream, root_, "");
+		}
+		return stream.str();
+	}
+
+private:
+	//! The size of the component header: type(2) + size(4) + itemOption(2) + itemCount(4)
+	static const uint32_t COMPONENT_HEADER_SIZE = 12;
+
+	//! The size of one 6D item: handle(2) + status(2) + eight 4-byte floats
+	static const uint32_t DATA6D_ITEM_SIZE = 36;
+
+	//! The smallest possible frame data item: the 16 byte frame header plus an empty container
+	static const uint32_t MIN_FRAME_ITEM_SIZE = 20;
+
+	ArenaGbfContainer* readContainer()
+	{
+		ArenaGbfContainer* container = arena_.create<ArenaGbfContainer>();
+		if (container == NULL)
+		{
+			failed_ = true;
+			return NULL;
+		}
+		container->gbfVersion = get_uint16();
+		container->componentCount = get_uint16();
+		if (!ensureAvailable(static_cast<size_t>(container->componentCount) * COMPONENT_HEADER_SIZE))
+		{
+			container->componentCount = 0;
+		}
+		container->components = arena_.allocateArray<ArenaGbfComponent*>(container->componentCount);
+		if (container->components == NULL)
+		{
+			failed_ = true;
+			return NULL;
+		}
+		for (uint16_t i = 0; i < container->componentCount; i++)
+		{
+			container->components[i] = failed_ ? NULL : readComponent();
+		}
+		return container;
+	}
+
+	ArenaGbfComponent* readComponent()
+	{
+		ArenaGbfComponent header;
+		header.componentType = get_uint16();
+		header.componentSize = get_uint32();
+		header.itemOption = get_uint16();
+		header.itemCount = get_uint32();
+		if (failed_)
+		{
+			return NULL;
+		}
+
+		if (header.componentType == GbfComponentType::Frame)
+		{
+			if (!ensureAvailable(static_cast<size_t>(header.itemCount) * MIN_FRAME_ITEM_SIZE))
+			{
+				return NULL;
+			}
+			ArenaGbfFrame* frame = arena_.create<ArenaGbfFrame>();
+			if (frame == NULL || (frame->data = arena_.allocateArray<ArenaGbfFrameDataItem>(header.itemCount)) == NULL)
+			{
+				failed_ = true;
+				return NULL;
+			}
+			static_cast<ArenaGbfComponent&>(*frame) = header;
+			for (uint32_t i = 0; i < header.itemCount && !failed_; i++)
+			{
+				readFrameDataItem(frame->data[i]);
+			}
+			return frame;
+		}
+		else if (header.componentType == GbfComponentType::Data6D)
+		{
+			if (!ensureAvailable(static_cast<size_t>(header.itemCount) * DATA6D_ITEM_SIZE))
+			{
+				return NULL;
+			}
+			ArenaGbfData6D* data6D = arena_.create<ArenaGbfData6D>();
+			if (data6D == NULL || (data6D->toolTransforms = arena_.allocateArray<ArenaGbfTransform>(header.itemCount)) == NULL)
+			{
+				failed_ = true;
+				return NULL;
+			}
+			static_cast<ArenaGbfComponent&>(*data6D) = header;
+			for (uint32_t i = 0; i < header.itemCount; i++)
+			{
+				ArenaGbfTransform& transform = data6D->toolTransforms[i];
+				transform.toolHandle = get_uint16();
+				transform.status = get_uint16();
+				transform.q0 = get_double();
+				transform.qx = get_double();
+				transform.qy = get_double();
+				transform.qz = get_double();
+				transform.tx = get_double();
+				transform.ty = get_double();
+				transform.tz = get_double();
+				transform.error = get_double();
+			}
+			return data6D;
+		}
+
+		// Unhandled component types are kept as a bare header, and their payload is skipped
+		ArenaGbfComponent* component = arena_.create<ArenaGbfComponent>(header);
+		if (component == NULL || header.componentSize < COMPONENT_HEADER_SIZE || !ensureAvailable(header.componentSize - COMPONENT_HEADER_SIZE))
+		{
+			failed_ = true;
+			return NULL;
+		}
+		index_ += header.componentSize - COMPONENT_HEADER_SIZE;
+		return component;
+	}
+
+	void readFrameDataItem(ArenaGbfFrameDataItem& item)
+	{
+		item.frameType = get_byte();
+		item.frameSequenceIndex = get_byte();
+		item.frameStatus = get_uint16();
+		item.frameNumber = get_uint32();
+		item.timespec_s = get_uint32();
+		item.timespec_ns = get_uint32();
+		item.frameData = failed_ ? NULL : readContainer();
+	}
+
+	bool ensureAvailable(size_t numBytes)
+	{
+		if (failed_ || index_ + numBytes > length_)
+		{
+			failed_ = true;
+			return false;
+		}
+		return true;
+	}
+
+	byte_t get_byte()
+	{
+		return ensureAvailable(1) ? data_[index_++] : 0;
+	}
+
+	uint16_t get_uint16()
+	{
+		if (!ensureAvailable(2))
+		{
+			return 0;
+		}
+		uint16_t value = static_cast<uint16_t>(data_[index_] | (data_[index_ + 1] << 8));
+		index_ += 2;
+		return value;
+	}
+
+	uint32_t get_uint32()
+	{
+		if (!ensureAvailable(4))
+		{
+			return 0;
+		}
+		uint32_t value = static_cast<uint32_t>(data_[index_]) | (static_cast<uint32_t>(data_[index_ + 1]) << 8) |
+						 (static_cast<uint32_t>(data_[index_ + 2]) << 16) | (static_cast<uint32_t>(data_[index_ + 3]) << 24);
+		index_ += 4;
+		return value;
+	}
+
+	//! Like BufferedReader::get_double(), reads a four byte float and widens it
+	double get_double()
+	{
+		uint32_t bits = get_uint32();
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	//! GbfComponentType::toString() is not exported by the CAPI library, so the names are repeated here
+	static const char* componentTypeName(uint16_t componentType)
+	{
+		switch (componentType)
+		{
+			case GbfComponentType::Frame: return "Frame";
+			case GbfComponentType::Data6D: return "Data6D";
+			case GbfComponentType::Data3D: return "Data3D";
+			case GbfComponentType::Button1D: return "Button1D";
+			case GbfComponentType::Data2D: return "Data2D";
+			case GbfComponentType::UV: return "UV";
+			case GbfComponentType::SystemAlert: return "SystemAlert";
+			default: return "Unknown";
+		}
+	}
+
+	static void printContainer(std::stringstream& stream, const ArenaGbfContainer* container, const std::string& indent)
+	{
+		stream << indent << "---GbfContainer" << std::endl
+			   << indent << "gbfVersion=" << container->gbfVersion << std::endl
+			   << indent << "componentCount=" << container->componentCount << std::endl;
+		for (uint16_t i = 0; i < container->componentCount; i++)
+		{
+			const ArenaGbfComponent* component = container->components[i];
+			if (component == NULL)
+			{
+				continue;
+			}
+			stream << indent << "---" << componentTypeName(component->componentType) << std::endl
+				   << indent << "componentSize=" << component->componentSize << std::endl
+				   << indent << "itemOption=" << component->itemOption << std::endl
+				   << indent << "itemCount=" << component->itemCount << std::endl;
+			if (component->componentType == GbfComponentType::Frame)
+			{
+				const ArenaGbfFrame* frame = static_cast<const ArenaGbfFrame*>(component);
+				for (uint32_t j = 0; j < frame->itemCount; j++)
+				{
+					const ArenaGbfFrameDataItem& item = frame->data[j];
+					stream << indent << "  frameType=" << static_cast<int>(item.frameType) << std::endl
+						   << indent << "  frameSequenceIndex=" << static_cast<int>(item.frameSequenceIndex) << std::endl
+						   << indent << "  frameStatus=" << item.frameStatus << std::endl
+						   << indent << "  frameNumber=" << item.frameNumber << std::endl
+						   << indent << "  timespec=" << item.timespec_s << "s " << item.timespec_ns << "ns" << std::endl;
+					if (item.frameData != NULL)
+					{
+						printContainer(stream, item.frameData, indent + "    ");
+					}
+				}
+			}
+			else if (component->componentType == GbfComponentType::Data6D)
+			{
+				const ArenaGbfData6D* data6D = static_cast<const ArenaGbfData6D*>(component);
+				for (uint32_t j = 0; j < data6D->itemCount; j++)
+				{
+					const ArenaGbfTransform& t = data6D->toolTransforms[j];
+					stream << indent << "  toolHandle=" << t.toolHandle << " status=" << t.status;
+					if (t.isMissing())
+					{
+						stream << " MISSING" << std::endl;
+					}
+					else
+					{
+						stream << " q=[" << t.q0 << "," << t.qx << "," << t.qy << "," << t.qz << "]"
+							   << " t=[" << t.tx << "," << t.ty << "," << t.tz << "]"
+							   << " error=" << t.error << std::endl;
+					}
+				}
+			}
+		}
+	}
+
+	MonotonicArena arena_;
+	const ArenaGbfContainer* root_;
+
+	// Parsing cursor over the reply being decoded
+	const byte_t* data_;
+	size_t length_;
+	size_t index_;
+	bool failed_;
+};
+
+#endif // GBF_ARENA_TREE_HPP
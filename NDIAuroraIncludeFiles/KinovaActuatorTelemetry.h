@@ -0,0 +1,294 @@
+#ifndef KINOVA_ACTUATOR_TELEMETRY_HPP
+#define KINOVA_ACTUATOR_TELEMETRY_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "AcquisitionClock.h"
+#include "CommunicationLayerWindows.h"
+#include "SeqLock.h"
+
+/**
+ * @brief The latest state of every actuator on the arm's RS-485 bus, one array per quantity.
+ */
+struct ActuatorTelemetryState
+{
+	//! Actuators answer from consecutive bus addresses starting here
+	static const int FIRST_ACTUATOR_ADDRESS = 0x10;
+
+	//! The largest number of actuators on a supported arm
+	static const int MAX_ACTUATORS = 7;
+
+	//! Host time [ns] each actuator was last heard from, or 0 if never
+	int64_t timestamp[MAX_ACTUATORS];
+
+	//! Joint position [deg]
+	float position[MAX_ACTUATORS];
+
+	//! Joint velocity [deg/s]
+	float velocity[MAX_ACTUATORS];
+
+	//! Joint torque [Nm]
+	float torque[MAX_ACTUATORS];
+
+	//! Motor current [A]
+	float current[MAX_ACTUATORS];
+
+	//! Motor PWM duty cycle
+	float pwm[MAX_ACTUATORS];
+
+	//! Position measured by the joint encoder [deg]
+	float encoderPosition[MAX_ACTUATORS];
+
+	//! Actuator acceleration along x, y, z [g]
+	float accelerationX[MAX_ACTUATORS];
+	float accelerationY[MAX_ACTUATORS];
+	float accelerationZ[MAX_ACTUATORS];
+
+	//! Actuator temperature [C]
+	float temperature[MAX_ACTUATORS];
+
+	//! The last error reported with RS485_MSG_REPORT_ERROR, or 0
+	uint32_t errorCode[MAX_ACTUATORS];
+
+	//! The number of decoded messages so far
+	uint32_t messageCount;
+};
+
+/**
+ * @brief The RS-485 passthrough functions of CommunicationLayerWindows.dll.
+ * @details Held as pointers, as Kinova applications load them with GetProcAddress; a stand-in can be
+ *          substituted to run the telemetry without an arm.
+ */
+struct KinovaRS485Functions
+{
+	int (*activate)(void);
+	int (*read)(RS485_Message* packagesIn, int quantityWanted, int& receivedQuantity);
+	int (*write)(RS485_Message* packagesOut, int quantityToSend, int& quantitySent);
+};
+
+/**
+ * @brief Reads actuator telemetry straight off the arm's RS-485 bus on a dedicated thread.
+ * @details The USB GetAngularPosition API answers at about 100 Hz; the actuators themselves report far
+ *          faster over RS-485. The telemetry thread optionally asks every actuator for its position once
+ *          per poll period, drains the replies in batches of up to 50 messages, decodes the DataFloat/DataLong
+ *          unions into an ActuatorTelemetryState and publishes it through a SeqLocked slot, so the Aurora or
+ *          Simulink side reads the latest state without ever blocking the bus reader.
+ *          Note that once OpenRS485_Activate has been called the arm's USB API and joystick are disabled.
+ */
+class KinovaActuatorTelemetry
+{
+public:
+	//! OpenRS485_Read and OpenRS485_Write move at most this many messages per call
+	static const int MAX_MESSAGES = 50;
+
+	/**
+	 * @param functions The RS-485 passthrough functions.
+	 * @param numActuators The number of actuators on the bus.
+	 */
+	KinovaActuatorTelemetry(const KinovaRS485Functions& functions, int numActuators = 6)
+		: functions_(functions), numActuators_(numActuators < ActuatorTelemetryState::MAX_ACTUATORS ? numActuators : ActuatorTelemetryState::MAX_ACTUATORS),
+		  pollActuators_(true), pollPeriodUs_(DEFAULT_POLL_PERIOD_US), idleSleepUs_(DEFAULT_IDLE_SLEEP_US), running_(false), readErrors_(0), polls_(0)
+	{
+		std::memset(&working_, 0, sizeof(working_));
+	}
+
+	~KinovaActuatorTelemetry()
+	{
+		stop();
+	}
+
+	/**
+	 * @brief Chooses whether the thread requests positions (RS485_MSG_GET_ACTUALPOSITION) or only listens.
+	 * @details Listen only when another controller already drives the bus with position commands.
+	 *          Must be called before start().
+	 */
+	void setPollActuators(bool poll) { pollActuators_ = poll; }
+
+	/**
+	 * @brief Sets how often the actuators are asked for their position [us]. Must be called before start().
+	 * @details Each request puts one message per actuator on the bus, so the period bounds the bus load
+	 *          the telemetry adds. Replies are still drained as fast as they arrive between requests.
+	 */
+	void setPollPeriod(int microseconds) { pollPeriodUs_ = microseconds; }
+
+	//! Sets how long the thread sleeps when a read returns nothing [us]. Must be called before start().
+	void setIdleSleep(int microseconds) { idleSleepUs_ = microseconds; }
+
+	/**
+	 * @brief Activates the RS-485 passthrough and starts the telemetry thread.
+	 * @returns NO_ERROR_KINOVA for success, or the error code returned by OpenRS485_Activate.
+	 */
+	int start()
+	{
+		if (running_)
+		{
+			return NO_ERROR_KINOVA;
+		}
+		int result = functions_.activate();
+		if (result != NO_ERROR_KINOVA)
+		{
+			return result;
+		}
+		running_ = true;
+		thread_ = std::thread(&KinovaActuatorTelemetry::run, this);
+		return NO_ERROR_KINOVA;
+	}
+
+	//! Stops the telemetry thread. The passthrough stays active until the communication layer is closed.
+	void stop()
+	{
+		running_ = false;
+		if (thread_.joinable())
+		{
+			thread_.join();
+		}
+	}
+
+	//! Copies the latest state. Never blocks the telemetry thread.
+	void latest(ActuatorTelemetryState& state) const
+	{
+		state_.read(state);
+	}
+
+	//! Returns the number of times the state has been published
+	uint32_t version() const { return state_.version(); }
+
+	//! Returns the number of failed OpenRS485_Read calls
+	uint64_t readErrors() const { return readErrors_; }
+
+	//! Returns the number of position requests written to the bus
+	uint64_t polls() const { return polls_; }
+
+	/**
+	 * @brief Decodes one message into the state table.
+	 * @returns True if the message carried actuator data.
+	 */
+	static bool decode(const RS485_Message& message, int64_t timestamp, ActuatorTelemetryState& state)
+	{
+		int index = message.SourceAddress - ActuatorTelemetryState::FIRST_ACTUATOR_ADDRESS;
+		if (index < 0 || index >= ActuatorTelemetryState::MAX_ACTUATORS)
+		{
+			return false;
+		}
+
+		switch (message.Command)
+		{
+			case RS485_MSG_SEND_ACTUALPOSITION:
+			case RS485_MSG_SEND_ALL_VALUES_1:
+				state.current[index] = message.DataFloat[0];
+				state.position[index] = message.DataFloat[1];
+				state.velocity[index] = message.DataFloat[2];
+				state.torque[index] = message.DataFloat[3];
+				break;
+			case RS485_MSG_SEND_ALL_VALUES_2:
+				state.pwm[index] = message.DataFloat[0];
+				state.encoderPosition[index] = message.DataFloat[1];
+				state.accelerationX[index] = message.DataFloat[2];
+				state.accelerationY[index] = message.DataFloat[3];
+				break;
+			case RS485_MSG_SEND_ALL_VALUES_3:
+				state.accelerationZ[index] = message.DataFloat[0];
+				state.temperature[index] = message.DataFloat[1];
+				break;
+			case RS485_MSG_REPORT_ERROR:
+				state.errorCode[index] = static_cast<uint32_t>(message.DataLong[0]);
+				break;
+			default:
+				return false;
+		}
+		state.timestamp[index] = timestamp;
+		state.messageCount++;
+		return true;
+	}
+
+private:
+	enum
+	{
+		DEFAULT_POLL_PERIOD_US = 1000, //!< Ask for positions at 1 kHz unless told otherwise
+		DEFAULT_IDLE_SLEEP_US = 200
+	};
+
+	void run()
+	{
+		RS485_Message outgoing[MAX_MESSAGES];
+		RS485_Message incoming[MAX_MESSAGES];
+		std::memset(outgoing, 0, sizeof(outgoing));
+		for (int i = 0; i < numActuators_; i++)
+		{
+			outgoing[i].Command = RS485_MSG_GET_ACTUALPOSITION;
+			outgoing[i].SourceAddress = 0x00;
+			outgoing[i].DestinationAddress = static_cast<unsigned char>(ActuatorTelemetryState::FIRST_ACTUATOR_ADDRESS + i);
+		}
+
+		int64_t nextPoll = AcquisitionClock::now();
+		while (running_)
+		{
+			if (pollActuators_ && AcquisitionClock::now() >= nextPoll)
+			{
+				int sent = 0;
+				functions_.write(outgoing, numActuators_, sent);
+				polls_++;
+
+				// Keep to the period, but after a stall restart it rather than catch up with a burst
+				nextPoll += static_cast<int64_t>(pollPeriodUs_) * 1000;
+				int64_t now = AcquisitionClock::now();
+				if (nextPoll < now)
+				{
+					nextPoll = now;
+				}
+			}
+
+			int received = 0;
+			if (functions_.read(incoming, MAX_MESSAGES, received) != NO_ERROR_KINOVA)
+			{
+				readErrors_++;
+				received = 0;
+			}
+
+			int64_t now = AcquisitionClock::now();
+			bool changed = false;
+			for (int i = 0; i < received && i < MAX_MESSAGES; i++)
+			{
+				changed = decode(incoming[i], now, working_) || changed;
+			}
+
+			if (changed)
+			{
+				state_.write(working_);
+			}
+			else if (idleSleepUs_ > 0)
+			{
+				int64_t sleepUs = idleSleepUs_;
+				if (pollActuators_)
+				{
+					int64_t untilPollUs = (nextPoll - now) / 1000;
+					sleepUs = untilPollUs < sleepUs ? (untilPollUs > 0 ? untilPollUs : 0) : sleepUs;
+				}
+				std::this_thread::sleep_for(std::chrono::microseconds(sleepUs));
+			}
+		}
+	}
+
+	KinovaRS485Functions functions_;
+	int numActuators_;
+	bool pollActuators_;
+	int pollPeriodUs_;
+	int idleSleepUs_;
+
+	std::thread thread_;
+	std::atomic<bool> running_;
+	std::atomic<uint64_t> readErrors_;
+	std::atomic<uint64_t> polls_;
+
+	//! The table the telemetry thread decodes into, then publishes
+	ActuatorTelemetryState working_;
+
+	SeqLocked<ActuatorTelemetryState> state_;
+};
+
+#endif // KINOVA_ACTUATOR_TELEMETRY_HPP
@@ -0,0 +1,80 @@
+#ifndef KINOVA_ARM_READER_HPP
+#define KINOVA_ARM_READER_HPP
+
+#include <cstddef>
+
+#include "ArmSample.h"
+#include "CommunicationLayerWindows.h"
+#include "KinovaTypes.h"
+
+/**
+ * @brief Reads the arm state into an ArmSample through the Kinova command layer.
+ * @details Kinova applications load the command layer functions from CommandLayerWindows.dll with
+ *          GetProcAddress, so the reader takes them as function pointers. Include this header in a
+ *          translation unit that does not include the CAPI headers (see ArmSample), and hand read()
+ *          to FusedAcquisition as its arm reader.
+ */
+class KinovaArmReader
+{
+public:
+	//! Signature of GetCartesianPosition in the Kinova command layer
+	typedef int (*GetCartesianPositionFunction)(CartesianPosition&);
+
+	//! Signature of GetAngularPosition in the Kinova command layer
+	typedef int (*GetAngularPositionFunction)(AngularPosition&);
+
+	/**
+	 * @param getCartesianPosition The command layer's GetCartesianPosition.
+	 * @param getAngularPosition The command layer's GetAngularPosition, or NULL to skip joint angles.
+	 */
+	KinovaArmReader(GetCartesianPositionFunction getCartesianPosition, GetAngularPositionFunction getAngularPosition)
+		: getCartesianPosition_(getCartesianPosition), getAngularPosition_(getAngularPosition)
+	{
+	}
+
+	/**
+	 * @brief Reads the cartesian pose and, if available, the joint angles. The timestamp is left untouched.
+	 * @returns True if every read succeeded.
+	 */
+	bool operator()(ArmSample& sample) const
+	{
+		CartesianPosition cartesian;
+		if (getCartesianPosition_(cartesian) != NO_ERROR_KINOVA)
+		{
+			return false;
+		}
+		sample.cartesian[0] = cartesian.Coordinates.X;
+		sample.cartesian[1] = cartesian.Coordinates.Y;
+		sample.cartesian[2] = cartesian.Coordinates.Z;
+		sample.cartesian[3] = cartesian.Coordinates.ThetaX;
+		sample.cartesian[4] = cartesian.Coordinates.ThetaY;
+		sample.cartesian[5] = cartesian.Coordinates.ThetaZ;
+		sample.fingers[0] = cartesian.Fingers.Finger1;
+		sample.fingers[1] = cartesian.Fingers.Finger2;
+		sample.fingers[2] = cartesian.Fingers.Finger3;
+
+		if (getAngularPosition_ == NULL)
+		{
+			return true;
+		}
+		AngularPosition angular;
+		if (getAngularPosition_(angular) != NO_ERROR_KINOVA)
+		{
+			return false;
+		}
+		sample.joints[0] = angular.Actuators.Actuator1;
+		sample.joints[1] = angular.Actuators.Actuator2;
+		sample.joints[2] = angular.Actuators.Actuator3;
+		sample.joints[3] = angular.Actuators.Actuator4;
+		sample.joints[4] = angular.Actuators.Actuator5;
+		sample.joints[5] = angular.Actuators.Actuator6;
+		sample.joints[6] = angular.Actuators.Actuator7;
+		return true;
+	}
+
+private:
+	GetCartesianPositionFunction getCartesianPosition_;
+	GetAngularPositionFunction getAngularPosition_;
+};
+
+#endif // KINOVA_ARM_READER_HPP
@@ -0,0 +1,147 @@
+#ifndef KINOVA_PACKET_BATCH_HPP
+#define KINOVA_PACKET_BATCH_HPP
+
+#include <cstring>
+#include <vector>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "CommunicationLayerWindows.h"
+
+/**
+ * @brief Gathers the Kinova commands of one control cycle and sends them in a single SendPacketList transaction.
+ * @details Sending an angular torque command, a velocity command and a status query one SendPacket at a
+ *          time costs one USB round trip each. The batch serialises every command of the cycle into a
+ *          pool of Packets that is allocated once, splitting payloads larger than one packet the same way
+ *          the command layer does, and hands the whole list to the communication layer at once.
+ *
+ *          Typical control cycle:
+ *              batch.begin();
+ *              batch.addFloats(torqueCommandId, torques, COMMAND_SIZE);
+ *              batch.add(statusQueryId, NULL, 0);
+ *              batch.flush(result);
+ *              const std::vector<Packet>& replies = batch.replies();
+ *
+ *          SendPacketList answers in place, so after flush() the pool holds the replies. They stay there for
+ *          replies() until the next begin() or add() starts a new cycle.
+ */
+class KinovaPacketBatch
+{
+public:
+	//! Signature of SendPacketList in CommunicationLayerWindows.dll
+	typedef int (*SendPacketListFunction)(std::vector<Packet>&, int&);
+
+	/**
+	 * @brief Creates a batch and preallocates its packet pool.
+	 * @param sendPacketList The communication layer's SendPacketList, usually loaded with GetProcAddress.
+	 * @param maxPackets The most packets a single cycle may queue. At least 1 is kept.
+	 * @param packetDataSize The payload carried by each packet: PACKET_DATA_SIZE over USB, ETH_PACKET_DATA_SIZE over ethernet.
+	 *                       Clamped to 1 to PACKET_MAX_DATA_SIZE, the size of Packet::Data.
+	 */
+	KinovaPacketBatch(SendPacketListFunction sendPacketList, int maxPackets = 16, int packetDataSize = PACKET_DATA_SIZE)
+		: sendPacketList_(sendPacketList), maxPackets_(maxPackets > 1 ? maxPackets : 1),
+		  packetDataSize_(packetDataSize < 1 ? 1 : (packetDataSize > PACKET_MAX_DATA_SIZE ? PACKET_MAX_DATA_SIZE : packetDataSize)),
+		  flushed_(false), transactions_(0), packetsSent_(0)
+	{
+		packets_.reserve(maxPackets_);
+	}
+
+	//! Discards any queued packets or replies and starts a new cycle. Keeps the pool's memory.
+	void begin()
+	{
+		packets_.clear();
+		flushed_ = false;
+	}
+
+	/**
+	 * @brief Queues one command, split over as many packets as its payload needs.
+	 * @param idCommand The command identifier.
+	 * @param data The payload, or NULL for a command without data.
+	 * @param size The payload size in bytes.
+	 * @returns False if the pool does not have room for the command; nothing is queued in that case.
+	 * @details Adding after flush() discards the replies and starts a new cycle.
+	 */
+	bool add(short idCommand, const void* data, int size)
+	{
+		if (flushed_)
+		{
+			begin();
+		}
+		int packetCount = size <= 0 ? 1 : (size + packetDataSize_ - 1) / packetDataSize_;
+		if (static_cast<int>(packets_.size()) + packetCount > maxPackets_)
+		{
+			return false;
+		}
+
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (int i = 0; i < packetCount; i++)
+		{
+			// resize() stays within the reserved pool, so this never allocates
+			packets_.resize(packets_.size() + 1);
+			Packet& packet = packets_.back();
+			int offset = i * packetDataSize_;
+			int chunk = size - offset < packetDataSize_ ? size - offset : packetDataSize_;
+			packet.IdPacket = static_cast<short>(i + 1);
+			packet.TotalPacketCount = static_cast<short>(packetCount);
+			packet.IdCommand = idCommand;
+			packet.TotalDataSize = static_cast<short>(size < 0 ? 0 : size);
+			if (bytes != NULL && chunk > 0)
+			{
+				std::memcpy(packet.Data, bytes + offset, chunk);
+			}
+		}
+		return true;
+	}
+
+	//! Queues a command whose payload is an array of floats, eg. SendAngularTorqueCommand's COMMAND_SIZE values
+	bool addFloats(short idCommand, const float* values, int count)
+	{
+		return add(idCommand, values, count * static_cast<int>(sizeof(float)));
+	}
+
+	/**
+	 * @brief Sends every queued packet in one SendPacketList call. The replies are then available from replies().
+	 * @param result Receives the result reported by the communication layer.
+	 * @returns The SendPacketList return code (NO_ERROR_KINOVA on success), or NO_ERROR_KINOVA if nothing was queued.
+	 */
+	int flush(int& result)
+	{
+		result = NO_ERROR_KINOVA;
+		if (flushed_ || packets_.empty())
+		{
+			return NO_ERROR_KINOVA;
+		}
+		packetsSent_ += packets_.size();
+		int status = sendPacketList_(packets_, result);
+		transactions_++;
+		flushed_ = true;
+		return status;
+	}
+
+	//! Returns the number of packets queued in the current cycle, or 0 once it has been flushed
+	int size() const { return flushed_ ? 0 : static_cast<int>(packets_.size()); }
+
+	/**
+	 * @brief Returns the packets SendPacketList answered with in the last flush(), or an empty list before it.
+	 * @details The list is the batch's pool, so it is only valid until the next begin() or add().
+	 */
+	const std::vector<Packet>& replies() const { return flushed_ ? packets_ : noReplies_; }
+
+	//! Returns the number of SendPacketList transactions made
+	uint64_t transactions() const { return transactions_; }
+
+	//! Returns the number of packets sent over all transactions
+	uint64_t packetsSent() const { return packetsSent_; }
+
+private:
+	SendPacketListFunction sendPacketList_;
+	int maxPackets_;
+	int packetDataSize_;
+	std::vector<Packet> packets_;
+	std::vector<Packet> noReplies_;
+	bool flushed_;
+	uint64_t transactions_;
+	uint64_t packetsSent_;
+};
+
+#endif // KINOVA_PACKET_BATCH_HPP
@@ -0,0 +1,178 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+
+#include <stdint.h> // for uint8_t etc...
+
+/**
+ * @brief A fixed-size histogram of latencies, eg. how late a thread woke up or how long a reply took to arrive.
+ * @details Buckets are logarithmic with eight steps per power of two, so every latency from a nanosecond to
+ *          two seconds is kept to within 12.5% without allocating. One thread records; any thread may read
+ *          the counts while it does. reset() must not race with record().
+ */
+class LatencyHistogram
+{
+public:
+	enum
+	{
+		SUB_BUCKETS = 8,                             //!< Buckets per power of two
+		NUM_BUCKETS = SUB_BUCKETS + 28 * SUB_BUCKETS //!< Covers 0 to 2^31 ns, larger values land in the last bucket
+	};
+
+	LatencyHistogram()
+	{
+		reset();
+	}
+
+	//! Records one latency [ns]. Negative latencies count as 0
+	void record(int64_t latencyNs)
+	{
+		if (latencyNs < 0)
+		{
+			latencyNs = 0;
+		}
+		buckets_[bucketOf(latencyNs)].fetch_add(1, std::memory_order_relaxed);
+		uint64_t count = count_.load(std::memory_order_relaxed);
+		if (count == 0 || latencyNs < min_.load(std::memory_order_relaxed))
+		{
+			min_.store(latencyNs, std::memory_order_relaxed);
+		}
+		if (latencyNs > max_.load(std::memory_order_relaxed))
+		{
+			max_.store(latencyNs, std::memory_order_relaxed);
+		}
+		sum_.store(sum_.load(std::memory_order_relaxed) + latencyNs, std::memory_order_relaxed);
+		count_.store(count + 1, std::memory_order_release);
+	}
+
+	//! Clears every count
+	void reset()
+	{
+		for (int i = 0; i < NUM_BUCKETS; i++)
+		{
+			buckets_[i].store(0, std::memory_order_relaxed);
+		}
+		count_.store(0, std::memory_order_relaxed);
+		min_.store(0, std::memory_order_relaxed);
+		max_.store(0, std::memory_order_relaxed);
+		sum_.store(0, std::memory_order_relaxed);
+	}
+
+	//! Returns the number of latencies recorded
+	uint64_t count() const { return count_.load(std::memory_order_acquire); }
+
+	//! Returns the shortest latency recorded [ns]
+	int64_t min() const { return min_.load(std::memory_order_relaxed); }
+
+	//! Returns the longest latency recorded [ns]
+	int64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+	//! Returns the mean latency [ns]
+	double mean() const
+	{
+		uint64_t count = this->count();
+		return count == 0 ? 0.0 : static_cast<double>(sum_.load(std::memory_order_relaxed)) / count;
+	}
+
+	/**
+	 * @brief Returns the latency below which the given fraction of the recorded latencies fall [ns].
+	 * @param fraction Eg. 0.99 for the 99th percentile.
+	 * @returns The upper edge of the bucket holding the percentile, capped at max().
+	 */
+	int64_t percentile(double fraction) const
+	{
+		uint64_t count = this->count();
+		if (count == 0)
+		{
+			return 0;
+		}
+		uint64_t rank = static_cast<uint64_t>(fraction * count);
+		uint64_t seen = 0;
+		for (int i = 0; i < NUM_BUCKETS; i++)
+		{
+			seen += buckets_[i].load(std::memory_order_relaxed);
+			if (seen > rank)
+			{
+				int64_t upper = bucketUpper(i);
+				return upper < max() ? upper : max();
+			}
+		}
+		return max();
+	}
+
+	//! Returns the number of latencies in a bucket
+	uint64_t bucketCount(int bucket) const { return buckets_[bucket].load(std::memory_order_relaxed); }
+
+	//! Returns the smallest latency a bucket holds [ns]
+	static int64_t bucketLower(int bucket)
+	{
+		if (bucket < SUB_BUCKETS)
+		{
+			return bucket;
+		}
+		int exponent = bucket / SUB_BUCKETS + 2;
+		return static_cast<int64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << (exponent - 3);
+	}
+
+	//! Returns the smallest latency above a bucket [ns]
+	static int64_t bucketUpper(int bucket)
+	{
+		return bucket + 1 < NUM_BUCKETS ? bucketLower(bucket + 1) : INT64_MAX;
+	}
+
+	//! Summarizes the histogram on one line, in microseconds
+	std::string summary(const char* label) const
+	{
+		char text[256];
+		std::snprintf(text, sizeof(text), "%s: %llu x [min %.1f, mean %.1f, p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f] us",
+			label, static_cast<unsigned long long>(count()), min() / 1e3, mean() / 1e3, percentile(0.5) / 1e3,
+			percentile(0.99) / 1e3, percentile(0.999) / 1e3, max() / 1e3);
+		return text;
+	}
+
+	//! Lists every bucket that holds a latency, one per line, in microseconds
+	std::string histogram() const
+	{
+		std::string text;
+		char line[96];
+		for (int i = 0; i < NUM_BUCKETS; i++)
+		{
+			uint64_t bucket = bucketCount(i);
+			if (bucket == 0)
+			{
+				continue;
+			}
+			std::snprintf(line, sizeof(line), "%10.3f - %10.3f us: %llu\n", bucketLower(i) / 1e3,
+				bucketUpper(i) / 1e3, static_cast<unsigned long long>(bucket));
+			text += line;
+		}
+		return text;
+	}
+
+private:
+	static int bucketOf(int64_t latencyNs)
+	{
+		if (latencyNs < SUB_BUCKETS)
+		{
+			return static_cast<int>(latencyNs);
+		}
+		int exponent = 63;
+		while ((latencyNs >> exponent) == 0)
+		{
+			exponent--;
+		}
+		int bucket = (exponent - 2) * SUB_BUCKETS + static_cast<int>((latencyNs >> (exponent - 3)) & (SUB_BUCKETS - 1));
+		return bucket < NUM_BUCKETS ? bucket : NUM_BUCKETS - 1;
+	}
+
+	std::atomic<uint64_t> buckets_[NUM_BUCKETS];
+	std::atomic<uint64_t> count_;
+	std::atomic<int64_t> min_;
+	std::atomic<int64_t> max_;
+	std::atomic<int64_t> sum_;
+};
+
+#endif // LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,345 @@
+#ifndef LINK_RESET_HPP
+#define LINK_RESET_HPP
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include <stdint.h> // for uint8_t etc...
+
+#ifndef _WIN32
+#include <fcntl.h>   // for open()
+#include <termios.h> // for the rate of the shared port
+#include <unistd.h>  // for close()
+#endif
+
+#include "CombinedApi.h"
+#include "CommandSession.h"
+
+namespace ResetMethod
+{
+	//! How a LinkReset brought the device back, from cheapest to dearest
+	enum value { None = 0, Soft = 1, Break = 2 };
+}
+
+/**
+ * @brief How long each step of a reset took.
+ */
+struct ResetTiming
+{
+	ResetTiming() : method(ResetMethod::None), softUs(0), breakUs(0), renegotiateUs(0), totalUs(0) {}
+
+	ResetMethod::value method; //!< The step that brought the device back, or None if the reset failed
+	double softUs;             //!< RESET and INIT at the current rate, whether or not they were answered [us]
+	double breakUs;            //!< The serial break until the device's RESET reply, 0 if no break was sent [us]
+	double renegotiateUs;      //!< COMM and the switch back to the previous baud rate, 0 if not needed [us]
+	double totalUs;            //!< The whole reset [us]
+};
+
+/**
+ * @brief Resets a device on a serial link with as little dead time as possible.
+ * @details The usual reset is a serial break, after which the SCU restarts at 9600 baud and the host has to
+ *          renegotiate the rate it was using; ComConnection holds the break for a fixed 250 ms. LinkReset first
+ *          sends RESET and INIT at the current rate, which is all the device needs when the link only lost its
+ *          framing or the device reported an error, and takes tens of milliseconds. A device that answers
+ *          but comes back at 9600 baud is moved back to the previous rate with COMM. Only a device that
+ *          doesn't answer at all gets a break (as short as the port allows, see
+ *          LowLatencySerialConnection::setBreakDuration()), after which the host waits for its RESET reply at
+ *          9600 baud and renegotiates the previous rate. lastTiming() breaks down the last reset.
+ *          After a reset every port handle is free, so the caller initializes and enables them again.
+ *          SerialPort is LowLatencySerialConnection or ComConnection: any class with their
+ *          setSerialPortParams() and sendSerialBreak(). It must be the connection the session uses.
+ */
+template <class SerialPort>
+class LinkReset
+{
+public:
+	//! How long the device may take to restart after a break [ms]
+	enum { RESTART_TIMEOUT_MS = 3000 };
+
+	LinkReset(SerialPort& port, CommandSession& session)
+		: port_(port), session_(session), baudRate_(CommBaudRateEnum::Baud9600), handshake_(0), softResets_(0),
+		  breakResets_(0), failures_(0)
+	{
+	}
+
+	/**
+	 * @brief Tells the reset which rate the link uses, eg. when it was set up without changeBaudRate().
+	 * @param enableHandshake Whether hardware handshaking is on: { 0 = Off, 1 = On}
+	 */
+	void setBaudRate(CommBaudRateEnum::value baudRate, int enableHandshake = 1)
+	{
+		baudRate_ = baudRate;
+		handshake_ = enableHandshake;
+	}
+
+	//! Returns the rate the link uses, and restores after a reset
+	CommBaudRateEnum::value baudRate() const { return baudRate_; }
+
+	/**
+	 * @brief Moves the device, then the host, to another baud rate with COMM.
+	 * @returns 0, the error of COMM, or CommandSession::ERROR_WRITE if the host port rejected the rate.
+	 */
+	int changeBaudRate(CommBaudRateEnum::value baudRate, int enableHandshake = 1)
+	{
+		int result = session_.setCommParams(baudRate, enableHandshake);
+		if (result != 0)
+		{
+			return result;
+		}
+		if (!switchHost(baudRate, enableHandshake))
+		{
+			return CommandSession::ERROR_WRITE;
+		}
+		setBaudRate(baudRate, enableHandshake);
+		return 0;
+	}
+
+	/**
+	 * @brief Resets and initializes the device, sending a break only if it doesn't answer.
+	 * @returns 0 once the device answered INIT at the previous rate, or the last error.
+	 */
+	int reset()
+	{
+		Clock::time_point start = Clock::now();
+		timing_ = ResetTiming();
+
+		int result = softReset();
+		timing_.softUs = elapsedUs(start) - timing_.renegotiateUs;
+		if (result == 0)
+		{
+			timing_.method = ResetMethod::Soft;
+			softResets_++;
+		}
+		else
+		{
+			Clock::time_point breakStart = Clock::now();
+			double renegotiateBefore = timing_.renegotiateUs;
+			result = breakReset();
+			timing_.breakUs = elapsedUs(breakStart) - (timing_.renegotiateUs - renegotiateBefore);
+			if (result == 0)
+			{
+				timing_.method = ResetMethod::Break;
+				breakResets_++;
+			}
+		}
+		if (result != 0)
+		{
+			failures_++;
+		}
+		timing_.totalUs = elapsedUs(start);
+		return result;
+	}
+
+	//! Returns the timing of the last reset
+	const ResetTiming& lastTiming() const { return timing_; }
+
+	//! Returns the number of resets that needed no break
+	uint64_t softResets() const { return softResets_; }
+
+	//! Returns the number of resets that needed a break
+	uint64_t breakResets() const { return breakResets_; }
+
+	//! Returns the number of resets after which the device still didn't answer
+	uint64_t failures() const { return failures_; }
+
+	//! Describes the last reset and the counts so far
+	std::string timingReport() const
+	{
+		static const char* methods[] = { "failed", "soft", "break" };
+		char report[256];
+		std::snprintf(report, sizeof(report),
+			"last reset %s in %.1f ms [soft %.1f, break %.1f, renegotiate %.1f] ms, %llu soft, %llu break, %llu failed",
+			methods[timing_.method], timing_.totalUs / 1e3, timing_.softUs / 1e3, timing_.breakUs / 1e3,
+			timing_.renegotiateUs / 1e3, static_cast<unsigned long long>(softResets_),
+			static_cast<unsigned long long>(breakResets_), static_cast<unsigned long long>(failures_));
+		return report;
+	}
+
+	//! Returns the baud rate of a CommBaudRateEnum value
+	static int toInt(CommBaudRateEnum::value baudRate)
+	{
+		static const int rates[] = { 9600, 14400, 19200, 38400, 57600, 115200, 921600, 1228739 };
+		return (baudRate >= 0 && baudRate < static_cast<int>(sizeof(rates) / sizeof(rates[0]))) ? rates[baudRate] : 9600;
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	//! RESET and INIT at the current rate, renegotiating if the device answered but restarted at 9600 baud
+	int softReset()
+	{
+		// Start from a clean link: nothing stale in the port or the framer
+		if (!switchHost(baudRate_, handshake_))
+		{
+			return CommandSession::ERROR_WRITE;
+		}
+		int result = session_.reset();
+		if (result == CommandSession::ERROR_TIMEOUT || result == CommandSession::ERROR_WRITE)
+		{
+			return result; // Nothing answered: the link is stuck
+		}
+		if (result == 0)
+		{
+			result = session_.initialize();
+		}
+		if (result != 0 && baudRate_ != CommBaudRateEnum::Baud9600)
+		{
+			// A garbled reply or an unanswered INIT: the device restarted at its default rate
+			result = renegotiate();
+			if (result == 0)
+			{
+				result = session_.initialize();
+			}
+		}
+		return result;
+	}
+
+	//! Sends a break, waits for the device to restart at 9600 baud and restores the previous rate
+	int breakReset()
+	{
+		if (!switchHost(CommBaudRateEnum::Baud9600, 0) || !port_.sendSerialBreak())
+		{
+			return CommandSession::ERROR_WRITE;
+		}
+		Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(RESTART_TIMEOUT_MS);
+		int result;
+		do
+		{
+			result = session_.awaitReply();
+		} while (result == CommandSession::ERROR_TIMEOUT && Clock::now() < deadline);
+		if (result != 0)
+		{
+			return result;
+		}
+		if (!session_.replyIs("RESET"))
+		{
+			return CommandSession::ERROR_REPLY;
+		}
+		if (baudRate_ != CommBaudRateEnum::Baud9600)
+		{
+			result = renegotiate();
+			if (result != 0)
+			{
+				return result;
+			}
+		}
+		return session_.initialize();
+	}
+
+	//! Moves a device that restarted at 9600 baud back to the previous rate
+	int renegotiate()
+	{
+		Clock::time_point start = Clock::now();
+		int result = switchHost(CommBaudRateEnum::Baud9600, 0) ? session_.setCommParams(baudRate_, handshake_) : CommandSession::ERROR_WRITE;
+		if (result == 0 && !switchHost(baudRate_, handshake_))
+		{
+			result = CommandSession::ERROR_WRITE;
+		}
+		timing_.renegotiateUs += elapsedUs(start);
+		return result;
+	}
+
+	//! Sets the host's rate, which also drops whatever the port holds, and empties the framer
+	bool switchHost(CommBaudRateEnum::value baudRate, int enableHandshake)
+	{
+		session_.discardReplies();
+		return port_.setSerialPortParams(toInt(baudRate), 8, 0, 0, enableHandshake);
+	}
+
+	static double elapsedUs(Clock::time_point since)
+	{
+		return std::chrono::duration<double, std::micro>(Clock::now() - since).count();
+	}
+
+	SerialPort& port_;
+	CommandSession& session_;
+	CommBaudRateEnum::value baudRate_;
+	int handshake_;
+
+	ResetTiming timing_;
+	uint64_t softResets_;
+	uint64_t breakResets_;
+	uint64_t failures_;
+};
+
+#ifndef _WIN32
+/**
+ * @brief Resets the device on a serial port that another connection, eg. the CombinedApi's, keeps open.
+ * @details A TrackerSupervisor runs it at its link level (see TrackerSupervisor::setLinkReset()) instead of
+ *          CombinedApi::connect(), which breaks for 250 ms every time. It opens its own SerialPort on the
+ *          device, runs a LinkReset at the rate the other connection uses, then puts back the other
+ *          connection's settings, which every descriptor of the tty shares. SerialPort is
+ *          LowLatencySerialConnection or a class derived from it.
+ */
+template <class SerialPort>
+class SerialLinkReset
+{
+public:
+	/**
+	 * @param port The port to reset through. It is opened for each reset and closed after it.
+	 * @param device The serial device the other connection has open, eg. "/dev/ttyUSB0".
+	 */
+	SerialLinkReset(SerialPort& port, const std::string& device)
+		: port_(port), device_(device), session_(port), linkReset_(port, session_)
+	{
+	}
+
+	/**
+	 * @brief Resets the device and leaves the port as the other connection set it up.
+	 * @returns True once the device answered INIT at the other connection's rate.
+	 */
+	bool reset()
+	{
+		int shared = ::open(device_.c_str(), O_RDWR | O_NOCTTY);
+		struct termios settings;
+		if (shared < 0 || tcgetattr(shared, &settings) != 0)
+		{
+			if (shared >= 0)
+			{
+				::close(shared);
+			}
+			return false;
+		}
+		CommBaudRateEnum::value baudRate;
+		bool reset = toBaudRate(cfgetospeed(&settings), baudRate) && port_.connect(device_.c_str());
+		if (reset)
+		{
+			linkReset_.setBaudRate(baudRate, (settings.c_cflag & CRTSCTS) != 0 ? 1 : 0);
+			reset = linkReset_.reset() == 0;
+			port_.disconnect();
+		}
+		reset = tcsetattr(shared, TCSANOW, &settings) == 0 && reset;
+		::close(shared);
+		return reset;
+	}
+
+	//! Returns the LinkReset, for the timing of the last reset and the counts so far
+	const LinkReset<SerialPort>& linkReset() const { return linkReset_; }
+
+private:
+	//! Returns the COMM rate of a termios speed, false if COMM has none
+	static bool toBaudRate(speed_t speed, CommBaudRateEnum::value& baudRate)
+	{
+		switch (speed)
+		{
+			case B9600: baudRate = CommBaudRateEnum::Baud9600; return true;
+			case B19200: baudRate = CommBaudRateEnum::Baud19200; return true;
+			case B38400: baudRate = CommBaudRateEnum::Baud38400; return true;
+			case B57600: baudRate = CommBaudRateEnum::Baud57600; return true;
+			case B115200: baudRate = CommBaudRateEnum::Baud115200; return true;
+#ifdef B921600
+			case B921600: baudRate = CommBaudRateEnum::Baud921600; return true;
+#endif
+			default: return false;
+		}
+	}
+
+	SerialPort& port_;
+	std::string device_;
+	CommandSession session_;
+	LinkReset<SerialPort> linkReset_;
+};
+#endif // _WIN32
+
+#endif // LINK_RESET_HPP
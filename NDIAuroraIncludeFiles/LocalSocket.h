@@ -0,0 +1,250 @@
+#ifndef LOCAL_SOCKET_HPP
+#define LOCAL_SOCKET_HPP
+
+#include <string>
+#include <vector>
+
+#include <stdint.h> // for uint8_t etc...
+#include <string.h> // for memset()
+
+// Conditionally compile Windows vs. POSIX socket code. Windows 10 (1803 and later) supports AF_UNIX sockets
+#ifdef _WIN32
+// #include <windows.h> causes naming conflicts with TcpConnection's includes
+#include <winsock2.h>
+#include <afunix.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>     // for close() and unlink()
+#endif
+
+/**
+ * @brief Thin portable wrappers around the local (AF_UNIX) stream sockets used between the tracker daemon and its clients.
+ */
+namespace LocalSocket
+{
+#ifdef _WIN32
+	typedef SOCKET Handle;
+	static const Handle INVALID_HANDLE = INVALID_SOCKET;
+#else
+	typedef int Handle;
+	static const Handle INVALID_HANDLE = -1;
+#endif
+
+	//! Initializes the socket library. Safe to call more than once
+	inline bool startup()
+	{
+#ifdef _WIN32
+		static bool started = false;
+		if (!started)
+		{
+			WSADATA data;
+			started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+		}
+		return started;
+#else
+		return true;
+#endif
+	}
+
+	inline void close(Handle handle)
+	{
+		if (handle == INVALID_HANDLE)
+		{
+			return;
+		}
+#ifdef _WIN32
+		closesocket(handle);
+#else
+		::close(handle);
+#endif
+	}
+
+	//! Removes a socket file left behind by a previous server
+	inline void unlinkPath(const std::string& path)
+	{
+#ifdef _WIN32
+		DeleteFileA(path.c_str());
+#else
+		unlink(path.c_str());
+#endif
+	}
+
+	inline bool toAddress(const std::string& path, sockaddr_un& address)
+	{
+		if (path.size() >= sizeof(address.sun_path))
+		{
+			return false;
+		}
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		memcpy(address.sun_path, path.c_str(), path.size() + 1);
+		return true;
+	}
+
+	inline bool setNonBlocking(Handle handle)
+	{
+#ifdef _WIN32
+		u_long enable = 1;
+		return ioctlsocket(handle, FIONBIO, &enable) == 0;
+#else
+		int flags = fcntl(handle, F_GETFL, 0);
+		return flags >= 0 && fcntl(handle, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+	}
+
+	/**
+	 * @brief Creates a listening socket at path, replacing any stale socket file.
+	 * @returns The socket, or INVALID_HANDLE on failure.
+	 */
+	inline Handle listen(const std::string& path)
+	{
+		sockaddr_un address;
+		if (!startup() || !toAddress(path, address))
+		{
+			return INVALID_HANDLE;
+		}
+		Handle handle = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (handle == INVALID_HANDLE)
+		{
+			return INVALID_HANDLE;
+		}
+		unlinkPath(path);
+		if (bind(handle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(handle, 8) != 0)
+		{
+			close(handle);
+			return INVALID_HANDLE;
+		}
+		return handle;
+	}
+
+	/**
+	 * @brief Connects to a listening socket at path.
+	 * @returns The socket, or INVALID_HANDLE if nothing is listening there.
+	 */
+	inline Handle connect(const std::string& path)
+	{
+		sockaddr_un address;
+		if (!startup() || !toAddress(path, address))
+		{
+			return INVALID_HANDLE;
+		}
+		Handle handle = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (handle == INVALID_HANDLE)
+		{
+			return INVALID_HANDLE;
+		}
+		if (::connect(handle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			close(handle);
+			return INVALID_HANDLE;
+		}
+		return handle;
+	}
+
+	inline Handle accept(Handle listener)
+	{
+		return ::accept(listener, NULL, NULL);
+	}
+
+	/**
+	 * @brief Sends as much of the buffer as the socket takes without blocking (or all of it on a blocking socket).
+	 * @returns The number of bytes sent, 0 if the socket buffer is full, or -1 if the peer has gone.
+	 */
+	inline int send(Handle handle, const void* buffer, int length)
+	{
+#if defined(_WIN32)
+		int result = ::send(handle, static_cast<const char*>(buffer), length, 0);
+		if (result == SOCKET_ERROR)
+		{
+			return WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1;
+		}
+		return result;
+#else
+#ifdef MSG_NOSIGNAL
+		int flags = MSG_NOSIGNAL; // A client that disconnects must not raise SIGPIPE in the daemon
+#else
+		int flags = 0;
+#endif
+		ssize_t result;
+		do
+		{
+			result = ::send(handle, buffer, length, flags);
+		} while (result < 0 && errno == EINTR);
+		if (result < 0)
+		{
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+		return static_cast<int>(result);
+#endif
+	}
+
+	/**
+	 * @brief Receives whatever is available, up to length bytes.
+	 * @returns The number of bytes received, 0 if nothing was waiting, or -1 if the peer has gone.
+	 */
+	inline int receive(Handle handle, void* buffer, int length)
+	{
+#if defined(_WIN32)
+		int result = ::recv(handle, static_cast<char*>(buffer), length, 0);
+		if (result == SOCKET_ERROR)
+		{
+			return WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1;
+		}
+		return result == 0 ? -1 : result;
+#else
+		ssize_t result;
+		do
+		{
+			result = ::recv(handle, buffer, length, 0);
+		} while (result < 0 && errno == EINTR);
+		if (result < 0)
+		{
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+		return result == 0 ? -1 : static_cast<int>(result);
+#endif
+	}
+
+	/**
+	 * @brief Waits for any of the sockets to become readable, or writable where wantWrite is set.
+	 * @param handles The sockets to wait on.
+	 * @param wantWrite Per socket, nonzero to also wait for room to send.
+	 * @param ready Receives the poll events of each socket.
+	 * @returns The number of sockets with events, 0 on timeout, or -1 on error.
+	 */
+	inline int wait(const std::vector<Handle>& handles, const std::vector<uint8_t>& wantWrite, std::vector<short>& ready, int timeoutMs)
+	{
+#ifdef _WIN32
+		std::vector<WSAPOLLFD> descriptors(handles.size());
+#else
+		std::vector<pollfd> descriptors(handles.size());
+#endif
+		for (size_t i = 0; i < handles.size(); i++)
+		{
+			descriptors[i].fd = handles[i];
+			descriptors[i].events = static_cast<short>(POLLIN | (wantWrite[i] ? POLLOUT : 0));
+			descriptors[i].revents = 0;
+		}
+#ifdef _WIN32
+		int result = WSAPoll(descriptors.empty() ? NULL : &descriptors[0], static_cast<ULONG>(descriptors.size()), timeoutMs);
+#else
+		int result;
+		do
+		{
+			result = poll(descriptors.empty() ? NULL : &descriptors[0], descriptors.size(), timeoutMs);
+		} while (result < 0 && errno == EINTR);
+#endif
+		ready.resize(handles.size());
+		for (size_t i = 0; i < handles.size(); i++)
+		{
+			ready[i] = descriptors[i].revents;
+		}
+		return result;
+	}
+}
+
+#endif // LOCAL_SOCKET_HPP
@@ -0,0 +1,632 @@
+#ifndef LOW_LATENCY_SERIAL_CONNECTION_HPP
+#define LOW_LATENCY_SERIAL_CONNECTION_HPP
+
+// Only for Mac and Linux: ComConnection remains the Windows serial port implementation
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>   // for open()
+#include <limits.h>  // for PATH_MAX
+#include <poll.h>    // for poll()
+#include <stdio.h>   // for snprintf()
+#include <stdlib.h>  // for realpath()
+#include <string.h>  // for memchr()
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>  // for close()
+#ifdef __linux__
+#include <linux/serial.h> // for serial_struct and ASYNC_LOW_LATENCY
+#endif
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "Connection.h"
+
+namespace ReceiveMode
+{
+	//! How a LowLatencySerialConnection waits for a reply
+	enum value
+	{
+		Blocking = 0, //!< Sleep in poll() and read() until the kernel wakes the reader
+		BusyPoll = 1  //!< Spin on non-blocking reads, burning the core instead of paying the wake-up
+	};
+}
+
+namespace SpinBackoff
+{
+	//! What a busy-polling read does between reads that found nothing
+	enum value
+	{
+		None = 0,  //!< Read again at once
+		Pause = 1, //!< Issue a spin-wait hint (pause on x86, yield on ARM), easing the load on a sibling hyperthread
+		Yield = 2  //!< Pause, then after YIELD_AFTER_SPINS empty reads give the CPU to any other runnable thread
+	};
+}
+
+/**
+ * @brief A POSIX serial port connection tuned for the shortest request/reply turnaround.
+ * @details The Aurora SCU enumerates as a USB-serial (FTDI) device. With generic settings every reply is
+ *          held back by the driver's latency timer (16 ms by default) before the host sees it. This
+ *          connection:
+ *            - puts the port in raw mode and frames reads with VMIN/VTIME: VMIN is set to the number of bytes
+ *              read() asks for, so the kernel wakes the reader once per reply instead of once per byte, and
+ *              VTIME ends a read that stalls part way through,
+ *            - sets ASYNC_LOW_LATENCY on the tty (TIOCGSERIAL/TIOCSSERIAL),
+ *            - writes the FTDI latency timer in sysfs (/sys/bus/usb-serial/devices/ttyUSBn/latency_timer),
+ *            - measures the turnaround of every transaction: the time from the end of a write to the
+ *              first byte of the reply.
+ *          By default a reader sleeps until the kernel wakes it. In ReceiveMode::BusyPoll it spins on
+ *          non-blocking reads instead, so it sees a reply as soon as the driver has it, at the cost of
+ *          keeping a core busy for as long as it waits (see setReceiveMode()).
+ *          The ioctl and sysfs steps need a Linux USB-serial device (and permission to write the sysfs
+ *          file); on a pty, a built-in UART or another OS they are skipped and reported by tuningReport().
+ */
+class LowLatencySerialConnection : public Connection
+{
+public:
+	//! The FTDI latency timer written on connect [ms]. The driver default is 16
+	static const int DEFAULT_LATENCY_TIMER_MS = 1;
+
+	//! The time read() waits for the first byte of a reply [ms]
+	static const int DEFAULT_REPLY_TIMEOUT_MS = 100;
+
+	//! VTIME: once a reply has started, the read ends after this long without a new byte [1/10 s]
+	static const int INTER_BYTE_TIMEOUT_DS = 1;
+
+	//! How long sendSerialBreak() holds the line [ms]. A break needs to outlast a character at 9600 baud (about 1 ms)
+	static const int DEFAULT_BREAK_DURATION_MS = 10;
+
+	//! The empty reads SpinBackoff::Yield spins through before it starts yielding
+	static const unsigned int YIELD_AFTER_SPINS = 1000;
+
+	LowLatencySerialConnection()
+		: fd_(-1), vmin_(-1), latencyTimerMs_(DEFAULT_LATENCY_TIMER_MS), replyTimeoutMs_(DEFAULT_REPLY_TIMEOUT_MS),
+		  breakDurationMs_(DEFAULT_BREAK_DURATION_MS),
+		  receiveMode_(ReceiveMode::Blocking), backoff_(SpinBackoff::Pause), lowLatencyApplied_(false), latencyTimerApplied_(false), writePending_(false),
+		  turnaroundCount_(0), turnaroundMinNs_(0), turnaroundMaxNs_(0), turnaroundSumNs_(0), lastTurnaroundNs_(0)
+	{
+		portName_[0] = '\0';
+	}
+
+	virtual ~LowLatencySerialConnection()
+	{
+		disconnect();
+	}
+
+	/**
+	 * @brief Sets the FTDI latency timer written on the next connect() [ms, 1-255], or 0 to leave it unchanged.
+	 */
+	void setLatencyTimer(int milliseconds) { latencyTimerMs_ = milliseconds; }
+
+	//! Sets how long read() waits for the first byte of a reply [ms]
+	void setReplyTimeout(int milliseconds) { replyTimeoutMs_ = milliseconds; }
+
+	//! Returns how long read() waits for the first byte of a reply [ms]
+	int replyTimeout() const { return replyTimeoutMs_; }
+
+	//! Sets how long sendSerialBreak() holds the line [ms], or 0 for the system's default (tcsendbreak, 250 to 500 ms)
+	void setBreakDuration(int milliseconds) { breakDurationMs_ = milliseconds; }
+
+	/**
+	 * @brief Chooses how reads wait for a reply, now or on the next connect().
+	 * @details BusyPoll suits a reader with a core of its own (see RealtimeConfig), where the microseconds
+	 *          a blocking reader takes to be woken and scheduled matter more than the CPU time. Timeouts are
+	 *          the same in both modes.
+	 * @param backoff What a busy-polling read does while nothing has arrived. Ignored when blocking.
+	 * @returns False if the port is open and could not be switched.
+	 */
+	bool setReceiveMode(ReceiveMode::value mode, SpinBackoff::value backoff = SpinBackoff::Pause)
+	{
+		receiveMode_ = mode;
+		backoff_ = backoff;
+		return fd_ < 0 || applyReceiveMode();
+	}
+
+	//! Returns how reads wait for a reply
+	ReceiveMode::value receiveMode() const { return receiveMode_; }
+
+	//! Returns what a busy-polling read does while nothing has arrived
+	SpinBackoff::value spinBackoff() const { return backoff_; }
+
+	bool isConnected() const
+	{
+		return fd_ >= 0;
+	}
+
+	/**
+	 * @brief Opens the serial device (eg. "/dev/ttyUSB0") in raw mode at 9600 baud, 8N1, and applies the
+	 *        low latency settings that the device supports.
+	 * @returns False if the device could not be opened or configured as a terminal.
+	 */
+	bool connect(const char* device)
+	{
+		disconnect();
+		fd_ = ::open(device, O_RDWR | O_NOCTTY);
+		if (fd_ < 0)
+		{
+			return false;
+		}
+		snprintf(portName_, sizeof(portName_), "%s", device);
+
+		if (!setSerialPortParams(9600, 8, 0, 0, 0) || !applyReceiveMode())
+		{
+			disconnect();
+			return false;
+		}
+		lowLatencyApplied_ = applyLowLatency();
+		latencyTimerApplied_ = applyLatencyTimer(device);
+		resetTurnaround();
+		return true;
+	}
+
+	void disconnect()
+	{
+		if (fd_ >= 0)
+		{
+			::close(fd_);
+			fd_ = -1;
+		}
+	}
+
+	/**
+	 * @brief Reads up to length bytes, returning once length bytes arrived or the reply paused.
+	 * @returns The number of bytes read, 0 if no reply started within the reply timeout, or -1 on error.
+	 */
+	int read(char* buffer, int length) const
+	{
+		int count = 0;
+		while (count < length)
+		{
+			// Wait for the rest of the reply in one read() wherever it fits in VMIN
+			int result = receive(buffer + count, length - count, length - count, count == 0 ? replyTimeoutMs_ : INTER_BYTE_TIMEOUT_DS * 100);
+			if (result < 0)
+			{
+				return -1;
+			}
+			if (result == 0)
+			{
+				break; // No reply, or the device stopped sending
+			}
+			count += result;
+		}
+		return count;
+	}
+
+	int read(byte_t* buffer, int length) const
+	{
+		return read(reinterpret_cast<char*>(buffer), length);
+	}
+
+	/**
+	 * @brief Reads a reply up to and including the terminator (CR for ASCII replies) in as few system calls as possible.
+	 * @returns The number of bytes read, 0 on timeout, or -1 on error or if the reply does not fit.
+	 */
+	int readUntil(char* buffer, int capacity, char terminator) const
+	{
+		int count = 0;
+		while (count < capacity)
+		{
+			// The reply length is unknown: take each burst as it arrives
+			int result = receive(buffer + count, capacity - count, 1, count == 0 ? replyTimeoutMs_ : INTER_BYTE_TIMEOUT_DS * 100);
+			if (result <= 0)
+			{
+				return result < 0 ? -1 : count; // No reply, or the reply paused without a terminator
+			}
+			const void* end = memchr(buffer + count, terminator, result);
+			count += result;
+			if (end != NULL)
+			{
+				return count;
+			}
+		}
+		return -1;
+	}
+
+	/**
+	 * @brief Waits for a reply to start, then takes every byte received so far in a single read.
+	 * @returns The number of bytes read, 0 if no reply started within the reply timeout, or -1 on error.
+	 */
+	int readAvailable(char* buffer, int capacity) const
+	{
+		return receive(buffer, capacity, 1, replyTimeoutMs_);
+	}
+
+	int write(const char* buffer, int length) const
+	{
+		int count = 0;
+		while (count < length)
+		{
+			int result = static_cast<int>(::write(fd_, buffer + count, length - count));
+			if (result < 0)
+			{
+				// A busy-polling port is non-blocking: EAGAIN means the output queue is full, so try again
+				if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					continue;
+				}
+				return -1;
+			}
+			count += result;
+		}
+		writeTime_ = std::chrono::steady_clock::now();
+		writePending_ = true;
+		return count;
+	}
+
+	int write(byte_t* buffer, int length) const
+	{
+		return write(reinterpret_cast<const char*>(buffer), length);
+	}
+
+	char* connectionName()
+	{
+		return portName_;
+	}
+
+	/**
+	 * @brief Sets serial port parameters governing how the host sends/receives data.
+	 * @param baudRate Specifies the data transmission rate. 14400 and 1228739 have no POSIX equivalent.
+	 * @param dataBits Specifies the size of a byte
+	 * @param parity Specifies parity: { 0 = None, 1 = Odd, 2 = Even}
+	 * @param stopBits Specifies the number of stop bits: { 0 = 1 bit, 1 = 2 bits}
+	 * @param enableHandshake Enables or disables hardware handshaking: { 0 = Off, 1 = On}
+	 * @returns True if the settings were saved successfully, otherwise false.
+	 */
+	bool setSerialPortParams(int baudRate = 9600, int dataBits = 8, int parity = 0, int stopBits = 0, int enableHandshake = 1) const
+	{
+		speed_t speed;
+		if (!toSpeed(baudRate, speed))
+		{
+			return false;
+		}
+
+		struct termios options;
+		if (tcgetattr(fd_, &options) != 0)
+		{
+			return false;
+		}
+		cfmakeraw(&options);
+		cfsetispeed(&options, speed);
+		cfsetospeed(&options, speed);
+		options.c_cflag |= (CLOCAL | CREAD);
+		options.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+		options.c_cflag |= (dataBits == 7) ? CS7 : CS8;
+		if (parity != 0)
+		{
+			options.c_cflag |= (parity == 1) ? (PARENB | PARODD) : PARENB;
+		}
+		if (stopBits != 0)
+		{
+			options.c_cflag |= CSTOPB;
+		}
+		if (enableHandshake != 0)
+		{
+			options.c_cflag |= CRTSCTS;
+		}
+
+		// read() returns once VMIN bytes arrived, or INTER_BYTE_TIMEOUT_DS after the last byte of a burst
+		options.c_cc[VMIN] = 1;
+		options.c_cc[VTIME] = INTER_BYTE_TIMEOUT_DS;
+		vmin_ = 1;
+
+		return tcsetattr(fd_, TCSANOW, &options) == 0 && tcflush(fd_, TCIOFLUSH) == 0;
+	}
+
+	/**
+	 * @brief Sends a serial break lasting the break duration.
+	 * @details tcsendbreak() holds the line for 250 to 500 ms, where the SCU only needs a few character times.
+	 *          TIOCSBRK/TIOCCBRK time the break here instead, falling back to tcsendbreak() where they fail.
+	 * @returns True if the break was sent successfully, otherwise false.
+	 */
+	bool sendSerialBreak() const
+	{
+#if defined(TIOCSBRK) && defined(TIOCCBRK)
+		if (breakDurationMs_ > 0 && ioctl(fd_, TIOCSBRK) == 0)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(breakDurationMs_));
+			return ioctl(fd_, TIOCCBRK) == 0;
+		}
+#endif
+		return tcsendbreak(fd_, 0) == 0;
+	}
+
+	//! Drops every byte received but not read, and every byte written but not sent
+	bool flush() const
+	{
+		writePending_ = false;
+		return tcflush(fd_, TCIOFLUSH) == 0;
+	}
+
+	//! Returns true if ASYNC_LOW_LATENCY was set on the tty
+	bool lowLatencyApplied() const { return lowLatencyApplied_; }
+
+	//! Returns true if the FTDI latency timer was written
+	bool latencyTimerApplied() const { return latencyTimerApplied_; }
+
+	//! Returns the number of turnarounds measured since connect() or resetTurnaround()
+	uint64_t turnaroundCount() const { return turnaroundCount_; }
+
+	//! Returns the last measured turnaround [us]
+	double lastTurnaroundUs() const { return lastTurnaroundNs_ / 1e3; }
+
+	//! Returns the shortest measured turnaround [us]
+	double minTurnaroundUs() const { return turnaroundMinNs_ / 1e3; }
+
+	//! Returns the longest measured turnaround [us]
+	double maxTurnaroundUs() const { return turnaroundMaxNs_ / 1e3; }
+
+	//! Returns the mean measured turnaround [us]
+	double meanTurnaroundUs() const { return turnaroundCount_ == 0 ? 0.0 : turnaroundSumNs_ / 1e3 / turnaroundCount_; }
+
+	//! Clears the turnaround statistics
+	void resetTurnaround()
+	{
+		turnaroundCount_ = 0;
+		turnaroundMinNs_ = turnaroundMaxNs_ = turnaroundSumNs_ = lastTurnaroundNs_ = 0;
+		writePending_ = false;
+	}
+
+	//! Describes which low latency settings were applied and the turnaround measured so far
+	std::string tuningReport() const
+	{
+		static const char* backoffs[] = { "no backoff", "pause", "yield" };
+		char mode[48];
+		if (receiveMode_ == ReceiveMode::BusyPoll)
+		{
+			snprintf(mode, sizeof(mode), "busy-poll (%s)", backoffs[backoff_]);
+		}
+		else
+		{
+			snprintf(mode, sizeof(mode), "blocking");
+		}
+		char report[320];
+		snprintf(report, sizeof(report),
+			"%s: ASYNC_LOW_LATENCY %s, latency timer %s, %s receive, turnaround %llu x [min %.1f, mean %.1f, max %.1f] us",
+			portName_, lowLatencyApplied_ ? "set" : "unsupported",
+			latencyTimerApplied_ ? "set" : "unavailable", mode,
+			static_cast<unsigned long long>(turnaroundCount_), minTurnaroundUs(), meanTurnaroundUs(), maxTurnaroundUs());
+		return report;
+	}
+
+private:
+	//! Waits up to timeoutMs for readable data
+	bool waitReadable(int timeoutMs) const
+	{
+		struct pollfd descriptor;
+		descriptor.fd = fd_;
+		descriptor.events = POLLIN;
+		descriptor.revents = 0;
+		int result;
+		do
+		{
+			result = poll(&descriptor, 1, timeoutMs);
+		} while (result < 0 && errno == EINTR);
+		return result > 0 && (descriptor.revents & POLLIN);
+	}
+
+	/**
+	 * @brief Waits up to timeoutMs for bytes, then reads up to capacity of them in the receive mode.
+	 * @param framing The bytes a blocking read waits for before returning (VMIN). Unused when busy-polling.
+	 * @returns The number of bytes read, 0 if none arrived in time, or -1 on error.
+	 */
+	int receive(char* buffer, int capacity, int framing, int timeoutMs) const
+	{
+		if (receiveMode_ == ReceiveMode::BusyPoll)
+		{
+			return spinRead(buffer, capacity, timeoutMs);
+		}
+		if (!waitReadable(timeoutMs) || !setFraming(framing))
+		{
+			return 0;
+		}
+		recordTurnaround();
+		for (;;)
+		{
+			int result = static_cast<int>(::read(fd_, buffer, capacity));
+			if (result < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			return result < 0 ? -1 : result;
+		}
+	}
+
+	//! Reads without blocking until bytes arrive or timeoutMs passes, backing off between empty reads
+	int spinRead(char* buffer, int capacity, int timeoutMs) const
+	{
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+		for (unsigned int spins = 0;; spins++)
+		{
+			int result = static_cast<int>(::read(fd_, buffer, capacity));
+			if (result > 0)
+			{
+				recordTurnaround();
+				return result;
+			}
+			if (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			{
+				return -1;
+			}
+			if (std::chrono::steady_clock::now() >= deadline)
+			{
+				return 0;
+			}
+			if (backoff_ != SpinBackoff::None)
+			{
+				cpuRelax();
+				if (backoff_ == SpinBackoff::Yield && spins >= YIELD_AFTER_SPINS)
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+	}
+
+	//! Tells the CPU this is a spin-wait loop
+	static void cpuRelax()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+		__asm__ __volatile__("yield");
+#endif
+	}
+
+	//! Makes reads non-blocking for BusyPoll and blocking otherwise
+	bool applyReceiveMode() const
+	{
+		int flags = fcntl(fd_, F_GETFL);
+		if (flags < 0)
+		{
+			return false;
+		}
+		int wanted = (receiveMode_ == ReceiveMode::BusyPoll) ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+		return wanted == flags || fcntl(fd_, F_SETFL, wanted) == 0;
+	}
+
+	//! Records the turnaround of a pending write, now that the first byte of its reply has arrived
+	void recordTurnaround() const
+	{
+		if (writePending_)
+		{
+			int64_t turnaround = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - writeTime_).count();
+			lastTurnaroundNs_ = turnaround;
+			turnaroundSumNs_ += turnaround;
+			if (turnaroundCount_ == 0 || turnaround < turnaroundMinNs_)
+			{
+				turnaroundMinNs_ = turnaround;
+			}
+			if (turnaround > turnaroundMaxNs_)
+			{
+				turnaroundMaxNs_ = turnaround;
+			}
+			turnaroundCount_++;
+			writePending_ = false;
+		}
+	}
+
+	/**
+	 * @brief Sets VMIN to the expected number of bytes (at most 255), skipping the call when it is unchanged.
+	 * @details Only called once poll() has seen data waiting, so the VTIME inter-byte timer starts at once
+	 *          and read() cannot block indefinitely.
+	 */
+	bool setFraming(int length) const
+	{
+		int vmin = length < 1 ? 1 : (length > 255 ? 255 : length);
+		if (vmin == vmin_)
+		{
+			return true;
+		}
+		struct termios options;
+		if (tcgetattr(fd_, &options) != 0)
+		{
+			return false;
+		}
+		options.c_cc[VMIN] = static_cast<cc_t>(vmin);
+		if (tcsetattr(fd_, TCSANOW, &options) != 0)
+		{
+			return false;
+		}
+		vmin_ = vmin;
+		return true;
+	}
+
+	//! Sets ASYNC_LOW_LATENCY. Fails quietly on ptys and drivers without TIOCGSERIAL
+	bool applyLowLatency() const
+	{
+#if defined(__linux__) && defined(ASYNC_LOW_LATENCY)
+		struct serial_struct serial;
+		if (ioctl(fd_, TIOCGSERIAL, &serial) != 0)
+		{
+			return false;
+		}
+		serial.flags |= ASYNC_LOW_LATENCY;
+		return ioctl(fd_, TIOCSSERIAL, &serial) == 0;
+#else
+		return false;
+#endif
+	}
+
+	//! Writes the latency timer of a USB-serial device. Fails quietly if there is no such sysfs file
+	bool applyLatencyTimer(const char* device) const
+	{
+#ifdef __linux__
+		if (latencyTimerMs_ <= 0 || latencyTimerMs_ > 255)
+		{
+			return false;
+		}
+
+		// Resolve links such as /dev/serial/by-id/... to the ttyUSBn name used in sysfs
+		char resolved[PATH_MAX];
+		if (realpath(device, resolved) == NULL)
+		{
+			return false;
+		}
+		const char* name = strrchr(resolved, '/');
+		name = (name == NULL) ? resolved : name + 1;
+
+		char path[PATH_MAX + 64];
+		snprintf(path, sizeof(path), "/sys/bus/usb-serial/devices/%s/latency_timer", name);
+		int file = ::open(path, O_WRONLY);
+		if (file < 0)
+		{
+			return false;
+		}
+		char value[8];
+		int length = snprintf(value, sizeof(value), "%d", latencyTimerMs_);
+		bool written = ::write(file, value, length) == length;
+		::close(file);
+		return written;
+#else
+		return false;
+#endif
+	}
+
+	static bool toSpeed(int baudRate, speed_t& speed)
+	{
+		switch (baudRate)
+		{
+			case 9600: speed = B9600; return true;
+			case 19200: speed = B19200; return true;
+			case 38400: speed = B38400; return true;
+			case 57600: speed = B57600; return true;
+			case 115200: speed = B115200; return true;
+#ifdef B230400
+			case 230400: speed = B230400; return true;
+#endif
+#ifdef B921600
+			case 921600: speed = B921600; return true;
+#endif
+			default: return false;
+		}
+	}
+
+	char portName_[64];
+	int fd_;
+
+	//! The VMIN currently set on the port
+	mutable int vmin_;
+
+	int latencyTimerMs_;
+	int replyTimeoutMs_;
+	int breakDurationMs_;
+	ReceiveMode::value receiveMode_;
+	SpinBackoff::value backoff_;
+	bool lowLatencyApplied_;
+	bool latencyTimerApplied_;
+
+	// Turnaround measurement, updated by the const read/write methods
+	mutable std::chrono::steady_clock::time_point writeTime_;
+	mutable bool writePending_;
+	mutable uint64_t turnaroundCount_;
+	mutable int64_t turnaroundMinNs_;
+	mutable int64_t turnaroundMaxNs_;
+	mutable int64_t turnaroundSumNs_;
+	mutable int64_t lastTurnaroundNs_;
+};
+
+#endif // _WIN32
+
+#endif // LOW_LATENCY_SERIAL_CONNECTION_HPP
@@ -0,0 +1,138 @@
+#ifndef MONOTONIC_ARENA_HPP
+#define MONOTONIC_ARENA_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A bump allocator whose memory is released all at once by reset().
+ * @details Allocations are carved sequentially out of one block. If a frame needs more than the
+ *          block holds, overflow blocks are chained on; the next reset() folds them into a single
+ *          larger block so the arena settles at the high-water mark and stops touching the heap.
+ *          Destructors are never run, so only trivially destructible types may be created here.
+ */
+class MonotonicArena
+{
+public:
+	/**
+	 * @brief Creates an arena with one block of the given size.
+	 * @param capacity The initial block size in bytes.
+	 */
+	explicit MonotonicArena(size_t capacity = 64 * 1024)
+		: head_(NULL), capacity_(0), used_(0), overflowBytes_(0), highWaterMark_(0)
+	{
+		allocateHead(capacity);
+	}
+
+	//! Frees the block and any overflow blocks.
+	~MonotonicArena()
+	{
+		releaseOverflow();
+		std::free(head_);
+	}
+
+	/**
+	 * @brief Returns a block of memory with the requested size and alignment.
+	 * @returns A pointer into the arena, or NULL if the system is out of memory.
+	 */
+	void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+	{
+		size_t offset = (used_ + alignment - 1) & ~(alignment - 1);
+		if (offset + bytes <= capacity_)
+		{
+			used_ = offset + bytes;
+			return head_ + offset;
+		}
+
+		// The frame outgrew the block: park the request in an overflow block until the next reset()
+		char* block = static_cast<char*>(std::malloc(bytes + alignment));
+		if (block == NULL)
+		{
+			return NULL;
+		}
+		overflow_.push_back(block);
+		overflowBytes_ += bytes + alignment;
+		size_t misalignment = reinterpret_cast<size_t>(block) & (alignment - 1);
+		return block + (misalignment == 0 ? 0 : alignment - misalignment);
+	}
+
+	//! Allocates uninitialized storage for count objects of type T.
+	template <typename T>
+	T* allocateArray(size_t count)
+	{
+		return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+	}
+
+	//! Constructs a T in the arena. T must not need its destructor to run.
+	template <typename T, typename... Args>
+	T* create(Args&&... args)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "MonotonicArena never runs destructors");
+		void* memory = allocate(sizeof(T), alignof(T));
+		return memory == NULL ? NULL : new (memory) T(std::forward<Args>(args)...);
+	}
+
+	/**
+	 * @brief Releases every allocation made since the last reset.
+	 * @details If the previous frame spilled into overflow blocks, the main block is regrown once to
+	 *          cover the whole frame so that subsequent frames of the same size never spill.
+	 */
+	void reset()
+	{
+		size_t frameBytes = used_ + overflowBytes_;
+		if (frameBytes > highWaterMark_)
+		{
+			highWaterMark_ = frameBytes;
+		}
+		if (!overflow_.empty())
+		{
+			releaseOverflow();
+			std::free(head_);
+			allocateHead(frameBytes + frameBytes / 2);
+		}
+		used_ = 0;
+	}
+
+	//! Returns the number of bytes handed out from the main block since the last reset
+	size_t bytesUsed() const { return used_ + overflowBytes_; }
+
+	//! Returns the size of the main block in bytes
+	size_t capacity() const { return capacity_; }
+
+	//! Returns the largest number of bytes any single frame has needed
+	size_t highWaterMark() const { return highWaterMark_; }
+
+private:
+	// The arena owns raw blocks, so copying it would double-free them
+	MonotonicArena(const MonotonicArena&);
+	MonotonicArena& operator=(const MonotonicArena&);
+
+	void allocateHead(size_t capacity)
+	{
+		head_ = static_cast<char*>(std::malloc(capacity));
+		capacity_ = head_ == NULL ? 0 : capacity;
+	}
+
+	void releaseOverflow()
+	{
+		for (size_t i = 0; i < overflow_.size(); i++)
+		{
+			std::free(overflow_[i]);
+		}
+		overflow_.clear();
+		overflowBytes_ = 0;
+	}
+
+	char* head_;
+	size_t capacity_;
+	size_t used_;
+	std::vector<char*> overflow_;
+	size_t overflowBytes_;
+	size_t highWaterMark_;
+};
+
+#endif // MONOTONIC_ARENA_HPP
@@ -0,0 +1,341 @@
+#ifndef POSE_CALIBRATION_HPP
+#define POSE_CALIBRATION_HPP
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "TransformBatch.h"
+
+/**
+ * @brief Applies per-handle tool-tip offsets and a global registration transform to a TransformBatch.
+ * @details For every valid handle the stage computes
+ *              p' = Rreg * (t + R(q) * tip[handle]) + treg
+ *              q' = qreg * q
+ *          so the outputs are tool-tip poses expressed in the registered (patient or robot) frame.
+ *          The registration must be rigid: a proper rotation plus a translation in mm. A rotation that is not
+ *          orthonormal within RIGID_TOLERANCE, or whose determinant is not +1 (a reflection), is rejected; one
+ *          within the tolerance, eg. typed with four decimals, is made exactly orthonormal, so q' stays a unit
+ *          quaternion and p' is never scaled.
+ *
+ *          A calibration file is plain text, one entry per line, '#' starts a comment:
+ *              registration r11 r12 r13 tx r21 r22 r23 ty r31 r32 r33 tz
+ *              tip <handle in hex> x y z
+ *          The registration is the top three rows of the 4x4 homogeneous matrix, row by row.
+ */
+class PoseCalibration
+{
+public:
+	//! Port handles are two hex characters, so a lookup table of this size covers every handle
+	static const int MAX_HANDLE = 256;
+
+	//! The largest error allowed in any element of R' * R - I for a registration rotation
+	static constexpr double RIGID_TOLERANCE = 1.0e-3;
+
+	//! Creates an identity calibration: no tip offsets, no registration.
+	explicit PoseCalibration(int capacity = 16)
+		: hasRegistration_(false), hasToolTips_(false),
+		  tipX_(MAX_HANDLE, 0.0), tipY_(MAX_HANDLE, 0.0), tipZ_(MAX_HANDLE, 0.0),
+		  offsetX_(capacity), offsetY_(capacity), offsetZ_(capacity)
+	{
+		setRegistration(NULL, NULL);
+	}
+
+	//! Returns true if applying the calibration would change any pose
+	bool isIdentity() const { return !hasRegistration_ && !hasToolTips_; }
+
+	/**
+	 * @brief Sets the tool-tip offset of one handle, expressed in the sensor's own frame [mm].
+	 */
+	void setToolTipOffset(uint16_t handle, double x, double y, double z)
+	{
+		if (handle >= MAX_HANDLE)
+		{
+			return;
+		}
+		tipX_[handle] = x;
+		tipY_[handle] = y;
+		tipZ_[handle] = z;
+		hasToolTips_ = hasToolTips_ || x != 0.0 || y != 0.0 || z != 0.0;
+	}
+
+	/**
+	 * @brief Sets the registration transform.
+	 * @param rotation A 3x3 rotation matrix in row-major order, or NULL for identity.
+	 * @param translation The translation [mm], or NULL for zero.
+	 * @returns False, leaving the registration unchanged, if the rotation is not a proper rotation (see the class description).
+	 */
+	bool setRegistration(const double* rotation, const double* translation)
+	{
+		static const double identity[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+		static const double zero[3] = { 0, 0, 0 };
+		const double* r = rotation == NULL ? identity : rotation;
+		const double* t = translation == NULL ? zero : translation;
+		if (!isProperRotation(r))
+		{
+			return false;
+		}
+
+		// The quaternion of a rotation within the tolerance is normalized, and the matrix rebuilt from it
+		double q[4];
+		matrixToQuaternion(r, q);
+		double norm = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		for (int i = 0; i < 4; i++)
+		{
+			registrationQuaternion_[i] = q[i] / norm;
+		}
+		quaternionToMatrix(registrationQuaternion_, rotation_);
+		for (int i = 0; i < 3; i++)
+		{
+			translation_[i] = t[i];
+		}
+		hasRegistration_ = rotation != NULL || translation != NULL;
+		return true;
+	}
+
+	/**
+	 * @brief Sets the registration from a 4x4 homogeneous matrix stored column-major, as MATLAB passes it.
+	 * @returns False, leaving the registration unchanged, if the matrix is not a rigid transform.
+	 */
+	bool setRegistrationColumnMajor4x4(const double* matrix)
+	{
+		double rotation[9];
+		double translation[3];
+		for (int row = 0; row < 3; row++)
+		{
+			for (int col = 0; col < 3; col++)
+			{
+				rotation[3 * row + col] = matrix[row + 4 * col];
+			}
+			translation[row] = matrix[row + 12];
+		}
+		return setRegistration(rotation, translation);
+	}
+
+	/**
+	 * @brief Loads tip offsets and a registration from a calibration file (see the class description).
+	 * @returns Zero for success, -1 if the file could not be opened, or the line number of the first invalid entry,
+	 *          including a registration that is not rigid.
+	 */
+	int loadFile(const std::string& path)
+	{
+		std::ifstream file(path.c_str());
+		if (!file.is_open())
+		{
+			return -1;
+		}
+
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(file, line))
+		{
+			lineNumber++;
+			size_t comment = line.find('#');
+			if (comment != std::string::npos)
+			{
+				line.erase(comment);
+			}
+			std::istringstream tokens(line);
+			std::string keyword;
+			if (!(tokens >> keyword))
+			{
+				continue;
+			}
+
+			if (keyword == "registration")
+			{
+				double values[12];
+				for (int i = 0; i < 12; i++)
+				{
+					if (!(tokens >> values[i]))
+					{
+						return lineNumber;
+					}
+				}
+				double rotation[9] = { values[0], values[1], values[2], values[4], values[5], values[6], values[8], values[9], values[10] };
+				double translation[3] = { values[3], values[7], values[11] };
+				if (!setRegistration(rotation, translation))
+				{
+					return lineNumber;
+				}
+			}
+			else if (keyword == "tip")
+			{
+				unsigned int handle = 0;
+				double x, y, z;
+				if (!(tokens >> std::hex >> handle >> std::dec >> x >> y >> z) || handle >= MAX_HANDLE)
+				{
+					return lineNumber;
+				}
+				setToolTipOffset(static_cast<uint16_t>(handle), x, y, z);
+			}
+			else
+			{
+				return lineNumber;
+			}
+		}
+		return 0;
+	}
+
+	/**
+	 * @brief Transforms every valid handle of the batch in place. Invalid handles are left untouched.
+	 */
+	void apply(TransformBatch& batch)
+	{
+		const int n = batch.size() < static_cast<int>(offsetX_.size()) ? batch.size() : static_cast<int>(offsetX_.size());
+		if (isIdentity() || n == 0)
+		{
+			return;
+		}
+
+		const uint8_t* valid = &batch.valid[0];
+		double* q0 = &batch.q0[0];
+		double* qx = &batch.qx[0];
+		double* qy = &batch.qy[0];
+		double* qz = &batch.qz[0];
+		double* tx = &batch.tx[0];
+		double* ty = &batch.ty[0];
+		double* tz = &batch.tz[0];
+
+		// Gather the tip offsets of this frame's handles so the arithmetic below runs over flat arrays
+		double* ox = &offsetX_[0];
+		double* oy = &offsetY_[0];
+		double* oz = &offsetZ_[0];
+		for (int i = 0; i < n; i++)
+		{
+			uint16_t handle = batch.toolHandle[i] < MAX_HANDLE ? batch.toolHandle[i] : 0;
+			ox[i] = tipX_[handle];
+			oy[i] = tipY_[handle];
+			oz[i] = tipZ_[handle];
+		}
+
+		// Tool tip: t + R(q) * o, using v' = v + 2w(u x v) + 2u x (u x v)
+		for (int i = 0; i < n; i++)
+		{
+			const double w = q0[i], ux = qx[i], uy = qy[i], uz = qz[i];
+			const double cx = 2.0 * (uy * oz[i] - uz * oy[i]);
+			const double cy = 2.0 * (uz * ox[i] - ux * oz[i]);
+			const double cz = 2.0 * (ux * oy[i] - uy * ox[i]);
+			const double keep = valid[i] ? 1.0 : 0.0;
+			tx[i] += keep * (ox[i] + w * cx + (uy * cz - uz * cy));
+			ty[i] += keep * (oy[i] + w * cy + (uz * cx - ux * cz));
+			tz[i] += keep * (oz[i] + w * cz + (ux * cy - uy * cx));
+		}
+
+		if (!hasRegistration_)
+		{
+			return;
+		}
+
+		// Registration: p' = Rreg * p + treg and q' = qreg * q
+		const double* r = rotation_;
+		const double rw = registrationQuaternion_[0], rx = registrationQuaternion_[1];
+		const double ry = registrationQuaternion_[2], rz = registrationQuaternion_[3];
+		for (int i = 0; i < n; i++)
+		{
+			const double px = tx[i], py = ty[i], pz = tz[i];
+			const double w = q0[i], x = qx[i], y = qy[i], z = qz[i];
+			const bool keep = valid[i] != 0;
+			tx[i] = keep ? r[0] * px + r[1] * py + r[2] * pz + translation_[0] : px;
+			ty[i] = keep ? r[3] * px + r[4] * py + r[5] * pz + translation_[1] : py;
+			tz[i] = keep ? r[6] * px + r[7] * py + r[8] * pz + translation_[2] : pz;
+			q0[i] = keep ? rw * w - rx * x - ry * y - rz * z : w;
+			qx[i] = keep ? rw * x + rx * w + ry * z - rz * y : x;
+			qy[i] = keep ? rw * y - rx * z + ry * w + rz * x : y;
+			qz[i] = keep ? rw * z + rx * y - ry * x + rz * w : z;
+		}
+	}
+
+private:
+	//! Returns true if a row-major matrix is orthonormal within RIGID_TOLERANCE and its determinant is positive
+	static bool isProperRotation(const double* m)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				// Element (i, j) of R' * R: the dot product of columns i and j
+				double dot = m[i] * m[j] + m[3 + i] * m[3 + j] + m[6 + i] * m[6 + j];
+				if (!(std::fabs(dot - (i == j ? 1.0 : 0.0)) <= RIGID_TOLERANCE))
+				{
+					return false;
+				}
+			}
+		}
+		double determinant = m[0] * (m[4] * m[8] - m[5] * m[7]) - m[1] * (m[3] * m[8] - m[5] * m[6]) + m[2] * (m[3] * m[7] - m[4] * m[6]);
+		return determinant > 0.0;
+	}
+
+	//! Converts a unit quaternion [w, x, y, z] to a row-major rotation matrix
+	static void quaternionToMatrix(const double* q, double* m)
+	{
+		const double w = q[0], x = q[1], y = q[2], z = q[3];
+		m[0] = 1.0 - 2.0 * (y * y + z * z);
+		m[1] = 2.0 * (x * y - w * z);
+		m[2] = 2.0 * (x * z + w * y);
+		m[3] = 2.0 * (x * y + w * z);
+		m[4] = 1.0 - 2.0 * (x * x + z * z);
+		m[5] = 2.0 * (y * z - w * x);
+		m[6] = 2.0 * (x * z - w * y);
+		m[7] = 2.0 * (y * z + w * x);
+		m[8] = 1.0 - 2.0 * (x * x + y * y);
+	}
+
+	//! Converts a row-major rotation matrix to a unit quaternion [w, x, y, z]
+	static void matrixToQuaternion(const double* m, double* q)
+	{
+		double trace = m[0] + m[4] + m[8];
+		if (trace > 0.0)
+		{
+			double s = 2.0 * std::sqrt(1.0 + trace);
+			q[0] = 0.25 * s;
+			q[1] = (m[7] - m[5]) / s;
+			q[2] = (m[2] - m[6]) / s;
+			q[3] = (m[3] - m[1]) / s;
+		}
+		else if (m[0] > m[4] && m[0] > m[8])
+		{
+			double s = 2.0 * std::sqrt(1.0 + m[0] - m[4] - m[8]);
+			q[0] = (m[7] - m[5]) / s;
+			q[1] = 0.25 * s;
+			q[2] = (m[1] + m[3]) / s;
+			q[3] = (m[2] + m[6]) / s;
+		}
+		else if (m[4] > m[8])
+		{
+			double s = 2.0 * std::sqrt(1.0 + m[4] - m[0] - m[8]);
+			q[0] = (m[2] - m[6]) / s;
+			q[1] = (m[1] + m[3]) / s;
+			q[2] = 0.25 * s;
+			q[3] = (m[5] + m[7]) / s;
+		}
+		else
+		{
+			double s = 2.0 * std::sqrt(1.0 + m[8] - m[0] - m[4]);
+			q[0] = (m[3] - m[1]) / s;
+			q[1] = (m[2] + m[6]) / s;
+			q[2] = (m[5] + m[7]) / s;
+			q[3] = 0.25 * s;
+		}
+	}
+
+	bool hasRegistration_;
+	bool hasToolTips_;
+
+	//! The registration rotation (row-major), its quaternion, and translation [mm]
+	double rotation_[9];
+	double registrationQuaternion_[4];
+	double translation_[3];
+
+	//! Tip offsets indexed by port handle
+	std::vector<double> tipX_, tipY_, tipZ_;
+
+	//! Scratch space holding the offsets gathered for the current frame
+	std::vector<double> offsetX_, offsetY_, offsetZ_;
+};
+
+#endif // POSE_CALIBRATION_HPP
@@ -0,0 +1,297 @@
+#ifndef POSE_HISTORY_HPP
+#define POSE_HISTORY_HPP
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "PoseSample.h"
+#include "RealtimeThread.h"
+#include "SeqLock.h"
+
+/**
+ * @brief A fixed-capacity history of recent frames that answers "where was this tool at time t".
+ * @details Camera frames, ultrasound images and arm samples are captured at their own instants. Given the
+ *          AcquisitionClock time of such a capture, query() finds the two frames that bracket it by binary
+ *          search over the ring and interpolates between them: linearly for the position and error, by
+ *          SLERP for the orientation. Only one thread (usually the acquisition thread, see
+ *          AuroraAcquisition::setHistory()) may push(); any number of threads may query concurrently without
+ *          locks. Readers never block the writer: a query that races with the writer overwriting its frames
+ *          simply searches again.
+ */
+class PoseHistory
+{
+public:
+	//! The outcome of a query
+	enum Result
+	{
+		Ok = 0,
+		TooOld = -1,  //!< The time is before the oldest frame kept
+		TooNew = -2,  //!< The time is after the latest frame
+		Missing = -3, //!< The tool was not tracked in one of the bracketing frames
+		Gap = -4,     //!< The bracketing frames are further apart than the maximum gap
+		Busy = -5     //!< The writer overwrote the bracketing frames on every attempt
+	};
+
+	/**
+	 * @param capacity The number of frames kept, eg. 400 frames span 10 s at 40 Hz.
+	 */
+	explicit PoseHistory(int capacity = 400)
+		: capacity_(capacity < 2 ? 2 : capacity), slots_(new Slot[capacity_]), pushed_(0), maxGapNs_(100000000)
+	{
+	}
+
+	//! Returns the number of frames the ring holds
+	int capacity() const { return capacity_; }
+
+	//! Touches every frame of the ring, so the first laps of push() don't page fault
+	void prefault()
+	{
+		RealtimeThread::prefault(slots_.get(), static_cast<size_t>(capacity_) * sizeof(Slot));
+	}
+
+	/**
+	 * @brief Sets the widest interval between two frames that is interpolated across [ns].
+	 * @details Frames further apart than this (eg. because acquisition stalled) make query() return Gap.
+	 */
+	void setMaxGap(int64_t nanoseconds) { maxGapNs_ = nanoseconds; }
+
+	/**
+	 * @brief Appends a frame. Frames must arrive in increasing timestamp order; others are ignored.
+	 * @returns False if the frame was ignored.
+	 */
+	bool push(const PoseSample& sample)
+	{
+		uint64_t index = pushed_.load(std::memory_order_relaxed);
+		if (index > 0 && sample.timestamp <= slots_[(index - 1) % capacity_].timestamp.load(std::memory_order_relaxed))
+		{
+			return false;
+		}
+		Slot& slot = slots_[index % capacity_];
+		entry_.index = index;
+		entry_.sample = sample;
+		// Searches compare against the timestamp before reading the frame, so it is invalidated first
+		slot.timestamp.store(INT64_MIN, std::memory_order_relaxed);
+		slot.entry.write(entry_);
+		slot.timestamp.store(sample.timestamp, std::memory_order_release);
+		pushed_.store(index + 1, std::memory_order_release);
+		return true;
+	}
+
+	//! Returns the number of frames pushed so far
+	uint64_t size() const { return pushed_.load(std::memory_order_acquire); }
+
+	/**
+	 * @brief Returns the pose of a tool at the given host time.
+	 * @param toolHandle The port handle of the tool.
+	 * @param time An AcquisitionClock time [ns].
+	 * @param pose Receives the interpolated pose. Its valid flag is set only when the result is Ok.
+	 * @returns A Result.
+	 */
+	int query(uint16_t toolHandle, int64_t time, TrackedPose& pose) const
+	{
+		Entry before;
+		Entry after;
+		int result = bracket(time, before, after);
+		pose.toolHandle = toolHandle;
+		pose.valid = 0;
+		if (result != Ok)
+		{
+			return result;
+		}
+		const TrackedPose* a = before.sample.find(toolHandle);
+		const TrackedPose* b = after.sample.find(toolHandle);
+		if (a == NULL || b == NULL || !a->valid || !b->valid)
+		{
+			return Missing;
+		}
+		interpolate(*a, *b, fraction(before.sample, after.sample, time), pose);
+		return Ok;
+	}
+
+	/**
+	 * @brief Returns every tool's pose at the given host time.
+	 * @details The sample holds the tools of the later bracketing frame; tools missing from either frame
+	 *          are marked invalid. The frame number is that of the nearer frame.
+	 * @returns A Result other than Missing.
+	 */
+	int query(int64_t time, PoseSample& sample) const
+	{
+		Entry before;
+		Entry after;
+		int result = bracket(time, before, after);
+		if (result != Ok)
+		{
+			sample.numPoses = 0;
+			return result;
+		}
+		double f = fraction(before.sample, after.sample, time);
+		sample = after.sample;
+		sample.timestamp = time;
+		sample.frameNumber = f < 0.5 ? before.sample.frameNumber : after.sample.frameNumber;
+		for (int i = 0; i < sample.numPoses; i++)
+		{
+			const TrackedPose* a = before.sample.find(after.sample.poses[i].toolHandle);
+			if (a == NULL || !a->valid || !after.sample.poses[i].valid)
+			{
+				sample.poses[i].valid = 0;
+				continue;
+			}
+			interpolate(*a, after.sample.poses[i], f, sample.poses[i]);
+		}
+		return Ok;
+	}
+
+	/**
+	 * @brief Spherical linear interpolation between two unit quaternions [q0, qx, qy, qz].
+	 * @details Takes the shorter arc, and falls back to a normalized linear blend when the quaternions are
+	 *          nearly equal.
+	 */
+	static void slerp(const double a[4], const double b[4], double f, double result[4])
+	{
+		double dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+		double sign = 1.0;
+		if (dot < 0.0)
+		{
+			dot = -dot;
+			sign = -1.0;
+		}
+		double wa = 1.0 - f;
+		double wb = f;
+		if (dot < 0.9995)
+		{
+			double theta = std::acos(dot);
+			double s = std::sin(theta);
+			wa = std::sin((1.0 - f) * theta) / s;
+			wb = std::sin(f * theta) / s;
+		}
+		double norm = 0.0;
+		for (int i = 0; i < 4; i++)
+		{
+			result[i] = wa * a[i] + sign * wb * b[i];
+			norm += result[i] * result[i];
+		}
+		norm = std::sqrt(norm);
+		for (int i = 0; i < 4; i++)
+		{
+			result[i] /= norm;
+		}
+	}
+
+private:
+	//! A frame and its position in the sequence of pushed frames
+	struct Entry
+	{
+		uint64_t index;
+		PoseSample sample;
+	};
+
+	struct Slot
+	{
+		Slot() : timestamp(INT64_MIN) {}
+
+		//! A copy of entry.sample.timestamp that searches read without copying the frame
+		std::atomic<int64_t> timestamp;
+		SeqLocked<Entry> entry;
+	};
+
+	//! The number of attempts a query makes before giving up on a writer that keeps overwriting its frames
+	enum { MAX_ATTEMPTS = 8 };
+
+	/**
+	 * @brief Copies the consecutive frames with before.timestamp <= time <= after.timestamp.
+	 */
+	int bracket(int64_t time, Entry& before, Entry& after) const
+	{
+		for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++)
+		{
+			uint64_t pushed = pushed_.load(std::memory_order_acquire);
+			if (pushed < 2)
+			{
+				return (pushed == 1 && time < timestampOf(0)) ? TooOld : TooNew;
+			}
+			// The oldest slot is left out: the writer may already be replacing it
+			uint64_t low = pushed > static_cast<uint64_t>(capacity_) ? pushed - capacity_ + 1 : 0;
+			uint64_t high = pushed - 1;
+			int64_t oldest = timestampOf(low);
+			int64_t newest = timestampOf(high);
+			if (oldest == INT64_MIN || newest == INT64_MIN)
+			{
+				continue;
+			}
+			if (time < oldest)
+			{
+				return TooOld;
+			}
+			if (time > newest)
+			{
+				return TooNew;
+			}
+
+			// Invariant: timestamp(low) <= time <= timestamp(high)
+			while (high - low > 1)
+			{
+				uint64_t middle = low + (high - low) / 2;
+				if (timestampOf(middle) <= time)
+				{
+					low = middle;
+				}
+				else
+				{
+					high = middle;
+				}
+			}
+
+			// The search read timestamps without locks, so check that the frames it found are still there
+			if (slots_[low % capacity_].entry.tryRead(before) && slots_[high % capacity_].entry.tryRead(after) &&
+				before.index == low && after.index == high &&
+				before.sample.timestamp <= time && time <= after.sample.timestamp)
+			{
+				if (after.sample.timestamp - before.sample.timestamp > maxGapNs_)
+				{
+					return Gap;
+				}
+				return Ok;
+			}
+		}
+		return Busy;
+	}
+
+	int64_t timestampOf(uint64_t index) const
+	{
+		return slots_[index % capacity_].timestamp.load(std::memory_order_acquire);
+	}
+
+	static double fraction(const PoseSample& before, const PoseSample& after, int64_t time)
+	{
+		int64_t span = after.timestamp - before.timestamp;
+		return span > 0 ? static_cast<double>(time - before.timestamp) / span : 0.0;
+	}
+
+	static void interpolate(const TrackedPose& a, const TrackedPose& b, double f, TrackedPose& pose)
+	{
+		const TrackedPose& nearer = f < 0.5 ? a : b;
+		pose.toolHandle = nearer.toolHandle;
+		pose.status = nearer.status;
+		pose.valid = 1;
+		slerp(a.q, b.q, f, pose.q);
+		for (int i = 0; i < 3; i++)
+		{
+			pose.t[i] = a.t[i] + f * (b.t[i] - a.t[i]);
+		}
+		pose.error = a.error + f * (b.error - a.error);
+	}
+
+	int capacity_;
+	std::unique_ptr<Slot[]> slots_;
+	std::atomic<uint64_t> pushed_;
+	int64_t maxGapNs_;
+
+	//! Scratch entry for push(), kept as a member to keep the frame off the writer's stack
+	Entry entry_;
+};
+
+#endif // POSE_HISTORY_HPP
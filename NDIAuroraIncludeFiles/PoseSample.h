@@ -0,0 +1,75 @@
+#ifndef POSE_SAMPLE_HPP
+#define POSE_SAMPLE_HPP
+
+#include <cstddef>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "AcquisitionClock.h"
+
+/**
+ * @brief The pose of one port handle in a PoseSample.
+ * @details A plain struct (unlike Transform, which is exported from the CAPI library with a vtable)
+ *          so that samples can be copied with memcpy, stored in rings and placed in shared memory.
+ */
+struct TrackedPose
+{
+	//! The handle that uniquely identifies the tool
+	uint16_t toolHandle;
+
+	//! The TransformStatus as a two byte integer
+	uint16_t status;
+
+	//! Nonzero if the pose below holds a measurement
+	uint8_t valid;
+
+	//! The quaternion [q0, qx, qy, qz]
+	double q[4];
+
+	//! The position [mm]
+	double t[3];
+
+	//! The RMS error in the measurement [mm]
+	double error;
+};
+
+/**
+ * @brief All tool poses from one tracker frame, stamped with the shared acquisition clock.
+ */
+struct PoseSample
+{
+	//! The largest number of handles a sample can carry
+	static const int MAX_POSES = 16;
+
+	//! Host time [ns] of the frame: the midpoint of the request/reply transaction, or the time the device clock model assigns to the frame
+	int64_t timestamp;
+
+	//! Host time [ns] the request was written
+	int64_t requestTime;
+
+	//! Host time [ns] the reply was fully read
+	int64_t replyTime;
+
+	//! The device frame number that identifies when the data was collected
+	uint32_t frameNumber;
+
+	//! The number of valid entries in poses
+	int numPoses;
+
+	TrackedPose poses[MAX_POSES];
+
+	//! Returns the pose for the given handle, or NULL if the handle is not in this sample
+	const TrackedPose* find(uint16_t toolHandle) const
+	{
+		for (int i = 0; i < numPoses; i++)
+		{
+			if (poses[i].toolHandle == toolHandle)
+			{
+				return &poses[i];
+			}
+		}
+		return NULL;
+	}
+};
+
+#endif // POSE_SAMPLE_HPP
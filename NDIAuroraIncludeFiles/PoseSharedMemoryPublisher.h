@@ -0,0 +1,176 @@
+#ifndef POSE_SHARED_MEMORY_PUBLISHER_HPP
+#define POSE_SHARED_MEMORY_PUBLISHER_HPP
+
+#include <cstring>
+#include <string>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "AuroraPoseShm.h"
+#include "PoseSample.h"
+
+/**
+ * @brief Converts a sample to the fixed layout shared with other processes.
+ */
+inline void poseSampleToShmFrame(const PoseSample& sample, AuroraShmFrame& frame)
+{
+	frame.timestamp = sample.timestamp;
+	frame.requestTime = sample.requestTime;
+	frame.replyTime = sample.replyTime;
+	frame.frameNumber = sample.frameNumber;
+	frame.numPoses = sample.numPoses < AURORA_SHM_MAX_POSES ? sample.numPoses : AURORA_SHM_MAX_POSES;
+	for (int i = 0; i < frame.numPoses; i++)
+	{
+		const TrackedPose& pose = sample.poses[i];
+		AuroraShmPose& shared = frame.poses[i];
+		shared.toolHandle = pose.toolHandle;
+		shared.status = pose.status;
+		shared.valid = pose.valid;
+		std::memset(shared.reserved, 0, sizeof(shared.reserved));
+		std::memcpy(shared.q, pose.q, sizeof(shared.q));
+		std::memcpy(shared.t, pose.t, sizeof(shared.t));
+		shared.error = pose.error;
+	}
+}
+
+/**
+ * @brief Publishes every acquired frame into a named shared-memory segment for other processes to read.
+ * @details Only one process can open the SCU's port. That process creates the publisher and hands it
+ *          every frame, eg.
+ *              PoseSharedMemoryPublisher publisher;
+ *              publisher.create(AURORA_SHM_DEFAULT_NAME);
+ *              acquisition.setSampleCallback([&](const PoseSample& sample) { publisher.publish(sample); });
+ *          Readers in other processes attach with the C API in AuroraPoseShm.h. Publishing never blocks on
+ *          readers. Only one thread may call publish().
+ */
+class PoseSharedMemoryPublisher
+{
+public:
+	PoseSharedMemoryPublisher()
+		: segment_(NULL), framesWritten_(0)
+#ifdef _WIN32
+		, mapping_(NULL)
+#endif
+	{
+	}
+
+	//! Removes the segment
+	~PoseSharedMemoryPublisher()
+	{
+		close();
+	}
+
+	/**
+	 * @brief Creates (or takes over) the named segment and marks it empty.
+	 * @param name The segment name, eg. AURORA_SHM_DEFAULT_NAME. POSIX names must start with '/'.
+	 * @returns False if the segment could not be created or mapped.
+	 */
+	bool create(const std::string& name)
+	{
+		close();
+		void* address = NULL;
+#ifdef _WIN32
+		mapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(AuroraShmSegment), name.c_str());
+		if (mapping_ == NULL)
+		{
+			return false;
+		}
+		address = MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(AuroraShmSegment));
+		if (address == NULL)
+		{
+			CloseHandle(mapping_);
+			mapping_ = NULL;
+			return false;
+		}
+#else
+		int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+		if (fd < 0)
+		{
+			return false;
+		}
+		if (ftruncate(fd, sizeof(AuroraShmSegment)) != 0)
+		{
+			::close(fd);
+			shm_unlink(name.c_str());
+			return false;
+		}
+		address = mmap(NULL, sizeof(AuroraShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (address == MAP_FAILED)
+		{
+			shm_unlink(name.c_str());
+			return false;
+		}
+#endif
+		name_ = name;
+		segment_ = static_cast<AuroraShmSegment*>(address);
+
+		// Readers check the magic number, so it is written once the rest of the header is valid
+		auroraShmStoreRelease(&segment_->magic, 0);
+		std::memset(segment_, 0, sizeof(AuroraShmSegment));
+		segment_->version = AURORA_SHM_VERSION;
+		segment_->frameSize = sizeof(AuroraShmFrame);
+		segment_->ringSize = AURORA_SHM_RING_SIZE;
+		segment_->writerAlive = 1;
+		framesWritten_ = 0;
+		auroraShmStoreRelease(&segment_->magic, AURORA_SHM_MAGIC);
+		return true;
+	}
+
+	//! Unmaps the segment and removes its name, so readers see that the publisher has gone
+	void close()
+	{
+		if (segment_ == NULL)
+		{
+			return;
+		}
+		auroraShmStoreRelease(&segment_->writerAlive, 0);
+#ifdef _WIN32
+		UnmapViewOfFile(segment_);
+		CloseHandle(mapping_);
+		mapping_ = NULL;
+#else
+		munmap(segment_, sizeof(AuroraShmSegment));
+		shm_unlink(name_.c_str());
+#endif
+		segment_ = NULL;
+	}
+
+	//! Returns true while the segment is open
+	bool isOpen() const { return segment_ != NULL; }
+
+	/**
+	 * @brief Writes a frame into the ring and the latest slot, then makes it visible to readers.
+	 */
+	void publish(const PoseSample& sample)
+	{
+		if (segment_ == NULL)
+		{
+			return;
+		}
+		poseSampleToShmFrame(sample, frame_);
+
+		uint32_t index = framesWritten_;
+		auroraShmSlotWrite(&segment_->ring[index % AURORA_SHM_RING_SIZE], &frame_, index);
+		auroraShmSlotWrite(&segment_->latest, &frame_, index);
+		framesWritten_ = index + 1;
+		auroraShmStoreRelease(&segment_->framesWritten, framesWritten_);
+	}
+
+	//! Returns the number of frames published since create()
+	uint32_t framesWritten() const { return framesWritten_; }
+
+private:
+	std::string name_;
+	AuroraShmSegment* segment_;
+	uint32_t framesWritten_;
+
+	//! Scratch frame, kept as a member so publishing does not put 1.2 kB on the acquisition thread's stack
+	AuroraShmFrame frame_;
+
+#ifdef _WIN32
+	HANDLE mapping_;
+#endif
+};
+
+#endif // POSE_SHARED_MEMORY_PUBLISHER_HPP
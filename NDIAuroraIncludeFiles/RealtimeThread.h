@@ -0,0 +1,194 @@
+#ifndef REALTIME_THREAD_HPP
+#define REALTIME_THREAD_HPP
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+// #include <windows.h> causes naming conflicts with TcpConnection's includes
+#include <winsock2.h>
+#include <malloc.h> // for _alloca()
+#else
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h> // for mlockall()
+#include <unistd.h>   // for sysconf()
+#endif
+
+/**
+ * @brief How a latency-critical thread, eg. an acquisition or I/O thread, is scheduled and kept in memory.
+ * @details Once a thread polls a device every few milliseconds, being preempted by other work and page
+ *          faulting on memory it hasn't touched yet cost more than the transaction itself. The default
+ *          configuration changes nothing; RealtimeConfig::acquisition() is a starting point for a dedicated
+ *          core. A priority and memory locking usually need privileges: CAP_SYS_NICE and CAP_IPC_LOCK (or
+ *          matching rtprio and memlock limits) on Linux. What could not be applied is reported by
+ *          RealtimeStatus rather than treated as an error.
+ */
+struct RealtimeConfig
+{
+	RealtimeConfig() : cpu(-1), priority(0), lockMemory(false), prefaultStackBytes(0) {}
+
+	//! The CPU the thread is pinned to, or -1 to let it run on any CPU
+	int cpu;
+
+	//! The SCHED_FIFO priority on Linux (1-99), or 0 to keep normal scheduling. Any priority selects THREAD_PRIORITY_TIME_CRITICAL on Windows
+	int priority;
+
+	//! Locks every current and future page of the process in RAM (mlockall). On Windows, raises the minimum working set instead
+	bool lockMemory;
+
+	//! The stack the thread touches as it starts, so its first deep calls don't page fault [bytes]
+	size_t prefaultStackBytes;
+
+	//! A configuration for an acquisition thread on its own CPU: SCHED_FIFO 80, locked memory and 256 KiB of stack
+	static RealtimeConfig acquisition(int cpu = -1)
+	{
+		RealtimeConfig config;
+		config.cpu = cpu;
+		config.priority = 80;
+		config.lockMemory = true;
+		config.prefaultStackBytes = 256 * 1024;
+		return config;
+	}
+};
+
+/**
+ * @brief What RealtimeThread::apply() managed to change.
+ */
+struct RealtimeStatus
+{
+	RealtimeStatus() : affinity(false), priority(false), memoryLocked(false) {}
+
+	bool affinity;     //!< The thread was pinned to the CPU
+	bool priority;     //!< The thread got the real-time priority
+	bool memoryLocked; //!< The process memory was locked
+
+	//! Describes the status on one line, given the configuration that was asked for
+	std::string describe(const RealtimeConfig& config) const
+	{
+		char text[160];
+		std::snprintf(text, sizeof(text), "cpu %s, priority %s, memory %s",
+			config.cpu < 0 ? "any" : (affinity ? "pinned" : "not pinned (failed)"),
+			config.priority <= 0 ? "normal" : (priority ? "real-time" : "normal (failed)"),
+			!config.lockMemory ? "pageable" : (memoryLocked ? "locked" : "pageable (failed)"));
+		return text;
+	}
+};
+
+namespace RealtimeThread
+{
+	//! The page size assumed where the system doesn't report one
+	static const size_t DEFAULT_PAGE_SIZE = 4096;
+
+	//! Returns the size of a memory page [bytes]
+	inline size_t pageSize()
+	{
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+#else
+		long size = sysconf(_SC_PAGESIZE);
+		return size > 0 ? static_cast<size_t>(size) : DEFAULT_PAGE_SIZE;
+#endif
+	}
+
+	/**
+	 * @brief Touches every page of a buffer so it is resident before the thread needs it.
+	 * @details Each page is read and written back unchanged. On Windows the pages are also locked with
+	 *          VirtualLock(); on POSIX they stay resident once lockMemory() has run.
+	 */
+	inline void prefault(void* buffer, size_t bytes)
+	{
+		if (buffer == NULL || bytes == 0)
+		{
+			return;
+		}
+		volatile char* bytesToTouch = static_cast<volatile char*>(buffer);
+		size_t step = pageSize();
+		for (size_t offset = 0; offset < bytes; offset += step)
+		{
+			bytesToTouch[offset] = bytesToTouch[offset];
+		}
+		bytesToTouch[bytes - 1] = bytesToTouch[bytes - 1];
+#ifdef _WIN32
+		VirtualLock(buffer, bytes);
+#endif
+	}
+
+	//! Touches the given amount of the calling thread's stack below the current frame
+	inline void prefaultStack(size_t bytes)
+	{
+		if (bytes == 0)
+		{
+			return;
+		}
+#ifdef _WIN32
+		void* stack = _alloca(bytes);
+#else
+		void* stack = alloca(bytes);
+#endif
+		prefault(stack, bytes);
+	}
+
+	/**
+	 * @brief Locks the pages of the process in RAM, including those it maps later.
+	 * @returns False if the process lacks the privilege or the limit is too low.
+	 */
+	inline bool lockMemory()
+	{
+#ifdef _WIN32
+		// Windows has no mlockall(): keep a larger working set resident and VirtualLock() the buffers in prefault()
+		return SetProcessWorkingSetSize(GetCurrentProcess(), 64 * 1024 * 1024, 256 * 1024 * 1024) != 0;
+#else
+		return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+#endif
+	}
+
+	/**
+	 * @brief Pins a thread and raises its priority, and locks the process memory, as configured.
+	 * @details Call with the handle of a thread that was just started, eg. std::thread::native_handle(). The
+	 *          thread itself should call prefaultStack() with config.prefaultStackBytes.
+	 */
+	inline RealtimeStatus apply(std::thread::native_handle_type thread, const RealtimeConfig& config)
+	{
+		RealtimeStatus status;
+#ifdef _WIN32
+		HANDLE handle = static_cast<HANDLE>(thread);
+		if (config.cpu >= 0 && config.cpu < static_cast<int>(sizeof(DWORD_PTR) * 8))
+		{
+			status.affinity = SetThreadAffinityMask(handle, static_cast<DWORD_PTR>(1) << config.cpu) != 0;
+		}
+		if (config.priority > 0)
+		{
+			status.priority = SetThreadPriority(handle, THREAD_PRIORITY_TIME_CRITICAL) != 0;
+		}
+#else
+#ifdef __linux__
+		if (config.cpu >= 0 && config.cpu < CPU_SETSIZE)
+		{
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET(config.cpu, &cpus);
+			status.affinity = pthread_setaffinity_np(thread, sizeof(cpus), &cpus) == 0;
+		}
+#endif
+		if (config.priority > 0)
+		{
+			struct sched_param parameters;
+			parameters.sched_priority = config.priority;
+			status.priority = pthread_setschedparam(thread, SCHED_FIFO, &parameters) == 0;
+		}
+#endif
+		if (config.lockMemory)
+		{
+			status.memoryLocked = lockMemory();
+		}
+		return status;
+	}
+}
+
+#endif // REALTIME_THREAD_HPP
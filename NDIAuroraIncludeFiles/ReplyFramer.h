@@ -0,0 +1,316 @@
+#ifndef REPLY_FRAMER_HPP
+#define REPLY_FRAMER_HPP
+
+#include <cstring>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "Connection.h"
+#include "LowLatencySerialConnection.h"
+
+/**
+ * @brief A reply framed and checked in the framer's buffer. Valid until the framer's next call.
+ */
+struct ReplyView
+{
+	const char* data; //!< The body: without the CRC16 and CR, or without the header and CRC16 if binary. Null terminated
+	int length;       //!< The length of the body
+	bool binary;      //!< True for a binary (eg. BX) reply
+};
+
+/**
+ * @brief Splits the bytes arriving from the SCU into replies with as few reads as possible.
+ * @details Reading a reply one byte at a time until its CR costs a system call per byte. The framer instead
+ *          reads whatever has arrived into one reusable buffer and finds the end of a reply there: memchr
+ *          for the CR of an ASCII reply, or the length in the header of a binary reply (which starts with
+ *          0xA5C4, little endian). The CRC16 is checked in place and the reply is returned as a view into the
+ *          buffer, so a reply takes one or two reads and no copies. Bytes after a reply stay buffered for the
+ *          next one.
+ *          On a LowLatencySerialConnection each read takes everything the port has received. Other
+ *          connections are asked for no more bytes than the reply is known to need, since their read()
+ *          blocks until it has them all: the whole of a binary reply, but only a byte at a time once an
+ *          ASCII reply has run past the shortest possible length.
+ */
+class ReplyFramer
+{
+public:
+	//! The largest reply the buffer holds, including its header or CRC16 and CR
+	static const int CAPACITY = 8192;
+
+	//! The shortest reply: a two character body, its CRC16 and CR
+	static const int MIN_REPLY_LENGTH = 7;
+
+	//! No complete reply arrived
+	static const int ERROR_TIMEOUT = -0x100;
+
+	//! The reply's CRC16 did not match its contents
+	static const int ERROR_CRC = -0x101;
+
+	//! The reply was malformed or too long
+	static const int ERROR_REPLY = -0x103;
+
+	explicit ReplyFramer(Connection& connection)
+		: connection_(connection), begin_(0), end_(0), reads_(0)
+	{
+#ifndef _WIN32
+		serial_ = dynamic_cast<LowLatencySerialConnection*>(&connection);
+#endif
+		buffer_[0] = '\0';
+	}
+
+	/**
+	 * @brief Reads the next reply.
+	 * @param reply Receives a view of the reply, valid until the next call.
+	 * @returns 0, or ERROR_TIMEOUT, ERROR_CRC or ERROR_REPLY. After an error the framer drops what it has
+	 *          buffered, so the next reply starts afresh.
+	 */
+	int next(ReplyView& reply)
+	{
+		reply.data = buffer_;
+		reply.length = 0;
+		reply.binary = false;
+		compact();
+		for (;;)
+		{
+			int needed = 0;
+			int result = frame(reply, needed);
+			if (result != 0 || needed == 0)
+			{
+				if (result != 0)
+				{
+					discard();
+				}
+				return result;
+			}
+			if (!fill(needed))
+			{
+				discard();
+				return ERROR_TIMEOUT;
+			}
+		}
+	}
+
+	//! Drops every buffered byte, eg. after the device was reset
+	void discard()
+	{
+		begin_ = end_ = 0;
+	}
+
+	//! Returns the number of reads made from the connection
+	uint64_t reads() const { return reads_; }
+
+	/**
+	 * @brief Computes the CRC16 the device appends to its replies (polynomial X^16 + X^15 + X^2 + 1, reflected).
+	 */
+	static uint16_t crc16(const char* data, int length)
+	{
+		const uint16_t* table = crcTable();
+		uint16_t crc = 0;
+		for (int i = 0; i < length; i++)
+		{
+			crc = static_cast<uint16_t>((crc >> 8) ^ table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF]);
+		}
+		return crc;
+	}
+
+	//! Parses width hex digits, or returns -1 if one of them is not a hex digit
+	static int parseHex(const char* text, int width)
+	{
+		int value = 0;
+		for (int i = 0; i < width; i++)
+		{
+			char c = text[i];
+			int digit;
+			if (c >= '0' && c <= '9')
+			{
+				digit = c - '0';
+			}
+			else if (c >= 'A' && c <= 'F')
+			{
+				digit = c - 'A' + 10;
+			}
+			else if (c >= 'a' && c <= 'f')
+			{
+				digit = c - 'a' + 10;
+			}
+			else
+			{
+				return -1;
+			}
+			value = (value << 4) | digit;
+		}
+		return value;
+	}
+
+private:
+	/**
+	 * @brief Frames a reply from the buffered bytes.
+	 * @param needed Set to the number of further bytes to read if the reply is not complete yet.
+	 */
+	int frame(ReplyView& reply, int& needed)
+	{
+		const char* start = buffer_ + begin_;
+		int available = end_ - begin_;
+		if (available < 2)
+		{
+			needed = MIN_REPLY_LENGTH - available;
+			return 0;
+		}
+
+		if (static_cast<uint8_t>(start[0]) == (START_SEQUENCE & 0xFF) && static_cast<uint8_t>(start[1]) == (START_SEQUENCE >> 8))
+		{
+			if (available < HEADER_LENGTH)
+			{
+				needed = HEADER_LENGTH + 2 - available;
+				return 0;
+			}
+			if (crc16(start, 4) != readLittleEndian16(start + 4))
+			{
+				return ERROR_CRC;
+			}
+			int length = readLittleEndian16(start + 2);
+			int total = HEADER_LENGTH + length + 2;
+			if (total > CAPACITY)
+			{
+				return ERROR_REPLY;
+			}
+			if (available < total)
+			{
+				needed = total - available;
+				return 0;
+			}
+			char* body = buffer_ + begin_ + HEADER_LENGTH;
+			if (crc16(body, length) != readLittleEndian16(body + length))
+			{
+				return ERROR_CRC;
+			}
+			// The CRC16 has been checked, so its first byte makes room for the terminator
+			body[length] = '\0';
+			begin_ += total;
+			reply.data = body;
+			reply.length = length;
+			reply.binary = true;
+			return 0;
+		}
+
+		const char* cr = static_cast<const char*>(std::memchr(start, CR, available));
+		if (cr == NULL)
+		{
+			if (available >= CAPACITY)
+			{
+				return ERROR_REPLY;
+			}
+			needed = available < MIN_REPLY_LENGTH ? MIN_REPLY_LENGTH - available : 1;
+			return 0;
+		}
+		int length = static_cast<int>(cr - start) - 4;
+		if (length < 0)
+		{
+			return ERROR_REPLY;
+		}
+		char* body = buffer_ + begin_;
+		if (parseHex(body + length, 4) != crc16(body, length))
+		{
+			return ERROR_CRC;
+		}
+		body[length] = '\0';
+		begin_ += length + 5;
+		reply.data = body;
+		reply.length = length;
+		reply.binary = false;
+		return 0;
+	}
+
+	//! Reads at least one more byte, and on a LowLatencySerialConnection everything that has arrived
+	bool fill(int needed)
+	{
+		int room = CAPACITY - end_;
+		if (needed > room)
+		{
+			needed = room;
+		}
+		int result;
+#ifndef _WIN32
+		if (serial_ != NULL)
+		{
+			result = serial_->readAvailable(buffer_ + end_, room);
+		}
+		else
+#endif
+		{
+			result = connection_.read(buffer_ + end_, needed);
+		}
+		reads_++;
+		if (result <= 0)
+		{
+			return false;
+		}
+		end_ += result;
+		return true;
+	}
+
+	//! Moves buffered bytes to the start of the buffer so a whole reply fits after them
+	void compact()
+	{
+		if (begin_ == end_)
+		{
+			begin_ = end_ = 0;
+		}
+		else if (begin_ > 0)
+		{
+			std::memmove(buffer_, buffer_ + begin_, end_ - begin_);
+			end_ -= begin_;
+			begin_ = 0;
+		}
+	}
+
+	static uint16_t readLittleEndian16(const char* data)
+	{
+		return static_cast<uint16_t>(static_cast<uint8_t>(data[0]) | (static_cast<uint8_t>(data[1]) << 8));
+	}
+
+	//! The CRC16 of every byte value, built once on first use
+	struct CrcTable
+	{
+		CrcTable()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				uint16_t value = static_cast<uint16_t>(i);
+				for (int bit = 0; bit < 8; bit++)
+				{
+					value = (value & 1) ? static_cast<uint16_t>((value >> 1) ^ 0xA001) : static_cast<uint16_t>(value >> 1);
+				}
+				values[i] = value;
+			}
+		}
+
+		uint16_t values[256];
+	};
+
+	static const uint16_t* crcTable()
+	{
+		static const CrcTable table;
+		return table.values;
+	}
+
+	//! Terminates every ASCII reply
+	static const char CR = '\r';
+
+	//! Starts a binary reply
+	static const uint16_t START_SEQUENCE = 0xA5C4;
+
+	//! The length of a binary reply's header: start sequence, body length and header CRC16
+	static const int HEADER_LENGTH = 6;
+
+	Connection& connection_;
+#ifndef _WIN32
+	LowLatencySerialConnection* serial_;
+#endif
+	char buffer_[CAPACITY];
+	int begin_;
+	int end_;
+	uint64_t reads_;
+};
+
+#endif // REPLY_FRAMER_HPP
@@ -0,0 +1,72 @@
+#ifndef SEQ_LOCK_HPP
+#define SEQ_LOCK_HPP
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+#include <stdint.h> // for uint8_t etc...
+
+/**
+ * @brief A single-writer latest-value slot that readers copy without locking.
+ * @details The writer makes the sequence odd, copies the value in and makes it even again. A reader copies
+ *          the value and retries if the sequence was odd or changed during the copy, so the writer is
+ *          never blocked by readers. T must be trivially copyable. The layout is standard, so a
+ *          SeqLocked<T> may also be placed in memory shared between processes.
+ */
+template <typename T>
+class SeqLocked
+{
+public:
+	SeqLocked() : sequence_(0)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "SeqLocked values are copied with memcpy");
+		std::memset(&value_, 0, sizeof(value_));
+	}
+
+	//! Publishes a new value. Must only be called from one thread at a time.
+	void write(const T& value)
+	{
+		uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+		sequence_.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(&value_, &value, sizeof(T));
+		sequence_.store(sequence + 2, std::memory_order_release);
+	}
+
+	/**
+	 * @brief Makes one attempt to copy a consistent value.
+	 * @returns False if the writer was active during the copy; value may then hold a torn copy.
+	 */
+	bool tryRead(T& value) const
+	{
+		uint32_t before = sequence_.load(std::memory_order_acquire);
+		if (before & 1)
+		{
+			return false;
+		}
+		std::memcpy(&value, &value_, sizeof(T));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return sequence_.load(std::memory_order_relaxed) == before;
+	}
+
+	//! Copies a consistent value, retrying while the writer is active
+	void read(T& value) const
+	{
+		while (!tryRead(value))
+		{
+		}
+	}
+
+	//! Returns the number of writes so far
+	uint32_t version() const
+	{
+		return sequence_.load(std::memory_order_acquire) / 2;
+	}
+
+private:
+	std::atomic<uint32_t> sequence_;
+	T value_;
+};
+
+#endif // SEQ_LOCK_HPP
@@ -0,0 +1,322 @@
+#ifndef TRACKER_CLIENT_HPP
+#define TRACKER_CLIENT_HPP
+
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "LocalSocket.h"
+#include "TrackerProtocol.h"
+
+/**
+ * @brief Talks to the tracker daemon that owns the SCU.
+ * @details A client either asks for the latest frame whenever it needs one, eg. once per Simulink step:
+ *              TrackerClient tracker;
+ *              tracker.connect(trackerDefaultSocketPath());
+ *              if (tracker.latest(frame) == TrackerResult::Ok) ...
+ *          or subscribes and receives every frame in turn:
+ *              tracker.subscribe(handles);
+ *              while (tracker.readFrame(frame, 100) == TrackerResult::Ok) ...
+ *          Every call blocks for at most the reply timeout. A client is not thread safe.
+ */
+class TrackerClient
+{
+public:
+	//! The most subscribed frames kept while waiting for the reply to another request
+	static const size_t MAX_QUEUED_FRAMES = 64;
+
+	TrackerClient()
+		: socket_(LocalSocket::INVALID_HANDLE), replyTimeoutMs_(100), droppedFrames_(0), frame_(NULL), status_(NULL)
+	{
+	}
+
+	~TrackerClient()
+	{
+		disconnect();
+	}
+
+	/**
+	 * @brief Connects to the daemon.
+	 * @returns False if no daemon is listening at path.
+	 */
+	bool connect(const std::string& path)
+	{
+		disconnect();
+		path_ = path;
+		socket_ = LocalSocket::connect(path);
+		if (socket_ == LocalSocket::INVALID_HANDLE)
+		{
+			return false;
+		}
+		LocalSocket::setNonBlocking(socket_);
+		return true;
+	}
+
+	void disconnect()
+	{
+		LocalSocket::close(socket_);
+		socket_ = LocalSocket::INVALID_HANDLE;
+		reader_ = TrackerMessageReader();
+		frames_.clear();
+	}
+
+	//! Returns true while connected to the daemon
+	bool isConnected() const { return socket_ != LocalSocket::INVALID_HANDLE; }
+
+	//! Connects again to the last daemon, eg. after a request timed out or the daemon restarted
+	bool reconnect() { return connect(path_); }
+
+	//! Sets how long a request waits for its reply [ms]
+	void setReplyTimeout(int milliseconds) { replyTimeoutMs_ = milliseconds; }
+
+	/**
+	 * @brief Asks the daemon to send every new frame.
+	 * @param handles The handles to receive, or an empty list for all of them.
+	 * @returns A TrackerResult.
+	 */
+	int subscribe(const std::vector<uint16_t>& handles = std::vector<uint16_t>())
+	{
+		return request(TrackerMessage::Subscribe, handles.empty() ? NULL : &handles[0],
+			static_cast<uint32_t>(handles.size() * sizeof(uint16_t)));
+	}
+
+	//! Stops the frames started by subscribe(). Returns a TrackerResult
+	int unsubscribe()
+	{
+		int result = request(TrackerMessage::Unsubscribe, NULL, 0);
+		frames_.clear();
+		return result;
+	}
+
+	/**
+	 * @brief Copies the most recent frame.
+	 * @param handles The handles to receive, or an empty list for all of them.
+	 * @returns A TrackerResult.
+	 */
+	int latest(AuroraShmFrame& frame, const std::vector<uint16_t>& handles = std::vector<uint16_t>())
+	{
+		frame_ = &frame;
+		return request(TrackerMessage::Latest, handles.empty() ? NULL : &handles[0],
+			static_cast<uint32_t>(handles.size() * sizeof(uint16_t)));
+	}
+
+	//! Copies the daemon's status. Returns a TrackerResult
+	int status(TrackerStatus& status)
+	{
+		status_ = &status;
+		return request(TrackerMessage::Status, NULL, 0);
+	}
+
+	//! Asks the daemon to start tracking. Returns a TrackerResult
+	int startTracking() { return request(TrackerMessage::StartTracking, NULL, 0); }
+
+	//! Asks the daemon to stop tracking. Returns a TrackerResult
+	int stopTracking() { return request(TrackerMessage::StopTracking, NULL, 0); }
+
+	/**
+	 * @brief Takes the next subscribed frame.
+	 * @param timeoutMs How long to wait if no frame has arrived yet.
+	 * @returns TrackerResult::Ok if a frame was copied, TrackerResult::NoFrame on timeout, or
+	 *          TrackerResult::DeviceError if the connection was lost.
+	 */
+	int readFrame(AuroraShmFrame& frame, int timeoutMs)
+	{
+		if (frames_.empty())
+		{
+			if (!isConnected())
+			{
+				return TrackerResult::DeviceError;
+			}
+			int result = waitFor(0, timeoutMs);
+			if (result != TrackerResult::Ok && frames_.empty())
+			{
+				return result;
+			}
+		}
+		frame = frames_.front();
+		frames_.pop_front();
+		return TrackerResult::Ok;
+	}
+
+	//! Returns the number of subscribed frames discarded because they were not read in time
+	uint64_t droppedFrames() const { return droppedFrames_; }
+
+private:
+	//! Sends a request and waits for its reply
+	int request(uint32_t type, const void* payload, uint32_t length)
+	{
+		if (!isConnected())
+		{
+			return TrackerResult::DeviceError;
+		}
+		std::string message;
+		trackerAppendMessage(message, type, payload, length);
+		if (!sendAll(message))
+		{
+			disconnect();
+			return TrackerResult::DeviceError;
+		}
+		uint32_t reply = TrackerMessage::Result;
+		if (type == TrackerMessage::Latest)
+		{
+			reply = TrackerMessage::LatestFrame;
+		}
+		else if (type == TrackerMessage::Status)
+		{
+			reply = TrackerMessage::StatusReply;
+		}
+		return waitFor(reply, replyTimeoutMs_);
+	}
+
+	bool sendAll(const std::string& message)
+	{
+		size_t sent = 0;
+		std::vector<LocalSocket::Handle> handles(1, socket_);
+		std::vector<uint8_t> wantWrite(1, 1);
+		std::vector<short> ready;
+		while (sent < message.size())
+		{
+			int result = LocalSocket::send(socket_, message.data() + sent, static_cast<int>(message.size() - sent));
+			if (result < 0)
+			{
+				return false;
+			}
+			sent += result;
+			if (result == 0 && LocalSocket::wait(handles, wantWrite, ready, replyTimeoutMs_) <= 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Reads messages until the expected reply arrives, queueing subscribed frames on the way.
+	 * @param reply The expected message type, or 0 to return as soon as a frame has been queued.
+	 */
+	int waitFor(uint32_t reply, int timeoutMs)
+	{
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+		std::vector<LocalSocket::Handle> handles(1, socket_);
+		std::vector<uint8_t> wantWrite(1, 0);
+		std::vector<short> ready;
+		for (;;)
+		{
+			uint32_t type;
+			const char* payload;
+			uint32_t length;
+			int next;
+			while ((next = reader_.next(type, payload, length)) > 0)
+			{
+				int result = TrackerResult::Ok;
+				if (!take(type, payload, length, result))
+				{
+					disconnect();
+					return TrackerResult::DeviceError;
+				}
+				// Requests that return data reply with a Result instead when they fail
+				if (reply == 0 ? type == TrackerMessage::Frame : (type == reply || type == TrackerMessage::Result))
+				{
+					return result;
+				}
+			}
+			if (next < 0)
+			{
+				disconnect();
+				return TrackerResult::DeviceError;
+			}
+
+			int remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+			if (remaining < 0 || LocalSocket::wait(handles, wantWrite, ready, remaining) <= 0)
+			{
+				if (reply == 0)
+				{
+					return TrackerResult::NoFrame;
+				}
+				// The late reply would be taken for the answer to the next request: drop the connection instead
+				disconnect();
+				return TrackerResult::DeviceError;
+			}
+			char buffer[4096];
+			int received;
+			while ((received = LocalSocket::receive(socket_, buffer, sizeof(buffer))) > 0)
+			{
+				reader_.append(buffer, received);
+			}
+			if (received < 0)
+			{
+				disconnect();
+				return TrackerResult::DeviceError;
+			}
+		}
+	}
+
+	//! Stores one message from the daemon. Returns false if it was malformed
+	bool take(uint32_t type, const char* payload, uint32_t length, int& result)
+	{
+		switch (type)
+		{
+		case TrackerMessage::Frame:
+			if (!copyFrame(payload, length, queued_))
+			{
+				return false;
+			}
+			if (frames_.size() >= MAX_QUEUED_FRAMES)
+			{
+				frames_.pop_front();
+				droppedFrames_++;
+			}
+			frames_.push_back(queued_);
+			return true;
+		case TrackerMessage::LatestFrame:
+			return frame_ != NULL && copyFrame(payload, length, *frame_);
+		case TrackerMessage::StatusReply:
+			if (status_ == NULL || length != sizeof(TrackerStatus))
+			{
+				return false;
+			}
+			std::memcpy(status_, payload, length);
+			return true;
+		case TrackerMessage::Result:
+			if (length != sizeof(int32_t))
+			{
+				return false;
+			}
+			int32_t code;
+			std::memcpy(&code, payload, sizeof(code));
+			result = code;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	static bool copyFrame(const char* payload, uint32_t length, AuroraShmFrame& frame)
+	{
+		if (length < offsetof(AuroraShmFrame, poses) || length > sizeof(AuroraShmFrame))
+		{
+			return false;
+		}
+		std::memcpy(&frame, payload, length);
+		return frame.numPoses >= 0 && trackerFrameLength(frame) == length;
+	}
+
+	LocalSocket::Handle socket_;
+	std::string path_;
+	TrackerMessageReader reader_;
+	int replyTimeoutMs_;
+
+	std::deque<AuroraShmFrame> frames_;
+	AuroraShmFrame queued_;
+	uint64_t droppedFrames_;
+
+	//! Where the reply to the request in progress is copied
+	AuroraShmFrame* frame_;
+	TrackerStatus* status_;
+};
+
+#endif // TRACKER_CLIENT_HPP
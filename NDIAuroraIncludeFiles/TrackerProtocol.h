@@ -0,0 +1,198 @@
+#ifndef TRACKER_PROTOCOL_HPP
+#define TRACKER_PROTOCOL_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "AuroraPoseShm.h"
+
+/**
+ * @file TrackerProtocol.h
+ * @brief The messages exchanged between the tracker daemon and its clients over a local socket.
+ * @details Every message is a TrackerMessageHeader followed by length bytes of payload. Both ends run on
+ *          the same host, so payloads are the native structs below rather than an encoded form.
+ *
+ *          Requests (client to daemon)         Payload                      Reply
+ *            Subscribe                         uint16_t handles[], or none  Result, then a Frame for every new frame
+ *            Unsubscribe                       none                         Result
+ *            Latest                            uint16_t handles[], or none  LatestFrame, or Result on failure
+ *            Status                            none                         StatusReply
+ *            StartTracking / StopTracking      none                         Result
+ *
+ *          An empty handle list means every handle. Frames carry only the subscribed handles, so
+ *          AuroraShmFrame::poses is truncated to numPoses entries.
+ */
+
+namespace TrackerMessage
+{
+	enum value
+	{
+		Subscribe = 0x01,
+		Unsubscribe = 0x02,
+		Latest = 0x03,
+		Status = 0x04,
+		StartTracking = 0x05,
+		StopTracking = 0x06,
+
+		Frame = 0x81,       //!< A frame pushed to a subscriber
+		LatestFrame = 0x82, //!< The reply to Latest
+		StatusReply = 0x83,
+		Result = 0x84       //!< An int32_t TrackerResult
+	};
+}
+
+namespace TrackerResult
+{
+	enum value
+	{
+		Ok = 0,
+		NoFrame = -1,     //!< Nothing has been acquired since tracking started
+		NotTracking = -2, //!< Tracking is stopped
+		DeviceError = -3, //!< The SCU rejected the command
+		BadRequest = -4   //!< The request type or payload was not understood
+	};
+}
+
+//! Precedes every message
+struct TrackerMessageHeader
+{
+	uint32_t type;   //!< A TrackerMessage value
+	uint32_t length; //!< The number of payload bytes that follow
+};
+
+//! The payload of StatusReply
+struct TrackerStatus
+{
+	uint32_t tracking;           //!< Nonzero while the daemon is acquiring frames
+	uint32_t clients;            //!< The number of connected clients
+	uint64_t framesAcquired;     //!< The number of new frames since the daemon started
+	uint64_t failedTransactions; //!< The number of tracking requests the SCU did not answer
+	uint32_t lastFrameNumber;    //!< The device frame number of the latest frame
+	uint32_t numHandles;         //!< The number of entries in handles
+	uint16_t handles[AURORA_SHM_MAX_POSES]; //!< The port handles in the latest frame
+};
+
+//! The largest payload either end accepts
+static const uint32_t TRACKER_MAX_PAYLOAD = sizeof(AuroraShmFrame);
+
+//! The socket path used when none is given
+inline std::string trackerDefaultSocketPath()
+{
+#ifdef _WIN32
+	const char* temp = std::getenv("TEMP");
+	return std::string(temp != NULL ? temp : ".") + "\\auroraTracker.sock";
+#else
+	return "/tmp/auroraTracker.sock";
+#endif
+}
+
+//! Returns the number of bytes of a frame that are sent: the header fields and numPoses poses
+inline uint32_t trackerFrameLength(const AuroraShmFrame& frame)
+{
+	return static_cast<uint32_t>(offsetof(AuroraShmFrame, poses) + frame.numPoses * sizeof(AuroraShmPose));
+}
+
+//! Appends a message to an output buffer
+inline void trackerAppendMessage(std::string& buffer, uint32_t type, const void* payload, uint32_t length)
+{
+	TrackerMessageHeader header;
+	header.type = type;
+	header.length = length;
+	buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (length > 0)
+	{
+		buffer.append(static_cast<const char*>(payload), length);
+	}
+}
+
+/**
+ * @brief Copies the poses of the listed handles from one frame to another.
+ * @param handles The handles to keep, or an empty list to keep them all.
+ */
+inline void trackerFilterFrame(const AuroraShmFrame& frame, const std::vector<uint16_t>& handles, AuroraShmFrame& filtered)
+{
+	std::memcpy(&filtered, &frame, offsetof(AuroraShmFrame, poses));
+	if (handles.empty())
+	{
+		std::memcpy(filtered.poses, frame.poses, frame.numPoses * sizeof(AuroraShmPose));
+		return;
+	}
+	filtered.numPoses = 0;
+	for (int i = 0; i < frame.numPoses; i++)
+	{
+		for (size_t j = 0; j < handles.size(); j++)
+		{
+			if (frame.poses[i].toolHandle == handles[j])
+			{
+				filtered.poses[filtered.numPoses++] = frame.poses[i];
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Reassembles messages from the bytes received on a stream socket.
+ */
+class TrackerMessageReader
+{
+public:
+	TrackerMessageReader() : start_(0) {}
+
+	//! Adds received bytes
+	void append(const char* data, size_t length)
+	{
+		buffer_.append(data, length);
+	}
+
+	/**
+	 * @brief Takes the next complete message.
+	 * @param type Receives the message type.
+	 * @param payload Receives a pointer to the payload, valid until the next call.
+	 * @param length Receives the payload length.
+	 * @returns 1 if a message was taken, 0 if more bytes are needed, -1 if the stream is corrupt.
+	 */
+	int next(uint32_t& type, const char*& payload, uint32_t& length)
+	{
+		if (start_ > 0 && start_ == buffer_.size())
+		{
+			buffer_.clear();
+			start_ = 0;
+		}
+		else if (start_ > 4096)
+		{
+			buffer_.erase(0, start_);
+			start_ = 0;
+		}
+		if (buffer_.size() - start_ < sizeof(TrackerMessageHeader))
+		{
+			return 0;
+		}
+		TrackerMessageHeader header;
+		std::memcpy(&header, buffer_.data() + start_, sizeof(header));
+		if (header.length > TRACKER_MAX_PAYLOAD)
+		{
+			return -1;
+		}
+		if (buffer_.size() - start_ < sizeof(header) + header.length)
+		{
+			return 0;
+		}
+		type = header.type;
+		payload = buffer_.data() + start_ + sizeof(header);
+		length = header.length;
+		start_ += sizeof(header) + header.length;
+		return 1;
+	}
+
+private:
+	std::string buffer_;
+	size_t start_;
+};
+
+#endif // TRACKER_PROTOCOL_HPP
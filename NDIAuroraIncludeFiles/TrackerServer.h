@@ -0,0 +1,395 @@
+#ifndef TRACKER_SERVER_HPP
+#define TRACKER_SERVER_HPP
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "AuroraAcquisition.h"
+#include "CombinedApi.h"
+#include "LocalSocket.h"
+#include "PoseSharedMemoryPublisher.h"
+#include "TrackerProtocol.h"
+
+/**
+ * @brief Owns a tracking SCU and serves its frames to any number of clients over a local socket.
+ * @details The server runs an AuroraAcquisition continuously and answers the requests in TrackerProtocol.h.
+ *          Frames reach subscribers from the acquisition thread as soon as they are acquired; a client
+ *          that stops reading loses frames instead of stalling the acquisition. Everything else
+ *          (accepting clients, requests, tracking control) happens on the thread that calls serve().
+ *          Typical use, once the SCU's ports are enabled:
+ *              TrackerServer server(capi);
+ *              server.listen(trackerDefaultSocketPath());
+ *              server.startTracking();
+ *              while (running)
+ *                  server.serve(100);
+ */
+class TrackerServer
+{
+public:
+	//! The most bytes queued for a slow client before its frames are dropped
+	static const size_t MAX_PENDING_BYTES = 64 * 1024;
+
+	/**
+	 * @param capi A connected CombinedApi whose ports are enabled. The server takes over the device:
+	 *             nothing else may use the CombinedApi while tracking.
+	 */
+	explicit TrackerServer(CombinedApi& capi)
+		: capi_(capi), acquisition_(capi), listener_(LocalSocket::INVALID_HANDLE), publisher_(NULL), tracking_(false)
+	{
+		acquisition_.setSampleCallback([this](const PoseSample& sample) { distribute(sample); });
+	}
+
+	//! Stops tracking and disconnects every client
+	~TrackerServer()
+	{
+		stopTracking();
+		close();
+	}
+
+	//! Also publishes every frame through shared memory. Must be called before startTracking()
+	void setPublisher(PoseSharedMemoryPublisher* publisher) { publisher_ = publisher; }
+
+	//! Returns the acquisition, eg. to configure phase locking before startTracking()
+	AuroraAcquisition& acquisition() { return acquisition_; }
+
+	/**
+	 * @brief Starts accepting clients on the socket at path.
+	 * @returns False if the socket could not be created.
+	 */
+	bool listen(const std::string& path)
+	{
+		close();
+		listener_ = LocalSocket::listen(path);
+		if (listener_ == LocalSocket::INVALID_HANDLE)
+		{
+			return false;
+		}
+		LocalSocket::setNonBlocking(listener_);
+		path_ = path;
+		return true;
+	}
+
+	//! Disconnects every client and removes the socket
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(clientsMutex_);
+		for (size_t i = 0; i < clients_.size(); i++)
+		{
+			LocalSocket::close(clients_[i]->socket);
+		}
+		clients_.clear();
+		if (listener_ != LocalSocket::INVALID_HANDLE)
+		{
+			LocalSocket::close(listener_);
+			LocalSocket::unlinkPath(path_);
+			listener_ = LocalSocket::INVALID_HANDLE;
+		}
+	}
+
+	/**
+	 * @brief Puts the SCU in tracking mode and starts acquiring frames.
+	 * @returns The CombinedApi result of TSTART: 0 on success, an error code otherwise.
+	 */
+	int startTracking()
+	{
+		if (tracking_)
+		{
+			return 0;
+		}
+		int result = capi_.startTracking();
+		if (result < 0)
+		{
+			return result;
+		}
+		tracking_ = true;
+		acquisition_.start();
+		return 0;
+	}
+
+	//! Stops acquiring frames and takes the SCU out of tracking mode
+	void stopTracking()
+	{
+		if (!tracking_)
+		{
+			return;
+		}
+		acquisition_.stop();
+		capi_.stopTracking();
+		tracking_ = false;
+	}
+
+	//! Returns true while frames are being acquired
+	bool isTracking() const { return tracking_; }
+
+	//! Returns the number of connected clients
+	size_t numClients() const
+	{
+		std::lock_guard<std::mutex> lock(clientsMutex_);
+		return clients_.size();
+	}
+
+	/**
+	 * @brief Accepts clients, answers their requests and flushes queued frames.
+	 * @param timeoutMs The longest time to wait for socket activity.
+	 */
+	void serve(int timeoutMs)
+	{
+		std::vector<LocalSocket::Handle> handles;
+		std::vector<uint8_t> wantWrite;
+		std::vector<short> ready;
+		{
+			std::lock_guard<std::mutex> lock(clientsMutex_);
+			handles.push_back(listener_);
+			wantWrite.push_back(0);
+			for (size_t i = 0; i < clients_.size(); i++)
+			{
+				handles.push_back(clients_[i]->socket);
+				wantWrite.push_back(clients_[i]->pending.empty() ? 0 : 1);
+			}
+		}
+		if (LocalSocket::wait(handles, wantWrite, ready, timeoutMs) <= 0)
+		{
+			return;
+		}
+
+		// Clients only come and go on this thread, so the indices above are still valid
+		for (size_t i = handles.size() - 1; i > 0; i--)
+		{
+			Client& client = *clients_[i - 1];
+			bool connected = !(ready[i] & (POLLERR | POLLNVAL));
+			if (connected && (ready[i] & (POLLIN | POLLHUP)))
+			{
+				connected = receive(client);
+			}
+			if (connected && (ready[i] & POLLOUT))
+			{
+				std::lock_guard<std::mutex> lock(clientsMutex_);
+				connected = flush(client);
+			}
+			if (!connected)
+			{
+				std::lock_guard<std::mutex> lock(clientsMutex_);
+				LocalSocket::close(client.socket);
+				clients_.erase(clients_.begin() + (i - 1));
+			}
+		}
+		if (ready[0] & POLLIN)
+		{
+			accept();
+		}
+	}
+
+private:
+	//! A connected client
+	struct Client
+	{
+		Client() : socket(LocalSocket::INVALID_HANDLE), subscribed(false), droppedFrames(0) {}
+
+		LocalSocket::Handle socket;
+		TrackerMessageReader reader;
+		bool subscribed;
+		std::vector<uint16_t> handles; //!< The subscribed handles, empty for all
+		std::string pending;           //!< Bytes waiting for room in the socket
+		uint64_t droppedFrames;
+	};
+
+	void accept()
+	{
+		LocalSocket::Handle socket;
+		while ((socket = LocalSocket::accept(listener_)) != LocalSocket::INVALID_HANDLE)
+		{
+			LocalSocket::setNonBlocking(socket);
+			std::unique_ptr<Client> client(new Client());
+			client->socket = socket;
+			std::lock_guard<std::mutex> lock(clientsMutex_);
+			clients_.push_back(std::move(client));
+		}
+	}
+
+	//! Reads and answers a client's requests. Returns false once the client has gone
+	bool receive(Client& client)
+	{
+		char buffer[4096];
+		int received;
+		while ((received = LocalSocket::receive(client.socket, buffer, sizeof(buffer))) > 0)
+		{
+			client.reader.append(buffer, received);
+		}
+		if (received < 0)
+		{
+			return false;
+		}
+
+		uint32_t type;
+		const char* payload;
+		uint32_t length;
+		int result;
+		while ((result = client.reader.next(type, payload, length)) > 0)
+		{
+			if (!answer(client, type, payload, length))
+			{
+				return false;
+			}
+		}
+		return result == 0;
+	}
+
+	//! Answers one request
+	bool answer(Client& client, uint32_t type, const char* payload, uint32_t length)
+	{
+		// Tracking control joins the acquisition thread, so it must not hold the client lock
+		int32_t result = TrackerResult::Ok;
+		if (type == TrackerMessage::StartTracking)
+		{
+			result = startTracking() == 0 ? TrackerResult::Ok : TrackerResult::DeviceError;
+		}
+		else if (type == TrackerMessage::StopTracking)
+		{
+			stopTracking();
+		}
+
+		std::lock_guard<std::mutex> lock(clientsMutex_);
+		switch (type)
+		{
+		case TrackerMessage::Subscribe:
+			client.handles = toHandles(payload, length);
+			client.subscribed = true;
+			break;
+		case TrackerMessage::Unsubscribe:
+			client.subscribed = false;
+			break;
+		case TrackerMessage::Latest:
+			if (!tracking_)
+			{
+				result = TrackerResult::NotTracking;
+			}
+			else if (!acquisition_.latest(latest_))
+			{
+				result = TrackerResult::NoFrame;
+			}
+			else
+			{
+				poseSampleToShmFrame(latest_, frame_);
+				trackerFilterFrame(frame_, toHandles(payload, length), filtered_);
+				trackerAppendMessage(client.pending, TrackerMessage::LatestFrame, &filtered_, trackerFrameLength(filtered_));
+				return flush(client);
+			}
+			break;
+		case TrackerMessage::Status:
+			status(status_);
+			trackerAppendMessage(client.pending, TrackerMessage::StatusReply, &status_, sizeof(status_));
+			return flush(client);
+		case TrackerMessage::StartTracking:
+		case TrackerMessage::StopTracking:
+			break;
+		default:
+			result = TrackerResult::BadRequest;
+		}
+		trackerAppendMessage(client.pending, TrackerMessage::Result, &result, sizeof(result));
+		return flush(client);
+	}
+
+	//! Fills in the daemon status. Called with the client lock held
+	void status(TrackerStatus& status)
+	{
+		std::memset(&status, 0, sizeof(status));
+		status.tracking = tracking_ ? 1 : 0;
+		status.clients = static_cast<uint32_t>(clients_.size());
+		status.framesAcquired = acquisition_.samplesPublished();
+		status.failedTransactions = acquisition_.failedTransactions();
+		if (acquisition_.latest(latest_))
+		{
+			status.lastFrameNumber = latest_.frameNumber;
+			for (int i = 0; i < latest_.numPoses && i < AURORA_SHM_MAX_POSES; i++)
+			{
+				status.handles[status.numHandles++] = latest_.poses[i].toolHandle;
+			}
+		}
+	}
+
+	static std::vector<uint16_t> toHandles(const char* payload, uint32_t length)
+	{
+		std::vector<uint16_t> handles(length / sizeof(uint16_t));
+		if (!handles.empty())
+		{
+			std::memcpy(&handles[0], payload, handles.size() * sizeof(uint16_t));
+		}
+		return handles;
+	}
+
+	//! Sends as much queued data as the socket takes. Called with the client lock held
+	static bool flush(Client& client)
+	{
+		size_t sent = 0;
+		while (sent < client.pending.size())
+		{
+			int result = LocalSocket::send(client.socket, client.pending.data() + sent, static_cast<int>(client.pending.size() - sent));
+			if (result < 0)
+			{
+				return false;
+			}
+			if (result == 0)
+			{
+				break;
+			}
+			sent += result;
+		}
+		client.pending.erase(0, sent);
+		return true;
+	}
+
+	//! Called on the acquisition thread for every new frame
+	void distribute(const PoseSample& sample)
+	{
+		if (publisher_ != NULL)
+		{
+			publisher_->publish(sample);
+		}
+		poseSampleToShmFrame(sample, distributed_);
+
+		std::lock_guard<std::mutex> lock(clientsMutex_);
+		for (size_t i = 0; i < clients_.size(); i++)
+		{
+			Client& client = *clients_[i];
+			if (!client.subscribed)
+			{
+				continue;
+			}
+			if (client.pending.size() > MAX_PENDING_BYTES)
+			{
+				client.droppedFrames++;
+				continue;
+			}
+			trackerFilterFrame(distributed_, client.handles, filteredForClients_);
+			trackerAppendMessage(client.pending, TrackerMessage::Frame, &filteredForClients_, trackerFrameLength(filteredForClients_));
+			// A client that has gone is removed by serve(), which sees the error too
+			flush(client);
+		}
+	}
+
+	CombinedApi& capi_;
+	AuroraAcquisition acquisition_;
+	LocalSocket::Handle listener_;
+	std::string path_;
+	PoseSharedMemoryPublisher* publisher_;
+	bool tracking_;
+
+	mutable std::mutex clientsMutex_;
+	std::vector<std::unique_ptr<Client> > clients_;
+
+	//! Scratch space for the serving thread, kept as members to keep frames off the stack
+	PoseSample latest_;
+	AuroraShmFrame frame_;
+	AuroraShmFrame filtered_;
+	TrackerStatus status_;
+
+	//! Scratch space for the acquisition thread
+	AuroraShmFrame distributed_;
+	AuroraShmFrame filteredForClients_;
+};
+
+#endif // TRACKER_SERVER_HPP
@@ -0,0 +1,289 @@
+#ifndef TRACKER_SUPERVISOR_HPP
+#define TRACKER_SUPERVISOR_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "CombinedApi.h"
+#include "PortHandleInfo.h"
+
+namespace RecoveryLevel
+{
+	//! The most expensive step a recovery needed, from cheapest to dearest
+	enum value { None = 0, Tracking = 1, Handles = 2, Link = 3, Full = 4 };
+}
+
+/**
+ * @brief Notices when a tracking SCU stops answering and brings it back with as little work as possible.
+ * @details The owner of the CombinedApi reports the outcome of every tracking request. Once several in a row
+ *          have failed (no reply, a reply that doesn't parse, or an ERROR reply), the supervisor resynchronises
+ *          the device from the cheapest state that is still valid:
+ *            - a device that answers TX with data only had a transient fault (RecoveryLevel::None),
+ *            - a device that answers but left tracking mode is started again (Tracking),
+ *            - port handles that are no longer initialized or enabled, eg. after a sensor was replugged or the
+ *              SCU reported an error, are initialized and enabled again, and only those (Handles),
+ *            - a device that doesn't answer at all is reconnected, keeping its setup if it survived (Link), or
+ *              on a serial link reset by the function given to setLinkReset(), eg. a SerialLinkReset,
+ *            - a device that lost its setup, eg. after a power cycle, is initialized again (Full).
+ *          recover() runs the recovery on the calling thread, eg. an acquisition thread. A real-time caller
+ *          uses startRecovery() instead, which retries on a thread of its own until the device is back; the
+ *          caller must not use the CombinedApi while isRecovering() is true.
+ */
+class TrackerSupervisor
+{
+public:
+	enum
+	{
+		FAILURES_BEFORE_RECOVERY = 3, //!< The number of failed requests in a row that is taken as a fault
+		RETRY_INTERVAL_MS = 1000      //!< The pause between recovery attempts while the device stays unreachable [ms]
+	};
+
+	/**
+	 * @param capi The CombinedApi of the device.
+	 * @param port The serial port or hostname to reconnect to.
+	 */
+	TrackerSupervisor(CombinedApi& capi, const std::string& port)
+		: capi_(capi), port_(port), replyOptions_(TrackingReplyOption::TransformData), consecutiveFailures_(0),
+		  recovering_(false), cancelled_(false), lastLevel_(RecoveryLevel::None), recoveries_(0), failedAttempts_(0),
+		  lastRecoveryMs_(0)
+	{
+	}
+
+	//! Waits for a recovery in progress to give up
+	~TrackerSupervisor()
+	{
+		cancelled_ = true;
+		if (thread_.joinable())
+		{
+			thread_.join();
+		}
+	}
+
+	//! Sets the TrackingReplyOption flags of the TX that probes the device
+	void setReplyOptions(uint16_t options) { replyOptions_ = options; }
+
+	//! Resets a device that doesn't answer, returning true once it answers INIT
+	typedef std::function<bool()> LinkResetFunction;
+
+	/**
+	 * @brief Sets how a device that doesn't answer is brought back before the CombinedApi reconnects.
+	 * @details CombinedApi::connect() is only used if the reset fails. The reset must leave the CombinedApi's
+	 *          connection usable, as SerialLinkReset does.
+	 */
+	void setLinkReset(const LinkResetFunction& linkReset) { linkReset_ = linkReset; }
+
+	/**
+	 * @brief Records the reply to a TX.
+	 * @returns True if the reply holds tracking data.
+	 */
+	bool reportReply(const std::string& reply)
+	{
+		bool valid = isTrackingReply(reply);
+		report(valid);
+		return valid;
+	}
+
+	//! Records the outcome of a tracking request, eg. whether BX returned any tools
+	void report(bool succeeded)
+	{
+		consecutiveFailures_ = succeeded ? 0 : consecutiveFailures_ + 1;
+	}
+
+	//! Returns true once enough requests have failed in a row to start a recovery
+	bool needsRecovery() const { return consecutiveFailures_ >= FAILURES_BEFORE_RECOVERY; }
+
+	/**
+	 * @brief Resynchronises the device on the calling thread.
+	 * @returns True if the device is tracking again.
+	 */
+	bool recover()
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		RecoveryLevel::value level = RecoveryLevel::None;
+		bool recovered = resynchronise(level);
+		lastRecoveryMs_ = static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+		if (!recovered)
+		{
+			failedAttempts_++;
+			return false;
+		}
+		lastLevel_ = level;
+		recoveries_++;
+		consecutiveFailures_ = 0;
+		return true;
+	}
+
+	/**
+	 * @brief Recovers on a thread of its own, trying every RETRY_INTERVAL_MS until the device is back.
+	 * @returns False if a recovery is already in progress.
+	 */
+	bool startRecovery()
+	{
+		if (recovering_)
+		{
+			return false;
+		}
+		if (thread_.joinable())
+		{
+			thread_.join();
+		}
+		recovering_ = true;
+		thread_ = std::thread(&TrackerSupervisor::retry, this);
+		return true;
+	}
+
+	//! Returns true while startRecovery() is working on the device
+	bool isRecovering() const { return recovering_; }
+
+	//! Returns the most expensive step of the last successful recovery
+	RecoveryLevel::value lastLevel() const { return lastLevel_; }
+
+	//! Returns the number of successful recoveries
+	uint64_t recoveries() const { return recoveries_; }
+
+	//! Returns the number of recovery attempts that failed
+	uint64_t failedAttempts() const { return failedAttempts_; }
+
+	//! Returns the duration of the last recovery attempt [ms]
+	int64_t lastRecoveryMs() const { return lastRecoveryMs_; }
+
+	//! Returns a short name for a recovery level
+	static const char* toString(RecoveryLevel::value level)
+	{
+		switch (level)
+		{
+		case RecoveryLevel::None: return "transient fault";
+		case RecoveryLevel::Tracking: return "restarted tracking";
+		case RecoveryLevel::Handles: return "re-enabled port handles";
+		case RecoveryLevel::Link: return "reconnected";
+		case RecoveryLevel::Full: return "reinitialized";
+		default: return "unknown";
+		}
+	}
+
+	//! Returns true if a TX reply holds tracking data: it starts with the two hex digits of the handle count
+	static bool isTrackingReply(const std::string& reply)
+	{
+		return reply.size() >= 6 && reply.compare(0, 5, "ERROR") != 0 && isHexDigit(reply[0]) && isHexDigit(reply[1]);
+	}
+
+private:
+	//! The body of the recovery thread
+	void retry()
+	{
+		while (!cancelled_ && !recover())
+		{
+			std::chrono::steady_clock::time_point resume = std::chrono::steady_clock::now() + std::chrono::milliseconds(RETRY_INTERVAL_MS);
+			while (!cancelled_ && std::chrono::steady_clock::now() < resume)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+		}
+		recovering_ = false;
+	}
+
+	//! Walks from the cheapest recovery step to the dearest until the device tracks again
+	bool resynchronise(RecoveryLevel::value& level)
+	{
+		// A device that doesn't answer TX at all (not even with an ERROR) needs a new link
+		std::string probe = capi_.getTrackingDataTX(replyOptions_);
+		if (isTrackingReply(probe))
+		{
+			return true;
+		}
+		if (probe.empty() || !startsWithError(probe))
+		{
+			if (!(linkReset_ && linkReset_()) && capi_.connect(port_) != 0)
+			{
+				return false;
+			}
+			level = RecoveryLevel::Link;
+		}
+
+		// Initialize and enable only the port handles that lost their setup
+		std::vector<PortHandleInfo> enabled = capi_.portHandleSearchRequest(PortHandleSearchRequestOption::Enabled);
+		std::vector<PortHandleInfo> notInitialized = capi_.portHandleSearchRequest(PortHandleSearchRequestOption::NotInit);
+		std::vector<PortHandleInfo> notEnabled = capi_.portHandleSearchRequest(PortHandleSearchRequestOption::NotEnabled);
+		if (enabled.empty() && notInitialized.empty() && notEnabled.empty())
+		{
+			// Nothing is set up: the device was reset and needs INIT before it reports any handle
+			if (capi_.initialize() != 0)
+			{
+				return false;
+			}
+			level = RecoveryLevel::Full;
+			notInitialized = capi_.portHandleSearchRequest(PortHandleSearchRequestOption::NotInit);
+		}
+		if (!notInitialized.empty() || !notEnabled.empty())
+		{
+			// PINIT and PENA are only accepted in setup mode
+			capi_.stopTracking();
+			for (size_t i = 0; i < notInitialized.size(); i++)
+			{
+				if (capi_.portHandleInitialize(notInitialized[i].getPortHandle()) != 0)
+				{
+					return false;
+				}
+			}
+			notEnabled = capi_.portHandleSearchRequest(PortHandleSearchRequestOption::NotEnabled);
+			for (size_t i = 0; i < notEnabled.size(); i++)
+			{
+				if (capi_.portHandleEnable(notEnabled[i].getPortHandle(), ToolTrackingPriority::Dynamic) != 0)
+				{
+					return false;
+				}
+			}
+			if (level < RecoveryLevel::Handles)
+			{
+				level = RecoveryLevel::Handles;
+			}
+		}
+
+		// Resume tracking if the device isn't already
+		if (!isTrackingReply(capi_.getTrackingDataTX(replyOptions_)))
+		{
+			if (capi_.startTracking() != 0)
+			{
+				return false;
+			}
+			if (level < RecoveryLevel::Tracking)
+			{
+				level = RecoveryLevel::Tracking;
+			}
+		}
+		return true;
+	}
+
+	static bool startsWithError(const std::string& reply)
+	{
+		return reply.compare(0, 5, "ERROR") == 0;
+	}
+
+	static bool isHexDigit(char c)
+	{
+		return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
+	}
+
+	CombinedApi& capi_;
+	std::string port_;
+	uint16_t replyOptions_;
+	LinkResetFunction linkReset_;
+	std::atomic<int> consecutiveFailures_;
+
+	std::thread thread_;
+	std::atomic<bool> recovering_;
+	std::atomic<bool> cancelled_;
+
+	std::atomic<RecoveryLevel::value> lastLevel_;
+	std::atomic<uint64_t> recoveries_;
+	std::atomic<uint64_t> failedAttempts_;
+	std::atomic<int64_t> lastRecoveryMs_;
+};
+
+#endif // TRACKER_SUPERVISOR_HPP
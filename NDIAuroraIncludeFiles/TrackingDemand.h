@@ -0,0 +1,194 @@
+#ifndef TRACKING_DEMAND_HPP
+#define TRACKING_DEMAND_HPP
+
+#include <string>
+#include <vector>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "CombinedApi.h"
+
+/**
+ * @brief Describes what a consumer of tracking data actually uses, and derives the smallest reply that covers it.
+ * @details CombinedApi asks for TransformData | AllTransforms on TX and BX, and for every section on BX2,
+ *          whatever the caller reads. The reply time grows with every byte at the serial baud rate, so
+ *          asking only for what is consumed leaves room in each 25 ms frame for more tools:
+ *              TrackingDemand demand;
+ *              demand.addTransforms(0x0A);
+ *              capi.getTrackingDataTX(demand.replyOptions());
+ *          A demand without handles wants every handle. Demands from several consumers are combined with
+ *          merge().
+ *          Transforms of tools partly or fully outside the measurement volume are asked for by default, as
+ *          CombinedApi does, since without them such a tool is reported MISSING (see setOutOfVolume()).
+ */
+class TrackingDemand
+{
+public:
+	TrackingDemand()
+		: transforms_(false), markers_(false), strays_(false), sensorData_(false), buttons_(false), outOfVolume_(true)
+	{
+		for (int i = 0; i < HANDLE_WORDS; i++)
+		{
+			handles_[i] = 0;
+		}
+	}
+
+	//! Returns a demand for the 6D transforms of every handle, the usual case
+	static TrackingDemand allTransforms()
+	{
+		TrackingDemand demand;
+		demand.setTransforms(true);
+		return demand;
+	}
+
+	//! Asks for 6D transforms
+	void setTransforms(bool wanted) { transforms_ = wanted; }
+
+	//! Asks for the 6D transform of one handle. Other handles are then only reported if asked for too
+	void addTransforms(uint16_t handle)
+	{
+		transforms_ = true;
+		handles_[(handle & 0xFF) / 32] |= 1u << (handle % 32);
+	}
+
+	//! Asks for the 3D markers of each tool
+	void setMarkers(bool wanted) { markers_ = wanted; }
+
+	//! Asks for stray 3D markers
+	void setStrays(bool wanted) { strays_ = wanted; }
+
+	//! Asks for BX2 sensor data
+	void setSensorData(bool wanted) { sensorData_ = wanted; }
+
+	//! Asks for BX2 button (1D) data
+	void setButtons(bool wanted) { buttons_ = wanted; }
+
+	/**
+	 * @brief Asks for the transforms of tools that are partly or fully out of the measurement volume
+	 *        (TrackingReplyOption::AllTransforms). On by default.
+	 * @details Without it the device reports such a tool as MISSING, so a consumer holding the last pose of a
+	 *          missing tool holds it for as long as the tool is out of the volume too. Only turn it off for a
+	 *          consumer that must not use a pose measured outside the volume.
+	 */
+	void setOutOfVolume(bool wanted) { outOfVolume_ = wanted; }
+
+	//! Adds everything another consumer wants
+	void merge(const TrackingDemand& other)
+	{
+		// A consumer of every handle widens the merged demand to every handle
+		if ((transforms_ && !hasHandles()) || (other.transforms_ && !other.hasHandles()))
+		{
+			for (int i = 0; i < HANDLE_WORDS; i++)
+			{
+				handles_[i] = 0;
+			}
+		}
+		else
+		{
+			for (int i = 0; i < HANDLE_WORDS; i++)
+			{
+				handles_[i] |= other.handles_[i];
+			}
+		}
+		transforms_ = transforms_ || other.transforms_;
+		markers_ = markers_ || other.markers_;
+		strays_ = strays_ || other.strays_;
+		sensorData_ = sensorData_ || other.sensorData_;
+		buttons_ = buttons_ || other.buttons_;
+		outOfVolume_ = outOfVolume_ || other.outOfVolume_;
+	}
+
+	//! Returns true if the transforms of handle are wanted
+	bool wantsHandle(uint16_t handle) const
+	{
+		if (!transforms_)
+		{
+			return false;
+		}
+		return !hasHandles() || (handles_[(handle & 0xFF) / 32] & (1u << (handle % 32))) != 0;
+	}
+
+	//! Returns the handles asked for with addTransforms(), or an empty list for every handle
+	std::vector<uint16_t> handles() const
+	{
+		std::vector<uint16_t> handles;
+		for (int handle = 0; handle < 256; handle++)
+		{
+			if (handles_[handle / 32] & (1u << (handle % 32)))
+			{
+				handles.push_back(static_cast<uint16_t>(handle));
+			}
+		}
+		return handles;
+	}
+
+	//! Returns true if something is wanted at all
+	bool isEmpty() const { return !transforms_ && !markers_ && !strays_ && !sensorData_ && !buttons_; }
+
+	/**
+	 * @brief Returns the TrackingReplyOption flags for TX and BX.
+	 * @details TX and BX always report every enabled handle, so the handles only matter to the consumer. A
+	 *          demand for nothing still asks for TransformData, the smallest reply.
+	 */
+	uint16_t replyOptions() const
+	{
+		uint16_t options = 0;
+		if (transforms_)
+		{
+			options |= TrackingReplyOption::TransformData;
+		}
+		if (markers_)
+		{
+			options |= TrackingReplyOption::ToolAndMarkerData;
+		}
+		if (strays_)
+		{
+			options |= TrackingReplyOption::SingleStray3D | TrackingReplyOption::PassiveStrays;
+		}
+		if (transforms_ && outOfVolume_)
+		{
+			options |= TrackingReplyOption::AllTransforms;
+		}
+		return options == 0 ? static_cast<uint16_t>(TrackingReplyOption::TransformData) : options;
+	}
+
+	/**
+	 * @brief Returns the BX2 options, naming every section so the ones not wanted are left out of the reply.
+	 */
+	std::string bx2Options() const
+	{
+		std::string options = transforms_ ? "--6d=tools" : "--6d=none";
+		// --3d=all adds the strays to the tools' markers
+		options += strays_ ? " --3d=all" : (markers_ ? " --3d=tools" : " --3d=none");
+		options += sensorData_ ? " --sensor=all" : " --sensor=none";
+		options += buttons_ ? " --1d=buttons" : " --1d=none";
+		return options;
+	}
+
+private:
+	enum { HANDLE_WORDS = 256 / 32 };
+
+	bool hasHandles() const
+	{
+		for (int i = 0; i < HANDLE_WORDS; i++)
+		{
+			if (handles_[i] != 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool transforms_;
+	bool markers_;
+	bool strays_;
+	bool sensorData_;
+	bool buttons_;
+	bool outOfVolume_;
+
+	//! A bit per handle asked for with addTransforms()
+	uint32_t handles_[HANDLE_WORDS];
+};
+
+#endif // TRACKING_DEMAND_HPP
@@ -0,0 +1,436 @@
+#ifndef TRANSFORM_BATCH_HPP
+#define TRANSFORM_BATCH_HPP
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <stdint.h> // for uint8_t etc...
+
+#include "Transform.h"
+
+/**
+ * @brief Stores the transforms of N port handles as a structure of arrays.
+ * @details Each Transform field (q0, qx, ... error) is held in its own contiguous array so the conversion
+ *          kernels below are simple loops over doubles that the compiler can vectorise. A frame is usually
+ *          processed as: loadTX() or loadToolData() -> scaleRaw() (TX only) -> maskInvalid() -> renormalize(),
+ *          after which the poses can be copied out as quaternions, rotation matrices or Euler angles.
+ *          Storage is sized once in the constructor; none of the per-frame methods allocate.
+ */
+class TransformBatch
+{
+public:
+	/**
+	 * @brief Creates an empty batch able to hold up to capacity handles.
+	 */
+	explicit TransformBatch(int capacity = 16)
+		: systemStatus(0),
+		  toolHandle(capacity), status(capacity), frameNumber(capacity), valid(capacity),
+		  q0(capacity), qx(capacity), qy(capacity), qz(capacity),
+		  tx(capacity), ty(capacity), tz(capacity), error(capacity),
+		  rawQ0(capacity), rawQx(capacity), rawQy(capacity), rawQz(capacity),
+		  rawTx(capacity), rawTy(capacity), rawTz(capacity), rawError(capacity),
+		  capacity_(capacity), size_(0)
+	{
+	}
+
+	//! Returns the number of handles in the current frame
+	int size() const { return size_; }
+
+	//! Returns the maximum number of handles the batch can hold
+	int capacity() const { return capacity_; }
+
+	//! Returns the index of the given handle in the current frame, or -1 if it is not present
+	int indexOf(uint16_t handle) const
+	{
+		for (int i = 0; i < size_; i++)
+		{
+			if (toolHandle[i] == handle)
+			{
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	/**
+	 * @brief Extracts the fixed-point fields of a TX reply (option 0x0001) into the raw arrays.
+	 * @details Only the digits are decoded here; call scaleRaw() to convert them to mm and unit quaternions.
+	 *          MISSING and DISABLED handles are recorded with valid = 0.
+	 * @param reply The reply returned by CombinedApi::getTrackingDataTX().
+	 * @returns The number of handles read, or -1 if the reply could not be parsed.
+	 */
+	int loadTX(const std::string& reply)
+	{
+		const char* cursor = reply.c_str();
+		const char* end = cursor + reply.size();
+		int numHandles = 0;
+		if (!readHex(cursor, end, 2, numHandles) || numHandles > capacity_)
+		{
+			size_ = 0;
+			return -1;
+		}
+
+		for (int i = 0; i < numHandles; i++)
+		{
+			int handle = 0;
+			if (!readHex(cursor, end, 2, handle))
+			{
+				size_ = 0;
+				return -1;
+			}
+			toolHandle[i] = static_cast<uint16_t>(handle);
+			status[i] = 0;
+			valid[i] = 0;
+
+			if (startsWith(cursor, end, "DISABLED"))
+			{
+				status[i] = TransformStatus::TrackingNotEnabled;
+				cursor += 8;
+			}
+			else
+			{
+				if (startsWith(cursor, end, "MISSING"))
+				{
+					status[i] = 0x0100 | TransformStatus::ToolMissing;
+					cursor += 7;
+				}
+				else
+				{
+					if (!readFixed(cursor, end, 6, rawQ0[i]) || !readFixed(cursor, end, 6, rawQx[i]) ||
+						!readFixed(cursor, end, 6, rawQy[i]) || !readFixed(cursor, end, 6, rawQz[i]) ||
+						!readFixed(cursor, end, 7, rawTx[i]) || !readFixed(cursor, end, 7, rawTy[i]) ||
+						!readFixed(cursor, end, 7, rawTz[i]) || !readFixed(cursor, end, 6, rawError[i]))
+					{
+						size_ = 0;
+						return -1;
+					}
+					valid[i] = 1;
+				}
+
+				// Port status and frame number follow the transform (or MISSING)
+				int portStatus = 0;
+				int frame = 0;
+				readHex(cursor, end, 8, portStatus);
+				readHex(cursor, end, 8, frame);
+				frameNumber[i] = static_cast<uint32_t>(frame);
+			}
+
+			if (!valid[i])
+			{
+				rawQ0[i] = rawQx[i] = rawQy[i] = rawQz[i] = 0;
+				rawTx[i] = rawTy[i] = rawTz[i] = rawError[i] = 0;
+			}
+
+			// Skip the line feed that terminates each handle
+			while (cursor < end && *cursor != '\n')
+			{
+				cursor++;
+			}
+			if (cursor < end)
+			{
+				cursor++;
+			}
+		}
+
+		int systemStatusValue = 0;
+		readHex(cursor, end, 4, systemStatusValue);
+		systemStatus = static_cast<uint16_t>(systemStatusValue);
+		size_ = numHandles;
+		return size_;
+	}
+
+	/**
+	 * @brief Copies the transforms returned by BX or BX2, which are already in floating point.
+	 * @returns The number of handles read. Tools beyond capacity() are dropped.
+	 */
+	template <typename ToolDataList>
+	int loadToolData(const ToolDataList& tools)
+	{
+		size_ = static_cast<int>(tools.size()) < capacity_ ? static_cast<int>(tools.size()) : capacity_;
+		for (int i = 0; i < size_; i++)
+		{
+			const Transform& t = tools[i].transform;
+			toolHandle[i] = t.toolHandle;
+			status[i] = t.status;
+			frameNumber[i] = tools[i].frameNumber;
+			q0[i] = t.q0;
+			qx[i] = t.qx;
+			qy[i] = t.qy;
+			qz[i] = t.qz;
+			tx[i] = t.tx;
+			ty[i] = t.ty;
+			tz[i] = t.tz;
+			error[i] = t.error;
+			valid[i] = 1;
+		}
+		return size_;
+	}
+
+	/**
+	 * @brief Converts the raw TX integers to doubles: quaternions and error have four implied decimals, positions two.
+	 */
+	void scaleRaw()
+	{
+		const int n = size_;
+		const int32_t* rq0 = &rawQ0[0];
+		const int32_t* rqx = &rawQx[0];
+		const int32_t* rqy = &rawQy[0];
+		const int32_t* rqz = &rawQz[0];
+		const int32_t* rtx = &rawTx[0];
+		const int32_t* rty = &rawTy[0];
+		const int32_t* rtz = &rawTz[0];
+		const int32_t* rerr = &rawError[0];
+		double* pq0 = &q0[0];
+		double* pqx = &qx[0];
+		double* pqy = &qy[0];
+		double* pqz = &qz[0];
+		double* ptx = &tx[0];
+		double* pty = &ty[0];
+		double* ptz = &tz[0];
+		double* perr = &error[0];
+		for (int i = 0; i < n; i++)
+		{
+			pq0[i] = rq0[i] * QUATERNION_SCALE;
+			pqx[i] = rqx[i] * QUATERNION_SCALE;
+			pqy[i] = rqy[i] * QUATERNION_SCALE;
+			pqz[i] = rqz[i] * QUATERNION_SCALE;
+		}
+		for (int i = 0; i < n; i++)
+		{
+			ptx[i] = rtx[i] * POSITION_SCALE;
+			pty[i] = rty[i] * POSITION_SCALE;
+			ptz[i] = rtz[i] * POSITION_SCALE;
+			perr[i] = rerr[i] * ERROR_SCALE;
+		}
+	}
+
+	/**
+	 * @brief Clears valid for missing handles and BAD_FLOAT values, then fills their fields with BAD_FLOAT.
+	 * @returns The number of valid handles.
+	 */
+	int maskInvalid()
+	{
+		const int n = size_;
+		uint8_t* pvalid = &valid[0];
+		const uint16_t* pstatus = &status[0];
+		double* fields[8] = { &q0[0], &qx[0], &qy[0], &qz[0], &tx[0], &ty[0], &tz[0], &error[0] };
+		int validCount = 0;
+		for (int i = 0; i < n; i++)
+		{
+			bool ok = pvalid[i] != 0 && (pstatus[i] & 0x0100) == 0 && fields[0][i] > MAX_NEGATIVE && fields[4][i] > MAX_NEGATIVE;
+			pvalid[i] = ok ? 1 : 0;
+			validCount += pvalid[i];
+		}
+		for (int f = 0; f < 8; f++)
+		{
+			double* field = fields[f];
+			for (int i = 0; i < n; i++)
+			{
+				field[i] = pvalid[i] ? field[i] : BAD_FLOAT;
+			}
+		}
+		return validCount;
+	}
+
+	/**
+	 * @brief Rescales the quaternions of valid handles to unit length, removing the rounding of the 4 decimal TX format.
+	 */
+	void renormalize()
+	{
+		const int n = size_;
+		const uint8_t* pvalid = &valid[0];
+		double* pq0 = &q0[0];
+		double* pqx = &qx[0];
+		double* pqy = &qy[0];
+		double* pqz = &qz[0];
+		for (int i = 0; i < n; i++)
+		{
+			double norm2 = pq0[i] * pq0[i] + pqx[i] * pqx[i] + pqy[i] * pqy[i] + pqz[i] * pqz[i];
+			double scale = (pvalid[i] && norm2 > 0.0) ? 1.0 / std::sqrt(norm2) : 1.0;
+			pq0[i] *= scale;
+			pqx[i] *= scale;
+			pqy[i] *= scale;
+			pqz[i] *= scale;
+		}
+	}
+
+	/**
+	 * @brief Writes one 3x3 rotation matrix per handle, column-major as MATLAB expects.
+	 * @param out Destination for 9 * size() doubles; handle i starts at out[9*i].
+	 *            Invalid handles are written as BAD_FLOAT.
+	 */
+	void toRotationMatrices(double* out) const
+	{
+		const int n = size_;
+		for (int i = 0; i < n; i++)
+		{
+			const double w = q0[i], x = qx[i], y = qy[i], z = qz[i];
+			const double fill = valid[i] ? 0.0 : BAD_FLOAT;
+			const double keep = valid[i] ? 1.0 : 0.0;
+			double* r = out + 9 * i;
+			r[0] = keep * (1.0 - 2.0 * (y * y + z * z)) + fill;
+			r[1] = keep * (2.0 * (x * y + w * z)) + fill;
+			r[2] = keep * (2.0 * (x * z - w * y)) + fill;
+			r[3] = keep * (2.0 * (x * y - w * z)) + fill;
+			r[4] = keep * (1.0 - 2.0 * (x * x + z * z)) + fill;
+			r[5] = keep * (2.0 * (y * z + w * x)) + fill;
+			r[6] = keep * (2.0 * (x * z + w * y)) + fill;
+			r[7] = keep * (2.0 * (y * z - w * x)) + fill;
+			r[8] = keep * (1.0 - 2.0 * (x * x + y * y)) + fill;
+		}
+	}
+
+	/**
+	 * @brief Writes Z-Y-X Euler angles [yaw, pitch, roll] in radians for each handle.
+	 * @param out Destination for 3 * size() doubles; handle i starts at out[3*i].
+	 *            Invalid handles are written as BAD_FLOAT.
+	 */
+	void toEulerAngles(double* out) const
+	{
+		const int n = size_;
+		for (int i = 0; i < n; i++)
+		{
+			const double w = q0[i], x = qx[i], y = qy[i], z = qz[i];
+			double sinPitch = 2.0 * (w * y - z * x);
+			sinPitch = sinPitch > 1.0 ? 1.0 : (sinPitch < -1.0 ? -1.0 : sinPitch);
+			double* e = out + 3 * i;
+			if (valid[i])
+			{
+				e[0] = std::atan2(2.0 * (w * z + x * y), 1.0 - 2.0 * (y * y + z * z));
+				e[1] = std::asin(sinPitch);
+				e[2] = std::atan2(2.0 * (w * x + y * z), 1.0 - 2.0 * (x * x + y * y));
+			}
+			else
+			{
+				e[0] = e[1] = e[2] = BAD_FLOAT;
+			}
+		}
+	}
+
+	//! Sets the number of handles in the current frame, for callers that fill the arrays with setPose()
+	void resize(int size)
+	{
+		size_ = size < capacity_ ? size : capacity_;
+	}
+
+	/**
+	 * @brief Stores one handle from the block's 7 element pose [W,Qx,Qy,Qz,X,Y,Z]; the inverse of copyPose().
+	 */
+	void setPose(int index, uint16_t handle, const double* pose, bool isValid)
+	{
+		toolHandle[index] = handle;
+		status[index] = 0;
+		valid[index] = isValid ? 1 : 0;
+		q0[index] = pose[0];
+		qx[index] = pose[1];
+		qy[index] = pose[2];
+		qz[index] = pose[3];
+		tx[index] = pose[4];
+		ty[index] = pose[5];
+		tz[index] = pose[6];
+		error[index] = 0.0;
+	}
+
+	/**
+	 * @brief Copies one handle as the block's 7 element pose [W,Qx,Qy,Qz,X,Y,Z].
+	 */
+	void copyPose(int index, double* out) const
+	{
+		out[0] = q0[index];
+		out[1] = qx[index];
+		out[2] = qy[index];
+		out[3] = qz[index];
+		out[4] = tx[index];
+		out[5] = ty[index];
+		out[6] = tz[index];
+	}
+
+	//! The system status reported at the end of the last TX reply
+	uint16_t systemStatus;
+
+	// Per-handle arrays, valid for indices [0, size())
+	std::vector<uint16_t> toolHandle;
+	std::vector<uint16_t> status;
+	std::vector<uint32_t> frameNumber;
+	std::vector<uint8_t> valid;
+	std::vector<double> q0, qx, qy, qz;
+	std::vector<double> tx, ty, tz;
+	std::vector<double> error;
+
+	// The undecoded TX integers, before scaleRaw()
+	std::vector<int32_t> rawQ0, rawQx, rawQy, rawQz;
+	std::vector<int32_t> rawTx, rawTy, rawTz;
+	std::vector<int32_t> rawError;
+
+private:
+	//! Quaternion components are sent as a sign and 5 digits with 4 implied decimals
+	static constexpr double QUATERNION_SCALE = 1.0e-4;
+
+	//! Positions are sent as a sign and 6 digits with 2 implied decimals [mm]
+	static constexpr double POSITION_SCALE = 1.0e-2;
+
+	//! The RMS error is sent as a sign and 5 digits with 4 implied decimals [mm]
+	static constexpr double ERROR_SCALE = 1.0e-4;
+
+	static bool startsWith(const char* cursor, const char* end, const char* token)
+	{
+		for (; *token != '\0'; token++, cursor++)
+		{
+			if (cursor >= end || *cursor != *token)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static bool readHex(const char*& cursor, const char* end, int width, int& value)
+	{
+		if (end - cursor < width)
+		{
+			return false;
+		}
+		unsigned int result = 0;
+		for (int i = 0; i < width; i++)
+		{
+			char c = cursor[i];
+			unsigned int digit;
+			if (c >= '0' && c <= '9') digit = c - '0';
+			else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+			else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+			else return false;
+			result = (result << 4) | digit;
+		}
+		cursor += width;
+		value = static_cast<int>(result);
+		return true;
+	}
+
+	//! Reads a sign followed by (width - 1) decimal digits
+	static bool readFixed(const char*& cursor, const char* end, int width, int32_t& value)
+	{
+		if (end - cursor < width || (cursor[0] != '+' && cursor[0] != '-'))
+		{
+			return false;
+		}
+		int32_t result = 0;
+		for (int i = 1; i < width; i++)
+		{
+			char c = cursor[i];
+			if (c < '0' || c > '9')
+			{
+				return false;
+			}
+			result = result * 10 + (c - '0');
+		}
+		value = cursor[0] == '-' ? -result : result;
+		cursor += width;
+		return true;
+	}
+
+	int capacity_;
+	int size_;
+};
+
+#endif // TRANSFORM_BATCH_HPP
@@ -1,12 +1,37 @@
 #define S_FUNCTION_NAME  auroraNDIComm
 #define S_FUNCTION_LEVEL 2
+#ifdef _WIN32
 #include <winsock2.h>
+#endif
 #include "simstruc.h"
 #include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <iostream>
+#include <chrono>
 #include "CombinedApi.h"
 #include "PortHandleInfo.h"
 #include "ToolData.h"
+#include "PoseCalibration.h"
+#include "TransformBatch.h"
+#include "TrackerClient.h"
+#include "TrackingDemand.h"
+#include "TrackerSupervisor.h"
+#include "EventLog.h"
+
+//The state the block keeps for each of its four sensors, held in place in the DWork vector. The pose is the one last
+//output: calibrated, and held while the sensor isn't measured
+struct SensorState
+{
+    double pose[7];//[W,Qx,Qy,Qz,X,Y,Z]
+};
+static_assert(sizeof(SensorState)==7*sizeof(real_T),"SensorState must map onto seven doubles of DWork");
+
+static SensorState *sensorStates(SimStruct *S)
+{
+    return (SensorState*)ssGetDWork(S,0);
+}
 
 
 static void mdlInitializeSizes(SimStruct *S)
@@ -14,11 +39,15 @@ static void mdlInitializeSizes(SimStruct *S)
     int numInputs=2;
     int numOutputs=5;
 
-    //Creating a I work vector that will be used to hold the number of sensors attached to the SCU
-    ssSetNumIWork(S,1);
-    ssSetNumPWork(S,1);
+    //The optional block parameters hold the calibration: a file name, or [4x4 registration(:); tip offsets(:)],
+    //then the transport: 'TX', 'BX' or 'BX2' (or 0, 1 or 2)
+    ssSetNumSFcnParams(S,-1);
+
+    //Creating a I work vector that will be used to hold the number of sensors attached to the SCU, the TX reply options and the recoveries reported
+    ssSetNumIWork(S,3);
+    ssSetNumPWork(S,7);
     ssSetNumDWork(S,1);
-    ssSetDWorkWidth(S,0,28);
+    ssSetDWorkWidth(S,0,4*sizeof(SensorState)/sizeof(real_T));
     ssSetDWorkDataType(S,0,SS_DOUBLE);
 
     //Discrete states are used to implement delays between certain API function calls which require time between them
@@ -51,10 +80,12 @@ static void mdlInitializeSizes(SimStruct *S)
 
 static void mdlInitializeSampleTimes(SimStruct *S)
 {
+    UNUSED_ARG(S);
 }
 
 static void mdlSetInputPortSampleTime(SimStruct *S,int_T portIdx,real_T sampleTime,real_T offsetTime)
 {
+    UNUSED_ARG(portIdx);
     int numInputs=2;
     int numOutputs=4;
 
@@ -77,6 +108,7 @@ static void mdlSetInputPortSampleTime(SimStruct *S,int_T portIdx,real_T sampleTi
 
 static void mdlSetOutputPortSampleTime(SimStruct *S,int_T portIdx,real_T sampleTime,real_T offsetTime)
 {
+    UNUSED_ARG(portIdx);
     int numInputs=2;
     int numOutputs=5;
 
@@ -96,23 +128,425 @@ static void mdlSetOutputPortSampleTime(SimStruct *S,int_T portIdx,real_T sampleT
     }
 }
 
+//Diagnostics logged from mdlOutputs and mdlTerminate. The EventLog thread formats and prints them, so a step never waits on the console
+enum AuroraEvent
+{
+    EVENT_CONNECT_FAILED,       //value: error code
+    EVENT_CONNECTED,
+    EVENT_PORTS_ALLOCATED,
+    EVENT_SENSORS_INITIALIZED,
+    EVENT_SENSORS_ENABLED,
+    EVENT_TRACKING_STARTED,
+    EVENT_RESUMED_TRACKING,     //value: number of sensors
+    EVENT_REATTACHED,           //value: number of sensors
+    EVENT_RECOVERED,            //value: RecoveryLevel, detail: duration [ms]
+    EVENT_LOST_SCU,
+    EVENT_COMMAND_FAILED,       //handle: port handle or 0, value: error code
+    EVENT_TRACKING_STOPPED
+};
+
+static int describeEvent(const LogEvent &event,char *text,int capacity)
+{
+    switch(event.code)
+    {
+    case EVENT_CONNECT_FAILED:
+        return snprintf(text,capacity,"[AURORA EM TRACKER]: Connection Failed (%d)! Retrying in 1 s",event.value);
+    case EVENT_CONNECTED:
+        return snprintf(text,capacity,"[AURORA EM TRACKER]: Connected!");
+    case EVENT_PORTS_ALLOCATED:
+        return snprintf(text,capacity,"[AURORA EM TRACKER]: Allocated Sensor Ports on SCU");
+    case EVENT_SENSORS_INITIALIZED:
+        return snprintf(text,capacity,"[AURORA EM TRACKER]: Successfully Initilaized the Sensors");
+    case EVENT_SENSORS_ENABLED:
+        return snprintf(text,capacity,"[AURORA EM TRACKER]: Enabled the sensors");
+    case EVENT_TRACKING_STARTED:
+        return snprintf(text,capacity,"[AURORA EM TRACKER]: Begining Tracking Mode");
+    case EVENT_RESUMED_TRACKING:
+        return snprintf(text,capacity,"[AURORA EM TRACKER]: Resumed tracking with the %d sensors still enabled on the SCU",event.value);
+    case EVENT_REATTACHED:
+        return snprintf(text,capacity,"[AURORA EM TRACKER]: Reattached to the SCU, still tracking %d sensors",event.value);
+    case EVENT_RECOVERED:
+        return snprintf(text,capacity,"[AURORA EM TRACKER]: Recovered the SCU (%s) in %g ms",TrackerSupervisor::toString((RecoveryLevel::value)event.value),event.detail);
+    case EVENT_LOST_SCU:
+        return snprintf(text,capacity,"[AURORA EM TRACKER]: Lost the SCU, recovering in the background");
+    case EVENT_COMMAND_FAILED:
+        //errorToString builds a string, which is fine on the log thread
+        return snprintf(text,capacity,"[AURORA EM TRACKER]: Port handle %02X: %s",event.handle,CombinedApi::errorToString(event.value).c_str());
+    case EVENT_TRACKING_STOPPED:
+        return snprintf(text,capacity,"[AURORA EM TRACKER]: Stopping Tracking");
+    default:
+        return snprintf(text,capacity,"[AURORA EM TRACKER]: Event %u (%d, %g)",event.code,event.value,event.detail);
+    }
+}
+
+//Queues a diagnostic for the EventLog thread without blocking the step
+static void logEvent(SimStruct *S,AuroraEvent code,uint16_t handle=0,int32_t value=0,double detail=0.0)
+{
+    EventLog *log=(EventLog*)ssGetPWorkValue(S,5);
+    if(log!=NULL)
+    {
+        log->log(code,handle,value,detail);
+    }
+}
+
+//Returns the port handle number of a PortHandleInfo, eg. 0x0A for "0A"
+static uint16_t handleNumber(const PortHandleInfo &info)
+{
+    return (uint16_t)strtol(info.getPortHandle().c_str(),NULL,16);
+}
+
+//Returns the position of a handle's record in a TX reply, or npos. Records follow the two digit handle count or a line feed,
+//so the handle is never matched inside another sensor's hexadecimal frame number or port status
+static size_t findHandleRecord(const std::string &currentData,const std::string &handleName)
+{
+    if(currentData.size()>=4&&currentData.compare(2,2,handleName)==0)
+    {
+        return 2;
+    }
+    size_t location=currentData.find("\n"+handleName);
+    return location==std::string::npos?location:location+1;
+}
+
+//Reads which of the four pose outputs are connected. Connections can't change while the model runs, so this is done once in mdlStart
+static void readConnectedOutputs(SimStruct *S,bool connected[4])
+{
+    for(int j=0;j<4;j++)
+    {
+        connected[j]=ssGetOutputPortConnected(S,j)!=0;
+    }
+}
+
+//Returns the transforms the block outputs: sensor j's pose is only needed when its output port is connected
+static TrackingDemand connectedSensorDemand(const bool connected[4])
+{
+    TrackingDemand demand;
+    for(int j=0;j<4;j++)
+    {
+        if(connected[j])
+        {
+            demand.addTransforms(0x0A+j);
+        }
+    }
+    return demand;
+}
+
+//Moves the poses just measured into the calibrated frame. Held poses were already calibrated when stored
+static void calibrateSensors(SimStruct *S,SensorState sensors[4],const bool measured[4],int numSensors)
+{
+    PoseCalibration *calibration=(PoseCalibration*)ssGetPWorkValue(S,1);
+    if(calibration->isIdentity())
+    {
+        return;
+    }
+    TransformBatch *batch=(TransformBatch*)ssGetPWorkValue(S,2);
+    batch->resize(numSensors);
+    for(int i=0;i<batch->size();i++)
+    {
+        batch->setPose(i,0x0A+i,sensors[i].pose,measured[i]);
+    }
+    calibration->apply(*batch);
+    for(int i=0;i<batch->size();i++)
+    {
+        if(measured[i])
+        {
+            batch->copyPose(i,sensors[i].pose);
+        }
+    }
+}
+
+//Updates the four pose outputs from the sensor states
+static void writeSensorOutputs(SimStruct *S,const SensorState sensors[4])
+{
+    for(int j=0;j<4;j++)
+    {
+        memcpy(ssGetOutputPortRealSignal(S,j),sensors[j].pose,sizeof(sensors[j].pose));
+    }
+}
+
+//Decodes the transform at the start of a TX record: q0, qx, qy, qz as a sign and 5 digits [1e-4], then tx, ty, tz as a
+//sign and 6 digits [1e-2 mm]. Returns false, leaving pose alone, if the record is short or malformed
+static bool parseTXPose(const std::string &reply,size_t location,double pose[7])
+{
+    static const int widths[7]={6,6,6,6,7,7,7};
+    static const double scales[7]={1e-4,1e-4,1e-4,1e-4,1e-2,1e-2,1e-2};
+    if(location+45>reply.size())
+    {
+        return false;
+    }
+    const char *field=reply.c_str()+location;
+    double decoded[7];
+    for(int k=0;k<7;k++)
+    {
+        if(field[0]!='+'&&field[0]!='-')
+        {
+            return false;
+        }
+        long value=0;
+        for(int d=1;d<widths[k];d++)
+        {
+            if(field[d]<'0'||field[d]>'9')
+            {
+                return false;
+            }
+            value=value*10+(field[d]-'0');
+        }
+        decoded[k]=(field[0]=='-'?-value:value)*scales[k];
+        field+=widths[k];
+    }
+    memcpy(pose,decoded,sizeof(decoded));
+    return true;
+}
+
+//The reply requested every step. The second block parameter selects BX or BX2, a binary reply, instead of TX
+enum TrackingTransport
+{
+    TRANSPORT_TX,
+    TRANSPORT_BX,
+    TRANSPORT_BX2,
+    NUM_TRANSPORTS
+};
+
+//Poses as the SCU reports them, or moved into the frame given by the calibration parameter
+enum OutputFormat
+{
+    OUTPUT_RAW,
+    OUTPUT_CALIBRATED,
+    NUM_OUTPUT_FORMATS
+};
+
+struct MeasureVariant;
+
+//Measures one frame and updates the pose outputs. Returns false, leaving the outputs alone, if the SCU didn't answer with tracking data
+typedef bool (*MeasureFunction)(SimStruct *S,MeasureVariant &variant,CombinedApi &capi,TrackerSupervisor &supervisor);
+
+//The measuring step of this run: a row of variants is picked by transport and output format in mdlStart,
+//and the variant for the number of sensors once the bring-up (or a reattach) finds them
+struct MeasureVariant
+{
+    const MeasureFunction *forSensorCount;//Variants for 0 to 4 sensors
+    MeasureFunction measure;
+    bool connected[4];//Which pose outputs are connected, resolved once in mdlStart
+    std::string bx2Options;//The BX2 sections the connected outputs need
+    std::vector<uint16_t> trackerHandles;//The handles asked of a tracker daemon, empty for every handle
+    std::chrono::steady_clock::time_point lastNewBX2;//When BX2 last reported new data, or the SCU last answered a BX
+};
+
+//BX2 reports nothing when no tool has new data, and CombinedApi returns nothing on an error too. Once BX2 has reported
+//nothing for longer than this, about four of the SCU's 40 Hz frames, a BX tells an SCU that stopped answering from one
+//with nothing new [ms]
+static const int BX2_QUIET_MS=100;
+
+//Reads the poses of the first NumSensors handles from a TX reply into their states. Sensors that are MISSING,
+//out of the volume or not connected to an output are left as they were
+template <int NumSensors>
+static bool readTX(SimStruct *S,const bool connected[4],CombinedApi &capi,TrackerSupervisor &supervisor,SensorState sensors[4],bool measured[4])
+{
+    static const std::string handleNames[4]={"0A","0B","0C","0D"};
+    std::string currentData=capi.getTrackingDataTX(ssGetIWorkValue(S,1));
+
+    //A timeout, CRC failure or ERROR reply holds the outputs. Several in a row hand the SCU to the supervisor
+    if(!supervisor.reportReply(currentData))
+    {
+        return false;
+    }
+    for(int i=0;i<NumSensors;i++)
+    {
+        //A record holding a pose starts with the sign of q0, one that doesn't reads MISSING
+        size_t location=connected[i]?findHandleRecord(currentData,handleNames[i]):std::string::npos;
+        measured[i]=location!=std::string::npos&&parseTXPose(currentData,location+2,sensors[i].pose);
+    }
+    return true;
+}
+
+//Reads the poses of the first NumSensors handles from a BX or BX2 reply into their states, as readTX does
+template <int NumSensors,TrackingTransport Transport>
+static bool readBX(SimStruct *S,MeasureVariant &variant,CombinedApi &capi,TrackerSupervisor &supervisor,SensorState sensors[4],bool measured[4])
+{
+    const bool *connected=variant.connected;
+    std::vector<ToolData> tools;
+    if(Transport==TRANSPORT_BX2)
+    {
+        //BX2 only reports the tools with new data: the others hold their pose. Nothing new, eg. when the block steps
+        //faster than the SCU measures, holds every output and is not a failure
+        tools=capi.getTrackingDataBX2(variant.bx2Options);
+        std::chrono::steady_clock::time_point now=std::chrono::steady_clock::now();
+        if(tools.empty()&&now-variant.lastNewBX2<std::chrono::milliseconds(BX2_QUIET_MS))
+        {
+            supervisor.report(true);
+            return true;
+        }
+        if(tools.empty())
+        {
+            tools=capi.getTrackingDataBX(ssGetIWorkValue(S,1));
+        }
+        if(!tools.empty())
+        {
+            variant.lastNewBX2=now;
+        }
+    }
+    else
+    {
+        tools=capi.getTrackingDataBX(ssGetIWorkValue(S,1));
+    }
+    supervisor.report(!tools.empty());
+    if(tools.empty())
+    {
+        return false;
+    }
+    for(size_t t=0;t<tools.size();t++)
+    {
+        const Transform &transform=tools[t].transform;
+        int i=transform.toolHandle-0x0A;
+        if(i<0||i>=NumSensors||transform.isMissing()||!connected[i])
+        {
+            continue;
+        }
+        double *pose=sensors[i].pose;
+        pose[0]=transform.q0;
+        pose[1]=transform.qx;
+        pose[2]=transform.qy;
+        pose[3]=transform.qz;
+        pose[4]=transform.tx;
+        pose[5]=transform.ty;
+        pose[6]=transform.tz;
+        measured[i]=true;
+    }
+    return true;
+}
+
+//The measuring step, compiled once per sensor count, transport and output format so that none of them is tested
+//while the block runs and every loop over the sensors has a fixed trip count
+template <int NumSensors,TrackingTransport Transport,OutputFormat Format>
+static bool measureSensors(SimStruct *S,MeasureVariant &variant,CombinedApi &capi,TrackerSupervisor &supervisor)
+{
+    //Measured poses are written over the held ones in place: nothing else is copied
+    SensorState *sensors=sensorStates(S);
+    bool measured[4]={false,false,false,false};
+    bool answered=Transport==TRANSPORT_TX?readTX<NumSensors>(S,variant.connected,capi,supervisor,sensors,measured):
+                                          readBX<NumSensors,Transport>(S,variant,capi,supervisor,sensors,measured);
+    if(!answered)
+    {
+        return false;
+    }
+    if(Format==OUTPUT_CALIBRATED)
+    {
+        calibrateSensors(S,sensors,measured,NumSensors);
+    }
+    writeSensorOutputs(S,sensors);
+    return true;
+}
+
+#define MEASURE_SENSOR_COUNTS(transport,format) \
+    {measureSensors<0,transport,format>,measureSensors<1,transport,format>,measureSensors<2,transport,format>, \
+     measureSensors<3,transport,format>,measureSensors<4,transport,format>}
+
+static const MeasureFunction measureVariants[NUM_TRANSPORTS][NUM_OUTPUT_FORMATS][5]=
+{
+    {MEASURE_SENSOR_COUNTS(TRANSPORT_TX,OUTPUT_RAW),MEASURE_SENSOR_COUNTS(TRANSPORT_TX,OUTPUT_CALIBRATED)},
+    {MEASURE_SENSOR_COUNTS(TRANSPORT_BX,OUTPUT_RAW),MEASURE_SENSOR_COUNTS(TRANSPORT_BX,OUTPUT_CALIBRATED)},
+    {MEASURE_SENSOR_COUNTS(TRANSPORT_BX2,OUTPUT_RAW),MEASURE_SENSOR_COUNTS(TRANSPORT_BX2,OUTPUT_CALIBRATED)}
+};
+
+//Reads the transport block parameter: 'TX', 'BX' or 'BX2' (Normal & Accelerator modes only), or 0, 1 or 2.
+//An empty parameter keeps TX. Returns false if the parameter is none of these
+static bool readTransport(const mxArray *transportParam,TrackingTransport &transport)
+{
+    if(mxGetNumberOfElements(transportParam)==0)
+    {
+        return true;
+    }
+    if(mxIsChar(transportParam))
+    {
+#ifdef MATLAB_MEX_FILE
+        static const char *transportNames[NUM_TRANSPORTS]={"TX","BX","BX2"};
+        char *transportName=mxArrayToString(transportParam);
+        bool found=false;
+        for(int t=0;t<NUM_TRANSPORTS&&!found;t++)
+        {
+            if(strcmp(transportName,transportNames[t])==0)
+            {
+                transport=(TrackingTransport)t;
+                found=true;
+            }
+        }
+        mxFree(transportName);
+        return found;
+#else
+        return false;
+#endif
+    }
+    double value=mxGetPr(transportParam)[0];
+    if(mxGetNumberOfElements(transportParam)!=1||value<0||value>=NUM_TRANSPORTS||value!=(int)value)
+    {
+        return false;
+    }
+    transport=(TrackingTransport)(int)value;
+    return true;
+}
+
+//Records how many sensors the SCU has and picks the measuring step for them. Only the first four have outputs
+static void setSensorCount(SimStruct *S,int numPorts)
+{
+    ssSetIWorkValue(S,0,numPorts);
+    MeasureVariant *variant=(MeasureVariant*)ssGetPWorkValue(S,6);
+    if(variant!=NULL)
+    {
+        variant->measure=variant->forSensorCount[numPorts<0?0:(numPorts>4?4:numPorts)];
+    }
+}
+
+//Resumes an SCU whose sensors are still enabled, eg. by the previous run of the model, instead of initializing it again.
+//Returns false when the full bring-up is needed: nothing is enabled yet or a sensor was plugged in since
+static bool reattach(SimStruct *S,CombinedApi &capi)
+{
+    std::vector<PortHandleInfo> enabledHandles=capi.portHandleSearchRequest(PortHandleSearchRequestOption::Enabled);
+    if(enabledHandles.empty()||!capi.portHandleSearchRequest(PortHandleSearchRequestOption::NotInit).empty())
+    {
+        return false;
+    }
+
+    //TX is only answered with data in tracking mode
+    std::string probe=capi.getTrackingDataTX(ssGetIWorkValue(S,1));
+    if(probe.empty()||probe.compare(0,5,"ERROR")==0)
+    {
+        if(capi.startTracking()!=0)
+        {
+            return false;
+        }
+        logEvent(S,EVENT_RESUMED_TRACKING,0,(int32_t)enabledHandles.size());
+    }
+    else
+    {
+        logEvent(S,EVENT_REATTACHED,0,(int32_t)enabledHandles.size());
+    }
+    setSensorCount(S,(int)enabledHandles.size());
+    return true;
+}
+
 #define MDL_START
 static void mdlStart(SimStruct *S)
 {
     //Going to intialize the value of the IWork vector holding the number of connected sensors
     ssSetIWorkValue(S,0,0);
 
-    //Initilize the DWorkVector holding the previous measurements to values of zero
-    /*DWork[0:6]    ->  [W,Qx,Qy,Qz,X,Y,Z] Sensor One
-     *DWork[7:13]   ->  [W,Qx,Qy,Qz,X,Y,Z] Sensor Two
-     *DWork[14:13]  ->  [W,Qx,Qy,Qz,X,Y,Z] Sensor Three
-     *DWork[21:28]  ->  [W,Qx,Qy,Qz,X,Y,Z] Sensor Four
+    //Only ask the SCU for the transforms the connected outputs use. They include the transforms of sensors partly or fully
+    //out of the volume (AllTransforms), which are output as the SCU reports them; only a MISSING sensor holds its pose
+    /*IWork[1]  ->  TrackingReplyOption flags used for TX
      */
-    real_T *dWorkValues=(real_T*)ssGetDWork(S,0);
-    for(int i=0;i<7;i++)
-    {
-        dWorkValues[i]=0;
-    }
+    bool connected[4];
+    readConnectedOutputs(S,connected);
+    ssSetIWorkValue(S,1,connectedSensorDemand(connected).replyOptions());
+    /*IWork[2]  ->  Number of supervisor recoveries already reported
+     */
+    ssSetIWorkValue(S,2,0);
+
+    //Initilize the sensor states in the DWork vector to zero: a sensor outputs zero until it is first measured
+    /*DWork[0:6]    ->  SensorState of Sensor One   [W,Qx,Qy,Qz,X,Y,Z]
+     *DWork[7:13]   ->  SensorState of Sensor Two
+     *DWork[14:20]  ->  SensorState of Sensor Three
+     *DWork[21:27]  ->  SensorState of Sensor Four
+     */
+    memset(sensorStates(S),0,4*sizeof(SensorState));
 
     //Setting All States to Zero upon program entry
     /*x[0]: Connected
@@ -128,19 +562,156 @@ static void mdlStart(SimStruct *S)
         *x0++=0.0;
     }
 
+    //Load the tool-tip offsets and registration applied to every measurement
+    /*PWork[1]  ->  PoseCalibration
+     *PWork[2]  ->  TransformBatch used as scratch space by the calibration stage
+     */
+    PoseCalibration *calibration=new PoseCalibration(4);
+    ssSetPWorkValue(S,0,NULL);
+    ssSetPWorkValue(S,1,calibration);
+    ssSetPWorkValue(S,2,new TransformBatch(4));
+    ssSetPWorkValue(S,3,NULL);
+    ssSetPWorkValue(S,4,NULL);
+
+    //Status messages are printed by a background thread, not by the step that reports them
+    /*PWork[5]  ->  EventLog
+     */
+    EventLog *log=new EventLog(describeEvent);
+    log->start();
+    ssSetPWorkValue(S,5,log);
+    ssSetPWorkValue(S,6,NULL);
+    if(ssGetSFcnParamsCount(S)>0)
+    {
+        const mxArray *calibrationParam=ssGetSFcnParam(S,0);
+        if(mxIsChar(calibrationParam))
+        {
+#ifdef MATLAB_MEX_FILE
+            char *calibrationFile=mxArrayToString(calibrationParam);
+            int result=calibration->loadFile(calibrationFile);
+            mxFree(calibrationFile);
+            if(result!=0)
+            {
+                ssSetErrorStatus(S,result<0?"Unable to open the calibration file":"Invalid entry in the calibration file, eg. a registration that is not rigid");
+                return;
+            }
+#else
+            ssSetErrorStatus(S,"Calibration files are only supported in simulation, pass the calibration as a numeric vector");
+            return;
+#endif
+        }
+        else if(mxGetNumberOfElements(calibrationParam)>0)
+        {
+            //[4x4 registration matrix (column-major), tip offset sensor one (x,y,z), ... sensor four]
+            int numValues=mxGetNumberOfElements(calibrationParam);
+            const double *values=mxGetPr(calibrationParam);
+            if(numValues<16||(numValues-16)%3!=0||numValues>28)
+            {
+                ssSetErrorStatus(S,"The calibration parameter must hold a 4x4 registration followed by up to four 3 element tip offsets");
+                return;
+            }
+            if(!calibration->setRegistrationColumnMajor4x4(values))
+            {
+                ssSetErrorStatus(S,"The calibration registration must be rigid: a rotation (orthonormal, determinant +1) and a translation");
+                return;
+            }
+            for(int i=0;16+3*i<numValues;i++)
+            {
+                calibration->setToolTipOffset(0x0A+i,values[16+3*i],values[17+3*i],values[18+3*i]);
+            }
+        }
+    }
+
+    //Pick the measuring step for the transport and the calibration now, so mdlOutputs never tests them
+    /*PWork[6]  ->  MeasureVariant
+     */
+    TrackingTransport transport=TRANSPORT_TX;
+    if(ssGetSFcnParamsCount(S)>1&&!readTransport(ssGetSFcnParam(S,1),transport))
+    {
+        ssSetErrorStatus(S,"The transport parameter must be 'TX', 'BX' or 'BX2' (or 0, 1 or 2)");
+        return;
+    }
+    MeasureVariant *variant=new MeasureVariant;
+    variant->forSensorCount=measureVariants[transport][calibration->isIdentity()?OUTPUT_RAW:OUTPUT_CALIBRATED];
+    variant->measure=variant->forSensorCount[0];
+    readConnectedOutputs(S,variant->connected);
+    TrackingDemand demand=connectedSensorDemand(variant->connected);
+    variant->bx2Options=demand.bx2Options();
+    variant->trackerHandles=demand.handles();
+    variant->lastNewBX2=std::chrono::steady_clock::now();
+    ssSetPWorkValue(S,6,variant);
+
+    //When a tracker daemon owns the SCU the block reads the poses from the daemon instead of driving the device
+    /*PWork[3]  ->  TrackerClient, or NULL when the block drives the SCU itself
+     */
+    const char *trackerSocket=getenv("AURORA_TRACKER_SOCKET");
+    if(trackerSocket!=NULL&&trackerSocket[0]!='\0')
+    {
+        TrackerClient *tracker=new TrackerClient();
+        ssSetPWorkValue(S,3,tracker);
+        if(!tracker->connect(trackerSocket))
+        {
+            ssSetErrorStatus(S,"Unable to connect to the tracker daemon named by AURORA_TRACKER_SOCKET");
+            return;
+        }
+        std::cout<<"[AURORA EM TRACKER]: Reading poses from the tracker daemon at "<<trackerSocket<<std::endl;
+    }
+}
+
+//Outputs the latest frame acquired by the tracker daemon
+static void mdlOutputsFromTracker(SimStruct *S,TrackerClient *tracker)
+{
+    double *auroraInitialized = ssGetOutputPortRealSignal(S,4);
+    const uint16_t sensorHandles[4]={0x0A,0x0B,0x0C,0x0D};
+    SensorState *sensors=sensorStates(S);
+    bool measured[4]={false,false,false,false};
+    AuroraShmFrame frame;
+
+    //A daemon that was restarted is picked up again on a later step
+    if(!tracker->isConnected())
+    {
+        tracker->reconnect();
+    }
+    const MeasureVariant *variant=(const MeasureVariant*)ssGetPWorkValue(S,6);
+    int result=tracker->latest(frame,variant->trackerHandles);
+    auroraInitialized[0]=result==TrackerResult::Ok?1:0;
+    if(result==TrackerResult::Ok)
+    {
+        for(int p=0;p<frame.numPoses;p++)
+        {
+            for(int j=0;j<4;j++)
+            {
+                if(frame.poses[p].toolHandle==sensorHandles[j]&&frame.poses[p].valid)
+                {
+                    memcpy(sensors[j].pose,frame.poses[p].q,sizeof(frame.poses[p].q));
+                    memcpy(sensors[j].pose+4,frame.poses[p].t,sizeof(frame.poses[p].t));
+                    measured[j]=true;
+                }
+            }
+        }
+    }
+
+    calibrateSensors(S,sensors,measured,4);
+    writeSensorOutputs(S,sensors);
 }
 
 //#define MDL_INITIALIZE_CONDITIONS
 static void mdlInitializeConditions(SimStruct *S)
 {
-
+    UNUSED_ARG(S);
 }//End of mdlInitlialzeConditions
 
 
 static void mdlOutputs(SimStruct *S, int_T tid)
 {
-    //Get pointer to DWork Vector. This is used to update/Acess previous sensor measurements (Post Formatting)
-    real_T *dWorkValues=(real_T*)ssGetDWork(S,0);
+    UNUSED_ARG(tid);
+
+    //A tracker daemon owns the SCU: skip the bring-up and output the daemon's latest frame
+    TrackerClient *tracker=(TrackerClient*)ssGetPWorkValue(S,3);
+    if(tracker!=NULL)
+    {
+        mdlOutputsFromTracker(S,tracker);
+        return;
+    }
 
     static CombinedApi capi = CombinedApi();//Create the capi class object
     static CombinedApi *capiPtr;//Create capi pointer
@@ -149,16 +720,12 @@ static void mdlOutputs(SimStruct *S, int_T tid)
     real_T *x=ssGetRealDiscStates(S);//Get pointer to state vector
     InputRealPtrsType u0Ptrs=ssGetInputPortRealSignalPtrs(S,0);//Pointer to input
     InputRealPtrsType u1Ptrs=ssGetInputPortRealSignalPtrs(S,1);//Pointer to input
-    double *y0 = ssGetOutputPortRealSignal(S,0);//Pointer to output
-    double *y1 = ssGetOutputPortRealSignal(S,1);//Pointer to output
-    double *y2 = ssGetOutputPortRealSignal(S,2);//Pointer to output
-    double *y3 = ssGetOutputPortRealSignal(S,3);//Pointer to output
     double *auroraInitialized = ssGetOutputPortRealSignal(S,4);//Pointer to output
 
     double time=double(*u0Ptrs[0]);
 
-    //Connects to the SCU
-    if(x[0]==0&&time>3)
+    //Connects to the SCU. After a failed attempt x[4] holds the time of the next one
+    if(x[0]==0&&time>3&&time>=x[4])
     {
         std::string comPort;
         switch(static_cast<int>(*u1Ptrs[0]))
@@ -219,16 +786,34 @@ static void mdlOutputs(SimStruct *S, int_T tid)
         std::string scu_hostname = "";
 
         // Attempt to connect to the device
-        if (capi.connect(hostname) != 0)
+        int connectResult=capi.connect(hostname);
+        if (connectResult != 0)
         {
-		// Print the error and exit if we can't connect to a device
-		std::cout << "[AURORA EM TRACKER]: Connection Failed!" << std::endl;
-		std::cout << "Press Enter to continue...";
-		std::cin.ignore();
+            // Don't hold up the simulation waiting on the user: try again a second later
+            logEvent(S,EVENT_CONNECT_FAILED,0,connectResult);
+            x[4]=time+1;
+            return;
         }
-        std::cout << "[AURORA EM TRACKER]: Connected!" << std::endl;
+        logEvent(S,EVENT_CONNECTED);
         x[0]=1;//Update the connected state to 1
         x[4]=*u0Ptrs[0];//Update the holding time state
+
+        //Brings the SCU back in the background if the link or the device fails while measuring
+        /*PWork[4]  ->  TrackerSupervisor
+         */
+        TrackerSupervisor *supervisor=new TrackerSupervisor(capi,hostname);
+        supervisor->setReplyOptions(ssGetIWorkValue(S,1));
+        ssSetPWorkValue(S,4,supervisor);
+
+        //Skip the bring-up when the SCU is still set up from an earlier run and measure from the next step
+        if(reattach(S,capi))
+        {
+            x[1]=1;
+            x[2]=1;
+            x[3]=1;
+            x[5]=1;
+            auroraInitialized[0]=1;
+        }
     }//End of connecting to SCU
     else if(x[0]==0&&time<3)//This else-if is added to make sure a value is assigned to x[4] before other statements check it in the condition
     {
@@ -239,7 +824,7 @@ static void mdlOutputs(SimStruct *S, int_T tid)
     else if(((time-x[4])>.5)&&x[1]==0&&x[0]==1)
     {
         capi.initialize();//Initialize the device. This step here 'allocates' the ports
-        std::cout<<"[AURORA EM TRACKER]: Allocated Sensor Ports on SCU"<<std::endl;
+        logEvent(S,EVENT_PORTS_ALLOCATED);
         x[1]=1;
         x[4]=*u0Ptrs[0];
     }//End of Initialize SCU
@@ -251,13 +836,17 @@ static void mdlOutputs(SimStruct *S, int_T tid)
     {
         std::vector<PortHandleInfo> handleInfo=capi.portHandleSearchRequest((PortHandleSearchRequestOption::value)00);//This is used to inform us which port has been assigned to the device
         int numPorts = handleInfo.size();
-        ssSetIWorkValue(S,0,numPorts);
+        setSensorCount(S,numPorts);
         //Initialize the ports for all connected sensors
         for (int i = 0; i < numPorts; i++)
         {
-            capi.portHandleInitialize(handleInfo[i].getPortHandle());
+            int result=capi.portHandleInitialize(handleInfo[i].getPortHandle());
+            if(result!=0)
+            {
+                logEvent(S,EVENT_COMMAND_FAILED,handleNumber(handleInfo[i]),result);
+            }
         }
-        std::cout<<"[AURORA EM TRACKER]: Successfully Initilaized the Sensors"<<std::endl;
+        logEvent(S,EVENT_SENSORS_INITIALIZED);
         x[2]=1;
         x[4]=*u0Ptrs[0];
     }//End of Search for and Initialize Sensors
@@ -271,11 +860,15 @@ static void mdlOutputs(SimStruct *S, int_T tid)
         int numPorts=ssGetIWorkValue(S,0);
         for (int i = 0; i < numPorts; i++)
         {
-            capi.portHandleEnable(handleInfo[i].getPortHandle(), ToolTrackingPriority::Dynamic);//Enable the sensor and define the tool to be one that is mobile
+            int result=capi.portHandleEnable(handleInfo[i].getPortHandle(), ToolTrackingPriority::Dynamic);//Enable the sensor and define the tool to be one that is mobile
+            if(result!=0)
+            {
+                logEvent(S,EVENT_COMMAND_FAILED,handleNumber(handleInfo[i]),result);
+            }
         }
-        std::cout<<"[AURORA EM TRACKER]: Enabled the sensors"<<std::endl;
+        logEvent(S,EVENT_SENSORS_ENABLED);
         capi.startTracking();//Begin tracking mode
-        std::cout<<"[AURORA EM TRACKER]: Begining Tracking Mode"<<std::endl;
+        logEvent(S,EVENT_TRACKING_STARTED);
         x[3]=1;
         auroraInitialized[0]=x[3];
         x[4]=*u0Ptrs[0];
@@ -285,79 +878,32 @@ static void mdlOutputs(SimStruct *S, int_T tid)
     //Take Measurements from device
     else if((((time-x[4])>.5)&&x[3]==1)||(x[5]==1))//Test to see if 2 seconds has passed since last change of state OR if the device is already in measuring mode
     {
-        std::string handleNames[4]={"0A","0B","0C","0D"};
-        int numPorts=ssGetIWorkValue(S,0);
-        double sensorReading[7][4] = { 0 };
-        double previousPositions[7][4]={0};
-        std::string currentData = capi.getTrackingDataTX();
-        //Need to add some checks in case on of the sensors goes out of bounds and resultingly the 'currentData' string is not the expected length
-        int sensorReadingBeginingLocation[4];
-        bool sensorInBounds[4];
-        std::string stringsToFormat[4];
-
-        //Begin reading previous measurements
-        for(int j=0;j<4;j++)
-        {
-            for(int i=0;i<7;i++)
-            {
-             previousPositions[i][j]=double(dWorkValues[i+7*j]);
-            }
-        }//End of reading previous measurements
-
-        //Begin determining which sensors have valid measurements within the measurement volume
-        for (int i = 0; i < numPorts; i++)
+        //While the supervisor owns the SCU the outputs hold their last pose and output 5 drops to 0
+        TrackerSupervisor *supervisor=(TrackerSupervisor*)ssGetPWorkValue(S,4);
+        if(supervisor->isRecovering())
         {
-            sensorReadingBeginingLocation[i]=currentData.find(handleNames[i]);
-            if (currentData.substr(sensorReadingBeginingLocation[i] + 2, 7) == "MISSING")
-            {
-                sensorInBounds[i] = FALSE;
-            }
-            else if((currentData.substr(sensorReadingBeginingLocation[i] + 2, 1)=="+")||(currentData.substr(sensorReadingBeginingLocation[i] + 2, 1)=="-"))
-            {
-                sensorInBounds[i] = TRUE;
-            }
-            else
-            {
-                sensorInBounds[i]=FALSE;
-            }
-
-            if (sensorInBounds[i] == TRUE)
-            {
-                stringsToFormat[i] = currentData.substr(sensorReadingBeginingLocation[i] + 2, 45);
-            }
-            else
-            {
-                stringsToFormat[i] = "SENSOROUTOFBOUNDS";
-            }
-        }//Finish determining if sensors are within measurements volume
-
-        //Begin formatting measurement data
-        for(int i=0;i<numPorts;i++)
-        {
-            capi.returnTrackingDataFormated(stringsToFormat[i], sensorReading, 7,i,previousPositions);
-        }//Finished formatting measurement data
-
-        //Update all S-Function Outputs
-        for(int i=0;i<7;i++)
+            auroraInitialized[0]=0;
+            return;
+        }
+        if(supervisor->recoveries()>(uint64_t)ssGetIWorkValue(S,2))
         {
-           y0[i]=sensorReading[i][0];
-           y1[i]=sensorReading[i][1];
-           y2[i]=sensorReading[i][2];
-           y3[i]=sensorReading[i][3];
+            ssSetIWorkValue(S,2,(int)supervisor->recoveries());
+            logEvent(S,EVENT_RECOVERED,0,supervisor->lastLevel(),supervisor->lastRecoveryMs());
         }
-        dWorkValues[4]=sensorReading[4][0];
-        dWorkValues[5]=sensorReading[5][0];
-        dWorkValues[6]=sensorReading[6][0];
 
-        //Place current,formatted, measurements in the DWork vector
-        for(int j=0;j<4;j++)
+        //Request a frame and update the outputs with the step picked for this SCU
+        MeasureVariant *variant=(MeasureVariant*)ssGetPWorkValue(S,6);
+        if(!variant->measure(S,*variant,capi,*supervisor))
         {
-            for(int i=0;i<7;i++)
+            auroraInitialized[0]=0;
+            if(supervisor->needsRecovery())
             {
-//                 std::cout<<i<<" "<<j<<" "<<i+7*j<<sensorReading[i][j]<<std::endl;
-             dWorkValues[i+7*j]=sensorReading[i][j];
+                logEvent(S,EVENT_LOST_SCU);
+                supervisor->startRecovery();
             }
+            return;
         }
+        auroraInitialized[0]=1;
 
         x[5]=1;//Measurement state is either changed to one or remains one
     }//End of aquiring measurements from device
@@ -366,12 +912,26 @@ static void mdlOutputs(SimStruct *S, int_T tid)
 
 static void mdlTerminate(SimStruct *S)
 {
-//     static CombinedApi capi = CombinedApi();
-//     capi.stopTracking();
-//     static CombinedApi *capiPtr;//Create capi pointer
-    void *capiPtr=ssGetPWorkValue(S,0);
-//     capiPtr->stopTracking();
-    std::cout<<"[AURORA EM TRACKER]: Stopping Tracking"<<std::endl;
+    //Wait for a recovery in progress to give up before using the SCU
+    delete (TrackerSupervisor*)ssGetPWorkValue(S,4);
+
+    //Leave the sensors enabled so the next run can reattach, but switch the field generator off
+    CombinedApi *capiPtr=(CombinedApi*)ssGetPWorkValue(S,0);
+    real_T *x=ssGetRealDiscStates(S);
+    if(capiPtr!=NULL&&x!=NULL&&x[3]==1)
+    {
+        capiPtr->stopTracking();
+        logEvent(S,EVENT_TRACKING_STOPPED);
+    }
+    delete (PoseCalibration*)ssGetPWorkValue(S,1);
+    delete (TransformBatch*)ssGetPWorkValue(S,2);
+    delete (TrackerClient*)ssGetPWorkValue(S,3);
+    delete (MeasureVariant*)ssGetPWorkValue(S,6);
+
+    //Prints whatever is still queued before the block goes away
+    EventLog *log=(EventLog*)ssGetPWorkValue(S,5);
+    ssSetPWorkValue(S,5,NULL);
+    delete log;
 }
 
 
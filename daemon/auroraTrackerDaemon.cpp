@@ -0,0 +1,265 @@
+/**
+ * Owns the Aurora SCU and serves its poses to any number of local clients, so several programs (Simulink
+ * models, loggers, visualizers) can share one tracker without reopening the serial port or repeating the
+ * bring-up. The daemon brings the SCU up once, tracks continuously, and answers the requests described in
+ * TrackerProtocol.h on a local socket. With --shm it also publishes every frame through shared memory
+ * (AuroraPoseShm.h). The auroraNDIComm block becomes a client when AURORA_TRACKER_SOCKET is set.
+ *
+ * Build on Windows (Developer Command Prompt) from the repository root:
+ *     cl /EHsc /O2 /INDIAuroraIncludeFiles daemon\auroraTrackerDaemon.cpp auroraLibrary.lib ws2_32.lib
+ *     auroraTrackerDaemon --port COM6
+ * Or against the emulated SCU of the harness, on Linux:
+ *     g++ -std=c++11 -O2 -Iharness -INDIAuroraIncludeFiles daemon/auroraTrackerDaemon.cpp harness/EmulatedCombinedApi.cpp -pthread -lrt -o auroraTrackerDaemon
+ */
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "CombinedApi.h"
+#include "LatencyHistogram.h"
+#include "LinkReset.h"
+#include "LowLatencySerialConnection.h"
+#include "PortHandleInfo.h"
+#include "PoseSharedMemoryPublisher.h"
+#include "RealtimeThread.h"
+#include "TrackerServer.h"
+#include "TrackerSupervisor.h"
+#include "TrackingDemand.h"
+
+struct DaemonOptions
+{
+	DaemonOptions() : port("COM6"), socketPath(trackerDefaultSocketPath()), phaseLocking(true), demand(TrackingDemand::allTransforms()), latencyHistogram(false) {}
+
+	std::string port;
+	std::string socketPath;
+	std::string shmName;
+	bool phaseLocking;
+	TrackingDemand demand;
+	RealtimeConfig realtime;
+	bool latencyHistogram;
+};
+
+static std::atomic<bool> running(true);
+
+static void requestShutdown(int)
+{
+	running = false;
+}
+
+static void printUsage(const char* program)
+{
+	std::printf("usage: %s [options]\n", program);
+	std::printf("  --port <name>       Serial port or hostname of the SCU (default COM6)\n");
+	std::printf("  --socket <path>     Socket clients connect to (default %s)\n", trackerDefaultSocketPath().c_str());
+	std::printf("  --shm [name]        Also publish every frame through shared memory (default name %s)\n", AURORA_SHM_DEFAULT_NAME);
+	std::printf("  --no-phase-lock     Poll back to back instead of timing requests to the SCU's frame clock\n");
+	std::printf("  --handles <list>    Only request and serve these port handles, eg. 0A,0B (default all)\n");
+	std::printf("  --cpu <n>           Pin the acquisition thread to CPU n\n");
+	std::printf("  --rt-priority <n>   Run the acquisition thread at SCHED_FIFO priority n, 1-99 (TIME_CRITICAL on Windows)\n");
+	std::printf("  --lock-memory       Lock the daemon's memory in RAM and prefault the acquisition stack and buffers\n");
+	std::printf("  --latency-histogram Print every bucket of the acquisition wake-up latency at exit\n");
+}
+
+//! Parses a comma separated list of hex port handles into a demand for their transforms
+static bool parseHandles(const std::string& list, TrackingDemand& demand)
+{
+	demand = TrackingDemand();
+	size_t start = 0;
+	while (start <= list.size())
+	{
+		size_t end = list.find(',', start);
+		if (end == std::string::npos)
+		{
+			end = list.size();
+		}
+		char* last = NULL;
+		std::string handle = list.substr(start, end - start);
+		unsigned long value = std::strtoul(handle.c_str(), &last, 16);
+		if (handle.empty() || *last != '\0' || value == 0 || value > 0xFF)
+		{
+			return false;
+		}
+		demand.addTransforms(static_cast<uint16_t>(value));
+		start = end + 1;
+	}
+	return true;
+}
+
+static bool parseArguments(int argc, char** argv, DaemonOptions& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc && argv[i + 1][0] != '-';
+		if (arg == "--port" && hasValue)
+		{
+			options.port = argv[++i];
+		}
+		else if (arg == "--socket" && hasValue)
+		{
+			options.socketPath = argv[++i];
+		}
+		else if (arg == "--shm")
+		{
+			// POSIX segment names start with '/', so only a following option ends the list
+			options.shmName = (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0) ? argv[++i] : AURORA_SHM_DEFAULT_NAME;
+		}
+		else if (arg == "--no-phase-lock")
+		{
+			options.phaseLocking = false;
+		}
+		else if (arg == "--handles" && hasValue)
+		{
+			if (!parseHandles(argv[++i], options.demand))
+			{
+				return false;
+			}
+		}
+		else if (arg == "--cpu" && hasValue)
+		{
+			options.realtime.cpu = std::atoi(argv[++i]);
+		}
+		else if (arg == "--rt-priority" && hasValue)
+		{
+			options.realtime.priority = std::atoi(argv[++i]);
+		}
+		else if (arg == "--lock-memory")
+		{
+			options.realtime.lockMemory = true;
+			options.realtime.prefaultStackBytes = RealtimeConfig::acquisition().prefaultStackBytes;
+		}
+		else if (arg == "--latency-histogram")
+		{
+			options.latencyHistogram = true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//! Connects to the SCU, then initializes and enables every sensor, as the block does during its bring-up
+static bool bringUp(CombinedApi& capi, const std::string& port)
+{
+	if (capi.connect(port) != 0)
+	{
+		std::printf("[AURORA TRACKER DAEMON]: Connection to %s failed\n", port.c_str());
+		return false;
+	}
+	int result = capi.initialize();
+	if (result < 0)
+	{
+		std::printf("[AURORA TRACKER DAEMON]: INIT failed: %s\n", CombinedApi::errorToString(result).c_str());
+		return false;
+	}
+
+	std::vector<PortHandleInfo> handleInfo = capi.portHandleSearchRequest(PortHandleSearchRequestOption::NotInit);
+	for (size_t i = 0; i < handleInfo.size(); i++)
+	{
+		capi.portHandleInitialize(handleInfo[i].getPortHandle());
+	}
+	handleInfo = capi.portHandleSearchRequest(PortHandleSearchRequestOption::NotEnabled);
+	for (size_t i = 0; i < handleInfo.size(); i++)
+	{
+		capi.portHandleEnable(handleInfo[i].getPortHandle(), ToolTrackingPriority::Dynamic);
+	}
+	handleInfo = capi.portHandleSearchRequest(PortHandleSearchRequestOption::Enabled);
+	std::printf("[AURORA TRACKER DAEMON]: Connected to %s with %d enabled sensors\n", port.c_str(), static_cast<int>(handleInfo.size()));
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	DaemonOptions options;
+	if (!parseArguments(argc, argv, options))
+	{
+		printUsage(argv[0]);
+		return 2;
+	}
+	std::signal(SIGINT, requestShutdown);
+	std::signal(SIGTERM, requestShutdown);
+
+	CombinedApi capi;
+	if (!bringUp(capi, options.port))
+	{
+		return 1;
+	}
+
+#ifndef _WIN32
+	// A serial SCU that stops answering is reset with RESET before the CombinedApi falls back to its 250 ms break
+	LowLatencySerialConnection resetPort;
+	SerialLinkReset<LowLatencySerialConnection> linkReset(resetPort, options.port);
+	bool serialPort = options.port.compare(0, 5, "/dev/") == 0;
+#endif
+
+	// The acquisition thread brings the SCU back itself if the link or the device fails
+	TrackerSupervisor supervisor(capi, options.port);
+	supervisor.setReplyOptions(options.demand.replyOptions());
+#ifndef _WIN32
+	if (serialPort)
+	{
+		supervisor.setLinkReset([&]() { return linkReset.reset(); });
+	}
+#endif
+
+	TrackerServer server(capi);
+	server.acquisition().setPhaseLocking(options.phaseLocking);
+	server.acquisition().setDemand(options.demand);
+	server.acquisition().setSupervisor(&supervisor);
+	server.acquisition().setRealtimeConfig(options.realtime);
+	if (!server.listen(options.socketPath))
+	{
+		std::printf("[AURORA TRACKER DAEMON]: Unable to listen on %s\n", options.socketPath.c_str());
+		return 1;
+	}
+	PoseSharedMemoryPublisher publisher;
+	if (!options.shmName.empty())
+	{
+		if (!publisher.create(options.shmName))
+		{
+			std::printf("[AURORA TRACKER DAEMON]: Unable to create the shared memory segment %s\n", options.shmName.c_str());
+			return 1;
+		}
+		server.setPublisher(&publisher);
+	}
+
+	int result = server.startTracking();
+	if (result != 0)
+	{
+		std::printf("[AURORA TRACKER DAEMON]: TSTART failed: %s\n", CombinedApi::errorToString(result).c_str());
+		return 1;
+	}
+	std::printf("[AURORA TRACKER DAEMON]: Tracking, serving clients on %s\n", options.socketPath.c_str());
+	std::printf("[AURORA TRACKER DAEMON]: Acquisition thread: %s\n",
+		server.acquisition().realtimeStatus().describe(options.realtime).c_str());
+
+	while (running)
+	{
+		server.serve(100);
+	}
+
+	server.stopTracking();
+	server.close();
+	std::printf("[AURORA TRACKER DAEMON]: Stopped after %llu frames and %llu recoveries\n",
+		static_cast<unsigned long long>(server.acquisition().samplesPublished()),
+		static_cast<unsigned long long>(supervisor.recoveries()));
+#ifndef _WIN32
+	if (serialPort)
+	{
+		std::printf("[AURORA TRACKER DAEMON]: Link resets: %s\n", linkReset.linkReset().timingReport().c_str());
+	}
+#endif
+	const LatencyHistogram& wakeup = server.acquisition().wakeupLatency();
+	std::printf("[AURORA TRACKER DAEMON]: %s\n", wakeup.summary("Wake-up latency").c_str());
+	if (options.latencyHistogram)
+	{
+		std::printf("%s", wakeup.histogram().c_str());
+	}
+	return 0;
+}
@@ -0,0 +1,440 @@
+/**
+ * Stand-in for the parts of auroraLibrary.dll the S-function, the acquisition classes and the component tests
+ * link against.
+ * Every command is answered by EmulatedDevice, so the block logic can be run and timed without an SCU.
+ */
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#include "BufferedReader.h"
+#include "CombinedApi.h"
+#include "GbfContainer.h"
+#include "GbfData6D.h"
+#include "GbfFrame.h"
+#include "PortHandleInfo.h"
+#include "ToolData.h"
+#include "TransformBatch.h"
+
+#include "EmulatedDevice.h"
+
+//! What the stand-in returns for a command the device didn't answer
+static const int ERROR_TIMEOUT = -0x100;
+
+/*
+ * Data classes
+ */
+Transform::Transform()
+	: toolHandle(0), status(0), q0(BAD_FLOAT), qx(BAD_FLOAT), qy(BAD_FLOAT), qz(BAD_FLOAT),
+	  tx(BAD_FLOAT), ty(BAD_FLOAT), tz(BAD_FLOAT), error(BAD_FLOAT)
+{
+}
+
+uint8_t Transform::getFaceNumber() const { return static_cast<uint8_t>((status & 0xE000) >> 13); }
+uint8_t Transform::getErrorCode() const { return static_cast<uint8_t>(status & 0x00FF); }
+bool Transform::isMissing() const { return (status & 0x0100) != 0; }
+
+MarkerData::MarkerData() : status(0), markerIndex(0), x(BAD_FLOAT), y(BAD_FLOAT), z(BAD_FLOAT) {}
+
+ToolData::ToolData()
+	: frameNumber(0), systemStatus(0), portStatus(0), frameType(0), frameSequenceIndex(0), frameStatus(0),
+	  timespec_s(0), timespec_ns(0), dataIsNew(false)
+{
+}
+
+PortHandleInfo::PortHandleInfo(std::string portHandle, uint8_t status)
+	: portHandle_(portHandle), status_(status)
+{
+}
+
+PortHandleInfo::PortHandleInfo(std::string portHandle, std::string toolType, std::string toolId,
+	std::string revision, std::string serialNumber, uint8_t status)
+	: portHandle_(portHandle), toolType_(toolType), toolId_(toolId), revision_(revision),
+	  serialNumber_(serialNumber), status_(status)
+{
+}
+
+std::string PortHandleInfo::getPortHandle() const { return portHandle_; }
+std::string PortHandleInfo::getToolId() const { return toolId_; }
+std::string PortHandleInfo::getRevision() const { return revision_; }
+std::string PortHandleInfo::getSerialNumber() const { return serialNumber_; }
+
+std::string PortHandleInfo::getStatus() const
+{
+	char status[8];
+	std::snprintf(status, sizeof(status), "%02X", status_);
+	return status;
+}
+
+/*
+ * GBF classes: the BX2 object model, parsed as the library does. Component types other than Frame and
+ * Data6D are kept as a bare header and their payload is skipped.
+ */
+BufferedReader::BufferedReader(Connection* connection) : connection_(connection), currentIndex_(0) {}
+
+std::string BufferedReader::toString() const
+{
+	std::string hex;
+	char byte[4];
+	for (size_t i = 0; i < buffer_.size(); i++)
+	{
+		std::snprintf(byte, sizeof(byte), "%02X", buffer_[i]);
+		hex += byte;
+	}
+	return hex;
+}
+
+std::string BufferedReader::getData(size_t start, size_t length) const
+{
+	return std::string(buffer_.begin() + start, buffer_.begin() + start + length);
+}
+
+void BufferedReader::readBytes(int numBytes)
+{
+	buffer_.clear();
+	currentIndex_ = 0;
+	buffer_.resize(numBytes);
+	int received = 0;
+	while (received < numBytes)
+	{
+		int count = connection_->read(&buffer_[received], numBytes - received);
+		if (count <= 0)
+		{
+			break;
+		}
+		received += count;
+	}
+	buffer_.resize(received);
+}
+
+void BufferedReader::skipBytes(int numBytes) { currentIndex_ += numBytes; }
+
+byte_t BufferedReader::get_byte()
+{
+	return currentIndex_ < static_cast<int>(buffer_.size()) ? buffer_[currentIndex_++] : 0;
+}
+
+uint16_t BufferedReader::get_uint16()
+{
+	uint16_t low = get_byte();
+	return static_cast<uint16_t>(low | (get_byte() << 8));
+}
+
+uint32_t BufferedReader::get_uint32()
+{
+	uint32_t low = get_uint16();
+	return low | (static_cast<uint32_t>(get_uint16()) << 16);
+}
+
+double BufferedReader::get_double()
+{
+	uint32_t bits = get_uint32();
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+GbfContainer::GbfContainer(BufferedReader& reader)
+{
+	gbfVersion = reader.get_uint16();
+	componentCount = reader.get_uint16();
+	for (int i = 0; i < componentCount; i++)
+	{
+		components.push_back(GbfComponent::buildComponent(reader));
+	}
+}
+
+GbfContainer::~GbfContainer()
+{
+	for (size_t i = 0; i < components.size(); i++)
+	{
+		delete components[i];
+	}
+}
+
+GbfComponent* GbfComponent::buildComponent(BufferedReader& reader)
+{
+	uint16_t componentType = reader.get_uint16();
+	uint32_t componentSize = reader.get_uint32();
+	uint16_t itemOption = reader.get_uint16();
+	uint32_t itemCount = reader.get_uint32();
+
+	GbfComponent* component;
+	switch (componentType)
+	{
+	case GbfComponentType::Frame:
+		component = new GbfFrame(reader, itemCount);
+		break;
+	case GbfComponentType::Data6D:
+		component = new GbfData6D(reader, itemCount);
+		break;
+	default:
+		component = new GbfComponent();
+		reader.skipBytes(componentSize - 12);
+		break;
+	}
+	component->componentType = componentType;
+	component->componentSize = componentSize;
+	component->itemOption = itemOption;
+	component->itemCount = itemCount;
+	return component;
+}
+
+std::string GbfComponent::toString() const { return "GbfComponent"; }
+
+GbfFrame::GbfFrame(BufferedReader& reader, int dataItems)
+{
+	for (int i = 0; i < dataItems; i++)
+	{
+		data.push_back(new GbfFrameDataItem(reader));
+	}
+}
+
+GbfFrame::~GbfFrame()
+{
+	for (size_t i = 0; i < data.size(); i++)
+	{
+		delete data[i];
+	}
+}
+
+std::string GbfFrame::toString() const { return "GbfFrame"; }
+
+GbfFrameDataItem::GbfFrameDataItem(BufferedReader& reader)
+{
+	frameType = reader.get_byte();
+	frameSequenceIndex = reader.get_byte();
+	frameStatus = reader.get_uint16();
+	frameNumber = reader.get_uint32();
+	timespec_s = reader.get_uint32();
+	timespec_ns = reader.get_uint32();
+	frameData = new GbfContainer(reader);
+}
+
+GbfFrameDataItem::~GbfFrameDataItem()
+{
+	delete frameData;
+}
+
+GbfData6D::GbfData6D(BufferedReader& reader, int numberOfTools)
+{
+	for (int i = 0; i < numberOfTools; i++)
+	{
+		Transform transform;
+		transform.toolHandle = reader.get_uint16();
+		transform.status = reader.get_uint16();
+		transform.q0 = reader.get_double();
+		transform.qx = reader.get_double();
+		transform.qy = reader.get_double();
+		transform.qz = reader.get_double();
+		transform.tx = reader.get_double();
+		transform.ty = reader.get_double();
+		transform.tz = reader.get_double();
+		transform.error = reader.get_double();
+		toolTransforms.push_back(transform);
+	}
+}
+
+std::string GbfData6D::toString() const { return "GbfData6D"; }
+
+/*
+ * CombinedApi
+ */
+CombinedApi::CombinedApi() : connection_(NULL), crcValidator_(NULL) {}
+
+CombinedApi::~CombinedApi() {}
+
+int CombinedApi::connect(std::string /*hostname*/)
+{
+	EmulatedDevice& device = EmulatedDevice::instance();
+	device.reconnect();
+	device.command();
+	return 0;
+}
+
+int CombinedApi::setCommParams(CommBaudRateEnum::value /*baudRate*/, int /*dataBits*/, int /*parity*/, int /*stopBits*/, int /*enableHandshake*/) const
+{
+	return EmulatedDevice::instance().command() ? 0 : ERROR_TIMEOUT;
+}
+
+std::string CombinedApi::getApiRevision() const
+{
+	return EmulatedDevice::instance().command() ? "D.002.007" : "";
+}
+
+int CombinedApi::initialize() const
+{
+	EmulatedDevice& device = EmulatedDevice::instance();
+	if (!device.command())
+	{
+		return ERROR_TIMEOUT;
+	}
+	device.initialize();
+	return 0;
+}
+
+std::vector<PortHandleInfo> CombinedApi::portHandleSearchRequest(PortHandleSearchRequestOption::value option) const
+{
+	EmulatedDevice& device = EmulatedDevice::instance();
+	std::vector<PortHandleInfo> handles;
+	// An SCU that lost its setup reports no handles until INIT
+	bool matches = device.command() && device.isInitialized();
+	switch (option)
+	{
+	case PortHandleSearchRequestOption::NotInit:
+		matches = matches && !device.portsInitialized();
+		break;
+	case PortHandleSearchRequestOption::NotEnabled:
+		matches = matches && device.portsInitialized() && !device.portsEnabled();
+		break;
+	case PortHandleSearchRequestOption::Enabled:
+		matches = matches && device.portsEnabled();
+		break;
+	default:
+		break;
+	}
+	for (int i = 0; matches && i < device.numSensors(); i++)
+	{
+		char handle[9]; // Room for any int in hex
+		std::snprintf(handle, sizeof(handle), "%02X", EmulatedDevice::FIRST_HANDLE + i);
+		handles.push_back(PortHandleInfo(handle, 0x31));
+	}
+	return handles;
+}
+
+int CombinedApi::portHandleFree(std::string /*portHandle*/) const
+{
+	return EmulatedDevice::instance().command() ? 0 : ERROR_TIMEOUT;
+}
+
+int CombinedApi::portHandleInitialize(std::string /*portHandle*/) const
+{
+	EmulatedDevice& device = EmulatedDevice::instance();
+	if (!device.command())
+	{
+		return ERROR_TIMEOUT;
+	}
+	device.setPortsInitialized(true);
+	return 0;
+}
+
+int CombinedApi::portHandleEnable(std::string /*portHandle*/, ToolTrackingPriority::value /*priority*/) const
+{
+	EmulatedDevice& device = EmulatedDevice::instance();
+	if (!device.command())
+	{
+		return ERROR_TIMEOUT;
+	}
+	device.setPortsEnabled(true);
+	return 0;
+}
+
+int CombinedApi::startTracking() const
+{
+	EmulatedDevice& device = EmulatedDevice::instance();
+	if (!device.command())
+	{
+		return ERROR_TIMEOUT;
+	}
+	device.setTracking(true);
+	return device.isTracking() ? 0 : -0x0C;
+}
+
+int CombinedApi::stopTracking() const
+{
+	EmulatedDevice& device = EmulatedDevice::instance();
+	if (!device.command())
+	{
+		return ERROR_TIMEOUT;
+	}
+	device.setTracking(false);
+	return 0;
+}
+
+std::string CombinedApi::getTrackingDataTX(const uint16_t options) const
+{
+	return EmulatedDevice::instance().trackingReply(options);
+}
+
+std::vector<ToolData> CombinedApi::getTrackingDataBX(const uint16_t options) const
+{
+	std::string reply = EmulatedDevice::instance().trackingReply(options);
+	if (reply.empty() || reply.compare(0, 5, "ERROR") == 0)
+	{
+		return std::vector<ToolData>();
+	}
+	TransformBatch batch;
+	batch.loadTX(reply);
+	batch.scaleRaw();
+
+	std::vector<ToolData> tools(batch.size());
+	for (int i = 0; i < batch.size(); i++)
+	{
+		ToolData& tool = tools[i];
+		tool.frameNumber = batch.frameNumber[i];
+		tool.systemStatus = batch.systemStatus;
+		tool.portStatus = 0x31;
+		tool.transform.toolHandle = batch.toolHandle[i];
+		tool.transform.status = batch.status[i];
+		if (batch.valid[i])
+		{
+			tool.transform.q0 = batch.q0[i];
+			tool.transform.qx = batch.qx[i];
+			tool.transform.qy = batch.qy[i];
+			tool.transform.qz = batch.qz[i];
+			tool.transform.tx = batch.tx[i];
+			tool.transform.ty = batch.ty[i];
+			tool.transform.tz = batch.tz[i];
+			tool.transform.error = batch.error[i];
+		}
+		tool.dataIsNew = true;
+	}
+	return tools;
+}
+
+std::vector<ToolData> CombinedApi::getTrackingDataBX2(std::string options) const
+{
+	EmulatedDevice& device = EmulatedDevice::instance();
+	device.setLastBX2Options(options);
+
+	// Tools are only reported in the 6D section, with their transforms out of the volume as BX2 always does.
+	// Every tool of a frame the previous BX2 reported has no new data, so none is reported
+	bool transforms = options.find("--6d=tools") != std::string::npos || options.find("--6d=all") != std::string::npos;
+	std::vector<ToolData> tools = getTrackingDataBX(transforms ? 0x0801 : 0x0001);
+	if (!transforms || (!tools.empty() && !device.reportBX2Frame(tools[0].frameNumber)))
+	{
+		tools.clear();
+	}
+	return tools;
+}
+
+std::string CombinedApi::errorToString(int errorCode)
+{
+	char message[32];
+	std::snprintf(message, sizeof(message), "Emulated error %d", errorCode);
+	return message;
+}
+
+void CombinedApi::returnTrackingDataFormated(std::string currentData, double returnFormattedDataArray[7][4], int sizeOfData, int sensorIndex, double previousPositions[7][4]) const
+{
+	// Out of volume sensors hold their previous pose
+	if (currentData == "SENSOROUTOFBOUNDS")
+	{
+		for (int i = 0; i < sizeOfData; i++)
+		{
+			returnFormattedDataArray[i][sensorIndex] = previousPositions[i][sensorIndex];
+		}
+		return;
+	}
+
+	// q0, qx, qy, qz: sign + 5 digits; tx, ty, tz: sign + 6 digits
+	static const int widths[7] = { 6, 6, 6, 6, 7, 7, 7 };
+	static const double scales[7] = { 1e-4, 1e-4, 1e-4, 1e-4, 1e-2, 1e-2, 1e-2 };
+	size_t offset = 0;
+	for (int i = 0; i < sizeOfData && i < 7; i++)
+	{
+		returnFormattedDataArray[i][sensorIndex] = std::strtol(currentData.substr(offset, widths[i]).c_str(), NULL, 10) * scales[i];
+		offset += widths[i];
+	}
+}
@@ -0,0 +1,334 @@
+#ifndef EMULATED_DEVICE_HPP
+#define EMULATED_DEVICE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h> // for uint8_t etc...
+
+/**
+ * @brief An Aurora SCU that answers the harness' CombinedApi stand-in.
+ * @details The device produces one frame every 1/40 s of the time set by the driver. Each frame is a TX
+ *          reply (option 0x0001) either generated from sensors moving on circles, or replayed from a file.
+ *          Replay files hold one TX reply per line, with the line feed that ends each handle written as
+ *          the two characters \n, eg.
+ *              020A+05000+00000+00000+08660+005000-001000-015000+00100000000310000012B\n0BMISSING000000310000012B\n0000
+ *          Replayed frames are served in order and loop at the end of the file.
+ *          Emulated replies honour AllTransforms (0x0800): a sensor partly out of the volume is reported with
+ *          its transform and the partly out of volume bit of its port status when asked for, otherwise MISSING.
+ *          BX2 only reports a frame once: a BX2 before the next frame reports no tools.
+ *          Faults can be injected to exercise recovery. The device may be used from several threads, eg.
+ *          the block's and a recovery thread.
+ */
+class EmulatedDevice
+{
+public:
+	//! The Aurora frame rate [Hz]
+	static const int FRAME_RATE = 40;
+
+	//! Sensor handles are numbered from 0x0A, as the S-function expects
+	static const int FIRST_HANDLE = 0x0A;
+
+	//! The frame number of the first frame after power up
+	static const uint32_t FIRST_FRAME = 0x100;
+
+	//! The faults injectFault() emulates
+	enum Fault
+	{
+		LinkFault,   //!< The cable glitched: nothing is answered until the host reconnects
+		DeviceFault, //!< The SCU reported an error and dropped out of tracking with its ports disabled
+		PowerFault   //!< The SCU was power cycled: the link is lost and every setting with it
+	};
+
+	//! Returns the device the CombinedApi stand-in talks to
+	static EmulatedDevice& instance()
+	{
+		static EmulatedDevice device;
+		return device;
+	}
+
+	//! Sets the number of emulated sensors (1 to 4)
+	void setNumSensors(int numSensors) { numSensors_ = numSensors; }
+
+	//! Reply option that reports the transforms of tools out of the measurement volume (TrackingReplyOption::AllTransforms)
+	static const uint16_t ALL_TRANSFORMS = 0x0800;
+
+	//! Port status bit of a tool partly out of the measurement volume
+	static const uint32_t PARTLY_OUT_OF_VOLUME = 0x80;
+
+	//! When enabled, the last sensor leaves the measurement volume every 2.5 s: partly for a quarter of a second, then fully for another
+	void setDropouts(bool dropouts) { dropouts_ = dropouts; }
+
+	//! Delays every tracking reply to emulate the serial round trip [us]
+	void setReplyLatency(int microseconds) { replyLatencyUs_ = microseconds; }
+
+	/**
+	 * @brief Loads the replies to replay instead of the emulated sensors.
+	 * @returns False if the file could not be read or holds no replies.
+	 */
+	bool loadReplay(const std::string& path)
+	{
+		std::ifstream file(path.c_str());
+		if (!file)
+		{
+			return false;
+		}
+		replies_.clear();
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line[line.size() - 1] == '\r')
+			{
+				line.erase(line.size() - 1);
+			}
+			if (line.empty() || line[0] == '#')
+			{
+				continue;
+			}
+			std::string reply;
+			for (size_t i = 0; i < line.size(); i++)
+			{
+				if (line[i] == '\\' && i + 1 < line.size() && line[i + 1] == 'n')
+				{
+					reply += '\n';
+					i++;
+				}
+				else
+				{
+					reply += line[i];
+				}
+			}
+			replies_.push_back(reply);
+		}
+		if (!replies_.empty())
+		{
+			numSensors_ = std::strtol(replies_[0].substr(0, 2).c_str(), NULL, 16);
+		}
+		return !replies_.empty();
+	}
+
+	//! Returns true if replies are replayed from a file
+	bool isReplaying() const { return !replies_.empty(); }
+
+	//! Returns the number of sensors plugged into the SCU
+	int numSensors() const { return numSensors_; }
+
+	/**
+	 * @brief Sets the device time [s]. The harness calls this before every step.
+	 * @details Until the time is set the device runs on the wall clock, so programs that know nothing of the
+	 *          emulator, such as the tracker daemon, can be linked against it.
+	 */
+	void setTime(double seconds) { time_ = seconds; }
+
+	//! Returns the index of the frame the device is currently measuring
+	uint32_t frameIndex() const
+	{
+		double seconds = time_;
+		if (seconds < 0.0)
+		{
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - powerUp_).count();
+		}
+		return static_cast<uint32_t>(seconds * FRAME_RATE);
+	}
+
+	/**
+	 * @brief Returns the TX reply for the current frame, after the configured latency, an ERROR reply
+	 *        when the device is not tracking, or nothing while the link is down.
+	 * @param options The TrackingReplyOption flags of the request. Recorded for lastReplyOptions().
+	 */
+	std::string trackingReply(uint16_t options = 0x0801)
+	{
+		lastReplyOptions_ = options;
+		if (replyLatencyUs_ > 0)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(replyLatencyUs_));
+		}
+		if (linkDown_ || !tracking_)
+		{
+			commands_++;
+			return linkDown_ ? "" : "ERROR0C";
+		}
+		std::string reply = isReplaying() ? replies_[frameIndex() % replies_.size()] : emulatedReply(FIRST_FRAME + frameIndex(), options);
+		std::lock_guard<std::mutex> lock(replyMutex_);
+		lastReply_ = reply;
+		transactions_++;
+		return reply;
+	}
+
+	/**
+	 * @brief Records a frame reported by BX2, which only reports the tools with new data since the last BX2.
+	 * @returns False if the previous BX2 already reported this frame, so it holds no new data.
+	 */
+	bool reportBX2Frame(uint32_t frame) { return lastBX2Frame_.exchange(frame) != frame; }
+
+	//! Records the options of a BX2 request, for lastBX2Options()
+	void setLastBX2Options(const std::string& options)
+	{
+		std::lock_guard<std::mutex> lock(replyMutex_);
+		lastBX2Options_ = options;
+	}
+
+	//! Returns the options of the last BX2 request
+	std::string lastBX2Options() const
+	{
+		std::lock_guard<std::mutex> lock(replyMutex_);
+		return lastBX2Options_;
+	}
+
+	//! Returns the last tracking reply sent
+	std::string lastReply() const
+	{
+		std::lock_guard<std::mutex> lock(replyMutex_);
+		return lastReply_;
+	}
+
+	//! Returns the reply options of the last tracking request
+	uint16_t lastReplyOptions() const { return lastReplyOptions_; }
+
+	//! Returns the number of tracking replies sent
+	uint64_t transactions() const { return transactions_; }
+
+	/**
+	 * @brief Counts a device command that is not a tracking request.
+	 * @returns False if the command goes unanswered because the link is down.
+	 */
+	bool command()
+	{
+		commands_++;
+		return !linkDown_;
+	}
+
+	//! Reconnecting brings a link that is down back up
+	void reconnect()
+	{
+		reconnects_++;
+		linkDown_ = false;
+	}
+
+	//! Returns the number of times the host reconnected
+	uint64_t reconnects() const { return reconnects_; }
+
+	//! A RESET or a serial break restarts the SCU: the link answers again, with nothing set up
+	void reset()
+	{
+		linkDown_ = false;
+		initialized_ = portsInitialized_ = portsEnabled_ = tracking_ = false;
+	}
+
+	//! Emulates a fault. The device stays faulty until the host recovers it
+	void injectFault(Fault fault)
+	{
+		switch (fault)
+		{
+		case LinkFault:
+			linkDown_ = true;
+			break;
+		case DeviceFault:
+			tracking_ = false;
+			portsEnabled_ = false;
+			break;
+		case PowerFault:
+			linkDown_ = true;
+			initialized_ = portsInitialized_ = portsEnabled_ = tracking_ = false;
+			break;
+		}
+	}
+
+	/**
+	 * @brief The state the SCU keeps between programs: it stays initialized, enabled and tracking until
+	 *        told otherwise, so a second run of the block can find it still tracking.
+	 */
+	void initialize()
+	{
+		initialized_ = true;
+		portsInitialized_ = portsEnabled_ = tracking_ = false;
+	}
+	void setPortsInitialized(bool initialized) { portsInitialized_ = initialized_ && initialized; }
+	void setPortsEnabled(bool enabled) { portsEnabled_ = portsInitialized_ && enabled; }
+	void setTracking(bool tracking) { tracking_ = portsEnabled_ && tracking; }
+
+	bool isInitialized() const { return initialized_; }
+	bool portsInitialized() const { return portsInitialized_; }
+	bool portsEnabled() const { return portsEnabled_; }
+	bool isTracking() const { return tracking_; }
+
+	//! Returns the number of device commands other than tracking requests
+	uint64_t commands() const { return commands_; }
+
+private:
+	EmulatedDevice()
+		: numSensors_(4), dropouts_(true), replyLatencyUs_(0), time_(-1.0), powerUp_(std::chrono::steady_clock::now()),
+		  transactions_(0), commands_(0), reconnects_(0), lastReplyOptions_(0), lastBX2Frame_(0), initialized_(false), portsInitialized_(false), portsEnabled_(false), tracking_(false),
+		  linkDown_(false)
+	{
+	}
+
+	//! Builds a TX reply in the format of option 0x0001, with or without AllTransforms
+	std::string emulatedReply(uint32_t frame, uint16_t options) const
+	{
+		char field[64];
+		std::snprintf(field, sizeof(field), "%02X", numSensors_);
+		std::string reply = field;
+		for (int i = 0; i < numSensors_; i++)
+		{
+			std::snprintf(field, sizeof(field), "%02X", FIRST_HANDLE + i);
+			reply += field;
+
+			bool outOfVolume = dropouts_ && i == numSensors_ - 1 && (frame / (FRAME_RATE / 2)) % 5 == 4;
+			bool partly = outOfVolume && frame % (FRAME_RATE / 2) < FRAME_RATE / 4;
+			if (outOfVolume && !(partly && (options & ALL_TRANSFORMS) != 0))
+			{
+				reply += "MISSING";
+			}
+			else
+			{
+				// Each sensor turns about z while circling the field generator at its own rate
+				double angle = 2.0 * M_PI * frame / (4.0 * FRAME_RATE) * (1.0 + 0.25 * i);
+				std::snprintf(field, sizeof(field), "%+06d%+06d%+06d%+06d%+07d%+07d%+07d%+06d",
+					fixed(std::cos(angle / 2.0), 1e4), 0, 0, fixed(std::sin(angle / 2.0), 1e4),
+					fixed(50.0 * std::cos(angle) + 20.0 * i, 1e2), fixed(50.0 * std::sin(angle), 1e2),
+					fixed(-150.0 - 10.0 * i, 1e2), fixed(0.12, 1e4));
+				reply += field;
+			}
+			std::snprintf(field, sizeof(field), "%08X%08X\n", 0x31 | (partly ? PARTLY_OUT_OF_VOLUME : 0), frame);
+			reply += field;
+		}
+		reply += "0000";
+		return reply;
+	}
+
+	static int fixed(double value, double scale)
+	{
+		return static_cast<int>(std::floor(value * scale + 0.5));
+	}
+
+	int numSensors_;
+	bool dropouts_;
+	int replyLatencyUs_;
+	std::atomic<double> time_;
+	std::chrono::steady_clock::time_point powerUp_;
+	std::atomic<uint64_t> transactions_;
+	std::atomic<uint64_t> commands_;
+	std::atomic<uint64_t> reconnects_;
+	std::atomic<uint16_t> lastReplyOptions_;
+	std::atomic<uint32_t> lastBX2Frame_;
+	std::atomic<bool> initialized_;
+	std::atomic<bool> portsInitialized_;
+	std::atomic<bool> portsEnabled_;
+	std::atomic<bool> tracking_;
+	std::atomic<bool> linkDown_;
+	std::vector<std::string> replies_;
+	mutable std::mutex replyMutex_;
+	std::string lastReply_;
+	std::string lastBX2Options_;
+};
+
+#endif // EMULATED_DEVICE_HPP
@@ -0,0 +1,141 @@
+#ifndef EMULATED_KINOVA_HPP
+#define EMULATED_KINOVA_HPP
+
+// CommunicationLayerWindows.h declares the DLL's functions __declspec(dllexport), which only Windows compilers know
+#ifndef _WIN32
+#define __declspec(attribute)
+#endif
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "CommunicationLayerWindows.h"
+#include "KinovaActuatorTelemetry.h"
+
+/**
+ * @brief A Kinova arm that answers the RS-485 passthrough of CommunicationLayerWindows.dll.
+ * @details rs485Functions() returns a KinovaRS485Functions table of stand-ins. Every OpenRS485_Write of
+ *          RS485_MSG_GET_ACTUALPOSITION messages queues one RS485_MSG_SEND_ACTUALPOSITION reply per actuator
+ *          addressed, and OpenRS485_Read hands the queued replies back, at most 50 at a time. All the replies
+ *          to one write carry the number of that write in every float, so a reader can tell a state torn
+ *          between two writes from a consistent one.
+ *          sendPacketList() stands in for SendPacketList: it keeps a copy of the packets sent and answers each
+ *          in place with a packet of the same command whose data is the request's with every bit inverted.
+ */
+class EmulatedKinovaArm
+{
+public:
+	//! Returns the arm the stand-in functions talk to
+	static EmulatedKinovaArm& instance()
+	{
+		static EmulatedKinovaArm arm;
+		return arm;
+	}
+
+	//! Returns the stand-ins for OpenRS485_Activate, OpenRS485_Read and OpenRS485_Write
+	static KinovaRS485Functions rs485Functions()
+	{
+		KinovaRS485Functions functions;
+		functions.activate = &EmulatedKinovaArm::activate;
+		functions.read = &EmulatedKinovaArm::read;
+		functions.write = &EmulatedKinovaArm::write;
+		return functions;
+	}
+
+	//! Stands in for SendPacketList
+	static int sendPacketList(std::vector<Packet>& listPacket, int& result)
+	{
+		EmulatedKinovaArm& arm = instance();
+		std::lock_guard<std::mutex> lock(arm.mutex_);
+		arm.packetsReceived_ = listPacket;
+		for (size_t i = 0; i < listPacket.size(); i++)
+		{
+			for (int j = 0; j < PACKET_MAX_DATA_SIZE; j++)
+			{
+				listPacket[i].Data[j] = static_cast<unsigned char>(~listPacket[i].Data[j]);
+			}
+		}
+		arm.packetLists_++;
+		result = NO_ERROR_KINOVA;
+		return NO_ERROR_KINOVA;
+	}
+
+	//! Returns a copy of the packets of the last SendPacketList call
+	std::vector<Packet> packetsReceived()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return packetsReceived_;
+	}
+
+	//! Returns the number of SendPacketList calls so far
+	uint64_t packetLists() const { return packetLists_; }
+
+	//! Returns the number of OpenRS485_Write calls so far
+	uint64_t writes() const { return writes_; }
+
+	//! Returns true once OpenRS485_Activate has been called
+	bool isActivated() const { return activated_; }
+
+private:
+	EmulatedKinovaArm() : writes_(0), packetLists_(0), activated_(false) {}
+
+	static int activate()
+	{
+		instance().activated_ = true;
+		return NO_ERROR_KINOVA;
+	}
+
+	static int read(RS485_Message* packagesIn, int quantityWanted, int& receivedQuantity)
+	{
+		EmulatedKinovaArm& arm = instance();
+		std::lock_guard<std::mutex> lock(arm.mutex_);
+		receivedQuantity = 0;
+		while (receivedQuantity < quantityWanted && receivedQuantity < KinovaActuatorTelemetry::MAX_MESSAGES && !arm.replies_.empty())
+		{
+			packagesIn[receivedQuantity++] = arm.replies_.front();
+			arm.replies_.pop_front();
+		}
+		return arm.activated_ ? NO_ERROR_KINOVA : ERROR_RS485_INVALID_HANDLE;
+	}
+
+	static int write(RS485_Message* packagesOut, int quantityToSend, int& quantitySent)
+	{
+		EmulatedKinovaArm& arm = instance();
+		std::lock_guard<std::mutex> lock(arm.mutex_);
+		if (!arm.activated_)
+		{
+			quantitySent = 0;
+			return ERROR_RS485_INVALID_HANDLE;
+		}
+		float value = static_cast<float>(++arm.writes_);
+		for (int i = 0; i < quantityToSend; i++)
+		{
+			if (packagesOut[i].Command != RS485_MSG_GET_ACTUALPOSITION)
+			{
+				continue;
+			}
+			RS485_Message reply;
+			reply.Command = RS485_MSG_SEND_ACTUALPOSITION;
+			reply.SourceAddress = packagesOut[i].DestinationAddress;
+			reply.DestinationAddress = packagesOut[i].SourceAddress;
+			for (int j = 0; j < 4; j++)
+			{
+				reply.DataFloat[j] = value;
+			}
+			arm.replies_.push_back(reply);
+		}
+		quantitySent = quantityToSend;
+		return NO_ERROR_KINOVA;
+	}
+
+	std::mutex mutex_;
+	std::deque<RS485_Message> replies_;
+	std::vector<Packet> packetsReceived_;
+	std::atomic<uint64_t> writes_;
+	std::atomic<uint64_t> packetLists_;
+	std::atomic<bool> activated_;
+};
+
+#endif // EMULATED_KINOVA_HPP
@@ -0,0 +1,281 @@
+#ifndef EMULATED_SERIAL_DEVICE_HPP
+#define EMULATED_SERIAL_DEVICE_HPP
+
+// Only for Mac and Linux, like LowLatencySerialConnection
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>  // for posix_openpt()
+#include <poll.h>   // for poll()
+#include <stdlib.h> // for grantpt(), unlockpt() and ptsname()
+#include <termios.h> // for the host's baud rate
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "EmulatedDevice.h"
+#include "LowLatencySerialConnection.h"
+#include "ReplyFramer.h"
+
+/**
+ * @brief Puts an EmulatedDevice behind a pseudo-terminal, so a LowLatencySerialConnection can talk to it
+ *        as it would to an SCU on /dev/ttyUSB0.
+ * @details A thread answers every command on the master side of the pty: TX with the device's tracking
+ *          reply for the options it asks for, anything else with OKAY, each with its CRC16 and CR. The round trip through the pty has no
+ *          baud rate or USB latency, which leaves the cost of waking the reader to be measured.
+ *          The device also keeps the rate of a real SCU's link: it starts at 9600 baud, moves to another rate
+ *          after the OKAY to COMM, and ignores commands while the host's side of the pty is set to another rate,
+ *          as it would a garbled line. RESET is answered with RESET and restarts the device, which comes back at
+ *          9600 baud if setResetRestoresDefaultRate() is on. A pty carries no serial break, so serialBreak()
+ *          stands in for one (see EmulatedSerialPort): the device restarts at 9600 baud and, RESTART_MS later,
+ *          sends RESET unprompted, also when it ignored every command before.
+ */
+class EmulatedSerialDevice
+{
+public:
+	//! How long the device takes to restart after a break [ms]
+	static const int RESTART_MS = 20;
+
+	explicit EmulatedSerialDevice(EmulatedDevice& device)
+		: device_(device), master_(-1), stop_(false), answered_(0), baudRate_(9600), resetRestoresDefaultRate_(false),
+		  breakPending_(false), breaks_(0)
+	{
+		portName_[0] = '\0';
+	}
+
+	~EmulatedSerialDevice()
+	{
+		close();
+	}
+
+	//! Opens a pty and starts answering on it. Connect to portName() afterwards
+	bool open()
+	{
+		close();
+		master_ = posix_openpt(O_RDWR | O_NOCTTY);
+		if (master_ < 0)
+		{
+			return false;
+		}
+		const char* name = (grantpt(master_) == 0 && unlockpt(master_) == 0) ? ptsname(master_) : NULL;
+		if (name == NULL)
+		{
+			close();
+			return false;
+		}
+		std::snprintf(portName_, sizeof(portName_), "%s", name);
+		stop_ = false;
+		thread_ = std::thread(&EmulatedSerialDevice::run, this);
+		return true;
+	}
+
+	void close()
+	{
+		stop_ = true;
+		if (thread_.joinable())
+		{
+			thread_.join();
+		}
+		if (master_ >= 0)
+		{
+			::close(master_);
+			master_ = -1;
+		}
+	}
+
+	//! Returns the name of the pty to connect to, eg. /dev/pts/3
+	const char* portName() const { return portName_; }
+
+	//! Returns the number of commands answered
+	uint64_t answered() const { return answered_; }
+
+	//! Sets the rate the device listens at, eg. as if COMM had moved it there
+	void setBaudRate(int baudRate) { baudRate_ = baudRate; }
+
+	//! Returns the rate the device listens at
+	int baudRate() const { return baudRate_; }
+
+	//! Makes RESET return the device to 9600 baud, as a break does
+	void setResetRestoresDefaultRate(bool restores) { resetRestoresDefaultRate_ = restores; }
+
+	//! Tells the device the host held a break on the line
+	void serialBreak()
+	{
+		breaks_++;
+		breakPending_ = true;
+	}
+
+	//! Returns the number of breaks the device saw
+	uint64_t breaks() const { return breaks_; }
+
+private:
+	void run()
+	{
+		std::string command;
+		char received[256];
+		while (!stop_)
+		{
+			struct pollfd descriptor;
+			descriptor.fd = master_;
+			descriptor.events = POLLIN;
+			descriptor.revents = 0;
+			if (breakPending_.exchange(false))
+			{
+				// Whatever was on the line during the break is lost
+				command.clear();
+				restart();
+			}
+			if (poll(&descriptor, 1, 10) <= 0)
+			{
+				continue;
+			}
+			int count = static_cast<int>(::read(master_, received, sizeof(received)));
+			for (int i = 0; i < count; i++)
+			{
+				if (received[i] != '\r')
+				{
+					command += received[i];
+					continue;
+				}
+				answer(command);
+				command.clear();
+			}
+		}
+	}
+
+	void answer(const std::string& command)
+	{
+		if (!hostMatchesRate())
+		{
+			return; // The device can't make out a command sent at another rate
+		}
+		bool tracking = command.compare(0, 2, "TX") == 0;
+		// TX:0801 or TX 0801, with or without a CRC16 after the options
+		uint16_t options = command.size() >= 7 ? static_cast<uint16_t>(std::strtol(command.substr(3, 4).c_str(), NULL, 16)) : 0x0001;
+		if (tracking)
+		{
+			send(device_.trackingReply(options));
+		}
+		else if (!device_.command())
+		{
+			return; // The link is down
+		}
+		else if (command.compare(0, 5, "RESET") == 0)
+		{
+			device_.reset();
+			send("RESET");
+			if (resetRestoresDefaultRate_)
+			{
+				baudRate_ = 9600;
+			}
+		}
+		else if (command.compare(0, 5, "COMM ") == 0 && command.size() >= 6 && command[5] >= '0' && command[5] <= '7')
+		{
+			// The new rate applies from the command after the OKAY
+			static const int rates[] = { 9600, 14400, 19200, 38400, 57600, 115200, 921600, 1228739 };
+			send("OKAY");
+			baudRate_ = rates[command[5] - '0'];
+		}
+		else
+		{
+			if (command.compare(0, 4, "INIT") == 0)
+			{
+				device_.initialize();
+			}
+			send("OKAY");
+		}
+	}
+
+	//! Restarts the device after a break and announces it at 9600 baud
+	void restart()
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(RESTART_MS));
+		device_.reset();
+		baudRate_ = 9600;
+		send("RESET");
+	}
+
+	//! Returns true if the host's side of the pty is set to the device's rate
+	bool hostMatchesRate() const
+	{
+		struct termios options;
+		if (tcgetattr(master_, &options) != 0)
+		{
+			return false;
+		}
+		speed_t host = cfgetospeed(&options);
+		switch (baudRate_)
+		{
+			case 9600: return host == B9600;
+			case 19200: return host == B19200;
+			case 38400: return host == B38400;
+			case 57600: return host == B57600;
+			case 115200: return host == B115200;
+#ifdef B921600
+			case 921600: return host == B921600;
+#endif
+			default: return false;
+		}
+	}
+
+	//! Sends a reply with its CRC16 and CR
+	void send(const std::string& body)
+	{
+		if (body.empty())
+		{
+			return; // The link is down
+		}
+		char crc[8];
+		std::snprintf(crc, sizeof(crc), "%04X\r", ReplyFramer::crc16(body.c_str(), static_cast<int>(body.size())));
+		std::string reply = body + crc;
+		size_t written = 0;
+		while (written < reply.size())
+		{
+			ssize_t result = ::write(master_, reply.data() + written, reply.size() - written);
+			if (result < 0 && errno != EINTR)
+			{
+				return;
+			}
+			written += result > 0 ? result : 0;
+		}
+		answered_++;
+	}
+
+	EmulatedDevice& device_;
+	int master_;
+	char portName_[64];
+	std::thread thread_;
+	std::atomic<bool> stop_;
+	std::atomic<uint64_t> answered_;
+	std::atomic<int> baudRate_;
+	std::atomic<bool> resetRestoresDefaultRate_;
+	std::atomic<bool> breakPending_;
+	std::atomic<uint64_t> breaks_;
+};
+
+/**
+ * @brief A LowLatencySerialConnection whose serial breaks reach an EmulatedSerialDevice, since a pty drops them.
+ */
+class EmulatedSerialPort : public LowLatencySerialConnection
+{
+public:
+	explicit EmulatedSerialPort(EmulatedSerialDevice& device) : device_(device) {}
+
+	//! Holds the break on the pty as on a real port, then hands it to the device
+	bool sendSerialBreak() const
+	{
+		bool sent = LowLatencySerialConnection::sendSerialBreak();
+		device_.serialBreak();
+		return sent;
+	}
+
+private:
+	EmulatedSerialDevice& device_;
+};
+
+#endif // _WIN32
+
+#endif // EMULATED_SERIAL_DEVICE_HPP
@@ -0,0 +1,600 @@
+/**
+ * Runs the auroraNDIComm S-function without MATLAB: the block is stepped at a chosen rate against
+ * EmulatedDevice, every mdlOutputs call is timed, and the block outputs are checked against the poses in
+ * the reply the device sent (held while a sensor is out of the volume, calibrated when a calibration is given).
+ * Faults injected with --fault must be recovered from, with output 5 at 0 while the outputs are held. Without a fault
+ * output 5 must stay 1 once measuring and the SCU must never be recovered, whatever the rate and transport.
+ * Outputs left unconnected with --unconnected must stay zero, and every tracking request must carry the reply
+ * options (or BX2 options) the connected outputs need.
+ * --receive-benchmark instead checks a LowLatencySerialConnection on a pty, then times TX transactions through
+ * it once in each receive mode.
+ *
+ * Build and run from the repository root:
+ *     g++ -std=c++11 -O2 -Iharness -INDIAuroraIncludeFiles harness/auroraNDICommHarness.cpp harness/EmulatedCombinedApi.cpp -pthread -o auroraNDICommHarness
+ *     ./auroraNDICommHarness --rate 40 --duration 20
+ */
+
+#include "../auroraNDIComm.cpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "EmulatedDevice.h"
+#include "EmulatedSerialDevice.h"
+#include "CommandSession.h"
+#include "LatencyHistogram.h"
+
+//! A fault to inject into the emulated SCU at a given simulation time
+struct HarnessFault
+{
+	EmulatedDevice::Fault fault;
+	double time;
+};
+
+struct HarnessOptions
+{
+	HarnessOptions() : rate(40.0), duration(10.0), sensors(4), dropouts(true), latencyUs(0), realtime(false), port(6), runs(1), receiveBenchmark(0), transport(-1) {}
+
+	double rate;
+	double duration;
+	int sensors;
+	bool dropouts;
+	int latencyUs;
+	bool realtime;
+	int port;
+	int runs;
+	int receiveBenchmark;
+	double transport;
+	std::string replay;
+	std::string timingFile;
+	std::vector<double> calibration;
+	std::vector<HarnessFault> faults;
+	std::vector<int> unconnected;
+};
+
+//! Parses <link|device|power>@<t>
+static bool parseFault(const std::string& text, HarnessFault& fault)
+{
+	size_t at = text.find('@');
+	if (at == std::string::npos)
+	{
+		return false;
+	}
+	std::string kind = text.substr(0, at);
+	if (kind == "link")
+	{
+		fault.fault = EmulatedDevice::LinkFault;
+	}
+	else if (kind == "device")
+	{
+		fault.fault = EmulatedDevice::DeviceFault;
+	}
+	else if (kind == "power")
+	{
+		fault.fault = EmulatedDevice::PowerFault;
+	}
+	else
+	{
+		return false;
+	}
+	fault.time = std::atof(text.c_str() + at + 1);
+	return true;
+}
+
+static void printUsage(const char* program)
+{
+	std::printf("usage: %s [options]\n", program);
+	std::printf("  --rate <Hz>              Step rate of the block (default 40)\n");
+	std::printf("  --duration <s>           Simulated time to run, including the 5 s bring-up (default 10)\n");
+	std::printf("  --sensors <1-4>          Number of emulated sensors (default 4)\n");
+	std::printf("  --no-dropouts            Keep every sensor in the measurement volume\n");
+	std::printf("  --latency <us>           Emulated serial round trip of each tracking request (default 0)\n");
+	std::printf("  --realtime               Pace the steps to the wall clock\n");
+	std::printf("  --replay <file>          Replay TX replies from a file instead of emulating sensors\n");
+	std::printf("  --calibration <v1,v2,..> Numeric calibration parameter (4x4 registration(:), tip offsets)\n");
+	std::printf("  --transport <TX|BX|BX2>  Transport parameter, passed as its number 0, 1 or 2 (default: no parameter, TX)\n");
+	std::printf("  --timing <file>          Write the duration of every step as CSV\n");
+	std::printf("  --runs <n>               Simulate n times in a row against the same SCU, as consecutive model runs do (default 1)\n");
+	std::printf("  --fault <kind>@<t>       Inject a link, device or power fault at simulation time t, eg. link@8 (repeatable)\n");
+	std::printf("  --unconnected <1-4>      Leave a pose output unconnected (repeatable)\n");
+	std::printf("  --receive-benchmark <n>  Instead of the block, time n TX transactions over a pty in each serial receive mode\n");
+}
+
+static bool parseArguments(int argc, char** argv, HarnessOptions& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--rate" && hasValue)
+		{
+			options.rate = std::atof(argv[++i]);
+		}
+		else if (arg == "--duration" && hasValue)
+		{
+			options.duration = std::atof(argv[++i]);
+		}
+		else if (arg == "--sensors" && hasValue)
+		{
+			options.sensors = std::atoi(argv[++i]);
+		}
+		else if (arg == "--no-dropouts")
+		{
+			options.dropouts = false;
+		}
+		else if (arg == "--latency" && hasValue)
+		{
+			options.latencyUs = std::atoi(argv[++i]);
+		}
+		else if (arg == "--realtime")
+		{
+			options.realtime = true;
+		}
+		else if (arg == "--replay" && hasValue)
+		{
+			options.replay = argv[++i];
+		}
+		else if (arg == "--timing" && hasValue)
+		{
+			options.timingFile = argv[++i];
+		}
+		else if (arg == "--runs" && hasValue)
+		{
+			options.runs = std::atoi(argv[++i]);
+		}
+		else if (arg == "--fault" && hasValue)
+		{
+			HarnessFault fault;
+			if (!parseFault(argv[++i], fault))
+			{
+				return false;
+			}
+			options.faults.push_back(fault);
+		}
+		else if (arg == "--unconnected" && hasValue)
+		{
+			int port = std::atoi(argv[++i]);
+			if (port < 1 || port > 4)
+			{
+				return false;
+			}
+			options.unconnected.push_back(port);
+		}
+		else if (arg == "--receive-benchmark" && hasValue)
+		{
+			options.receiveBenchmark = std::atoi(argv[++i]);
+		}
+		else if (arg == "--transport" && hasValue)
+		{
+			std::string transport = argv[++i];
+			options.transport = transport == "TX" ? 0 : transport == "BX" ? 1 : transport == "BX2" ? 2 : std::strtod(transport.c_str(), NULL);
+		}
+		else if (arg == "--calibration" && hasValue)
+		{
+			char* cursor = argv[++i];
+			while (*cursor != '\0')
+			{
+				char* end = NULL;
+				options.calibration.push_back(std::strtod(cursor, &end));
+				if (end == cursor)
+				{
+					return false;
+				}
+				cursor = *end == ',' ? end + 1 : end;
+			}
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return options.rate > 0 && options.sensors >= 1 && options.sensors <= 4 && options.runs >= 1 && options.receiveBenchmark >= 0;
+}
+
+//! Prints the count, mean, median, 99th percentile and maximum of the given step durations
+static void printTiming(const char* label, std::vector<double> micros)
+{
+	if (micros.empty())
+	{
+		std::printf("%-10s no steps\n", label);
+		return;
+	}
+	std::sort(micros.begin(), micros.end());
+	double sum = 0;
+	for (size_t i = 0; i < micros.size(); i++)
+	{
+		sum += micros[i];
+	}
+	std::printf("%-10s steps %6zu  mean %9.2f us  p50 %9.2f us  p99 %9.2f us  max %9.2f us\n", label, micros.size(),
+		sum / micros.size(), micros[micros.size() / 2], micros[(micros.size() * 99) / 100], micros.back());
+}
+
+/**
+ * @brief Compares the block outputs with the poses of the reply the device just sent.
+ * @param expected The outputs expected for each sensor, updated in place. MISSING sensors keep their value, and
+ *                 the outputs of unconnected ports stay zero.
+ * @returns The number of sensors whose outputs did not match.
+ */
+static int checkOutputs(SimStruct* S, const std::string& reply, PoseCalibration& calibration, int numSensors, double expected[4][7])
+{
+	TransformBatch batch(16);
+	if (batch.loadTX(reply) < 0)
+	{
+		std::printf("[HARNESS]: unable to parse the reply '%s'\n", reply.c_str());
+		return numSensors;
+	}
+	batch.scaleRaw();
+	calibration.apply(batch);
+
+	int mismatches = 0;
+	for (int i = 0; i < numSensors; i++)
+	{
+		int index = batch.indexOf(static_cast<uint16_t>(EmulatedDevice::FIRST_HANDLE + i));
+		if (index >= 0 && batch.valid[index] && ssGetOutputPortConnected(S, i))
+		{
+			batch.copyPose(index, expected[i]);
+		}
+
+		const real_T* y = ssGetOutputPortRealSignal(S, i);
+		for (int k = 0; k < 7; k++)
+		{
+			if (std::fabs(y[k] - expected[i][k]) > 1e-9)
+			{
+				std::printf("[HARNESS]: sensor %d element %d is %f, expected %f\n", i + 1, k, y[k], expected[i][k]);
+				mismatches++;
+				break;
+			}
+		}
+	}
+	return mismatches;
+}
+
+//! The outcome of every run
+struct HarnessResult
+{
+	HarnessResult() : framesChecked(0), mismatches(0), unrecovered(0), spuriousFaults(0) {}
+
+	std::vector<double> bringUpMicros;
+	std::vector<double> trackingMicros;
+	int framesChecked;
+	int mismatches;
+	int unrecovered;
+	int spuriousFaults;
+};
+
+/**
+ * @brief Simulates the block once, from mdlStart to mdlTerminate. The emulated SCU keeps its state between runs.
+ * @returns False if the block reported an error.
+ */
+static bool runBlock(const HarnessOptions& options, EmulatedDevice& device, int run, std::ofstream& timing, HarnessResult& result)
+{
+	SimStruct block;
+	SimStruct* S = &block;
+	mdlInitializeSizes(S);
+	// Port-based sample times: the engine propagates the step period to the ports, then asks for the block's
+	mdlSetInputPortSampleTime(S, 0, 1.0 / options.rate, 0.0);
+	mdlSetOutputPortSampleTime(S, 0, 1.0 / options.rate, 0.0);
+	mdlInitializeSampleTimes(S);
+	harnessAllocate(S);
+	mdlInitializeConditions(S);
+
+	uint16_t expectedOptions = 0x0001; // TransformData alone when nothing is connected
+	std::string expectedBX2Options = "--6d=none --3d=none --sensor=none --1d=none";
+	for (int i = 0; i < 4; i++)
+	{
+		bool connected = std::find(options.unconnected.begin(), options.unconnected.end(), i + 1) == options.unconnected.end();
+		S->outputs[i].connected = connected ? 1 : 0;
+		if (connected)
+		{
+			expectedOptions = 0x0001 | EmulatedDevice::ALL_TRANSFORMS;
+			expectedBX2Options = "--6d=tools --3d=none --sensor=none --1d=none";
+		}
+	}
+
+	mxArray calibrationParam;
+	calibrationParam.isChar = false;
+	calibrationParam.values = options.calibration;
+	mxArray transportParam;
+	transportParam.isChar = false;
+	transportParam.values.push_back(options.transport);
+	PoseCalibration expectedCalibration(4);
+	if (!options.calibration.empty() || options.transport >= 0)
+	{
+		S->params.push_back(&calibrationParam);
+	}
+	if (options.transport >= 0)
+	{
+		S->params.push_back(&transportParam);
+	}
+	if (!options.calibration.empty())
+	{
+		if (options.calibration.size() >= 16)
+		{
+			expectedCalibration.setRegistrationColumnMajor4x4(&options.calibration[0]);
+		}
+		for (int i = 0; 16 + 3 * i + 2 < static_cast<int>(options.calibration.size()); i++)
+		{
+			expectedCalibration.setToolTipOffset(EmulatedDevice::FIRST_HANDLE + i, options.calibration[16 + 3 * i],
+				options.calibration[17 + 3 * i], options.calibration[18 + 3 * i]);
+		}
+	}
+
+	mdlStart(S);
+	if (ssGetErrorStatus(S) != NULL)
+	{
+		std::printf("[HARNESS]: mdlStart failed: %s\n", ssGetErrorStatus(S));
+		return false;
+	}
+
+	double expected[4][7] = { { 0 } };
+	double measuringFrom = -1.0;
+	uint64_t transactionsBefore = device.transactions();
+	uint64_t commandsBefore = device.commands();
+	int numSteps = static_cast<int>(options.duration * options.rate) + 1;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t nextFault = 0;
+	double faultTime = -1.0;
+
+	for (int step = 0; step < numSteps; step++)
+	{
+		double time = step / options.rate;
+		device.setTime(time);
+		S->inputs[0].signal[0] = time;
+		S->inputs[1].signal[0] = options.port;
+		if (nextFault < options.faults.size() && time >= options.faults[nextFault].time)
+		{
+			device.injectFault(options.faults[nextFault].fault);
+			faultTime = time;
+			nextFault++;
+		}
+		uint64_t transactions = device.transactions();
+
+		std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+		mdlOutputs(S, 0);
+		std::chrono::steady_clock::time_point after = std::chrono::steady_clock::now();
+		double micros = std::chrono::duration<double, std::micro>(after - before).count();
+
+		bool tracking = ssGetRealDiscStates(S)[5] == 1;
+		(tracking ? result.trackingMicros : result.bringUpMicros).push_back(micros);
+		if (tracking && measuringFrom < 0.0)
+		{
+			measuringFrom = time;
+		}
+		if (timing.is_open())
+		{
+			timing << step << ',' << time << ',' << (tracking ? 1 : 0) << ',' << micros << '\n';
+		}
+		if (ssGetErrorStatus(S) != NULL)
+		{
+			std::printf("[HARNESS]: mdlOutputs failed at t = %.3f s: %s\n", time, ssGetErrorStatus(S));
+			break;
+		}
+
+		// Output 5 is 0 while the block holds its outputs through a fault, and only then: a run without faults, eg. one
+		// stepping BX2 faster than the SCU measures, must never drop it
+		bool valid = ssGetOutputPortRealSignal(S, 4)[0] == 1;
+		if (options.faults.empty() && tracking && !valid)
+		{
+			std::printf("[HARNESS]: run %d: output 5 dropped to 0 at t = %.3f s without a fault\n", run, time);
+			result.spuriousFaults++;
+		}
+		if (faultTime >= 0.0 && tracking && valid && device.transactions() != transactions)
+		{
+			std::printf("[HARNESS]: run %d: fault at t = %.3f s, measuring again at t = %.3f s\n", run, faultTime, time);
+			faultTime = -1.0;
+		}
+		if (tracking && device.transactions() != transactions && device.lastReplyOptions() != expectedOptions)
+		{
+			std::printf("[HARNESS]: run %d: tracking requested with options %04X, expected %04X\n", run, device.lastReplyOptions(), expectedOptions);
+			result.mismatches++;
+		}
+		if (tracking && options.transport == 2 && device.transactions() != transactions && device.lastBX2Options() != expectedBX2Options)
+		{
+			std::printf("[HARNESS]: run %d: BX2 requested with '%s', expected '%s'\n", run, device.lastBX2Options().c_str(), expectedBX2Options.c_str());
+			result.mismatches++;
+		}
+		if (tracking && valid && device.transactions() != transactions)
+		{
+			result.mismatches += checkOutputs(S, device.lastReply(), expectedCalibration, device.numSensors(), expected);
+			result.framesChecked++;
+		}
+
+		if (options.realtime)
+		{
+			std::this_thread::sleep_until(start + std::chrono::duration<double>((step + 1) / options.rate));
+		}
+		else if (faultTime >= 0.0)
+		{
+			// The block recovers on a thread of its own, so give it a step's worth of wall time per step
+			std::this_thread::sleep_for(std::chrono::duration<double>(1.0 / options.rate));
+		}
+	}
+
+	bool failed = ssGetErrorStatus(S) != NULL;
+	TrackerSupervisor* supervisor = static_cast<TrackerSupervisor*>(ssGetPWorkValue(S, 4));
+	if (options.faults.empty() && supervisor != NULL && (supervisor->isRecovering() || supervisor->recoveries() > 0))
+	{
+		std::printf("[HARNESS]: run %d: the block recovered the SCU without a fault\n", run);
+		result.spuriousFaults++;
+	}
+	mdlTerminate(S);
+	if (faultTime >= 0.0)
+	{
+		std::printf("[HARNESS]: run %d: the fault at t = %.3f s was not recovered from\n", run, faultTime);
+		result.unrecovered++;
+	}
+
+	std::printf("[HARNESS]: run %d: %d steps at %.1f Hz, measuring from t = %.3f s, %llu tracking replies, %llu other commands\n",
+		run, numSteps, options.rate, measuringFrom, static_cast<unsigned long long>(device.transactions() - transactionsBefore),
+		static_cast<unsigned long long>(device.commands() - commandsBefore));
+	return !failed;
+}
+
+#ifndef _WIN32
+/**
+ * @brief Times TX transactions with the SCU behind a pty, blocking and busy-polling, and prints the
+ *        distribution of the turnaround (end of the command to the first byte of the reply) and of the
+ *        whole transaction (command to parsed reply) in each mode.
+ * @returns False if the pty could not be opened or a transaction failed.
+ */
+/**
+ * @brief Checks a LowLatencySerialConnection on the emulated SCU's pty. Neither ASYNC_LOW_LATENCY nor the FTDI
+ *        latency timer exist on a pty, so both must be reported as not applied, and a TX transaction must
+ *        still return the reply the device sent for the options asked for.
+ */
+static bool checkPtyConnection(EmulatedSerialDevice& serial, EmulatedDevice& device)
+{
+	LowLatencySerialConnection port;
+	if (!port.connect(serial.portName()))
+	{
+		std::printf("[HARNESS]: unable to open %s\n", serial.portName());
+		return false;
+	}
+	std::printf("[HARNESS]: %s\n", port.tuningReport().c_str());
+
+	int failures = 0;
+	if (port.lowLatencyApplied())
+	{
+		std::printf("[HARNESS]: ASYNC_LOW_LATENCY reported as applied on a pty\n");
+		failures++;
+	}
+	if (port.latencyTimerApplied())
+	{
+		std::printf("[HARNESS]: the latency timer reported as applied on a pty\n");
+		failures++;
+	}
+
+	CommandSession session(port);
+	const uint16_t options = TrackingReplyOption::TransformData | TrackingReplyOption::AllTransforms;
+	int result = session.trackingDataTX(options);
+	std::string sent = device.lastReply();
+	if (result != 0 || sent.empty() || std::string(session.reply(), session.replyLength()).compare(0, sent.size(), sent) != 0)
+	{
+		std::printf("[HARNESS]: TX over the pty failed with %d\n", result);
+		failures++;
+	}
+	else if (device.lastReplyOptions() != options)
+	{
+		std::printf("[HARNESS]: TX over the pty asked for options %04X, expected %04X\n", device.lastReplyOptions(), options);
+		failures++;
+	}
+	return failures == 0;
+}
+
+static bool runReceiveBenchmark(const HarnessOptions& options, EmulatedDevice& device)
+{
+	struct Mode
+	{
+		ReceiveMode::value mode;
+		SpinBackoff::value backoff;
+		const char* label;
+	};
+	static const Mode modes[] = {
+		{ ReceiveMode::Blocking, SpinBackoff::None, "blocking" },
+		{ ReceiveMode::BusyPoll, SpinBackoff::None, "busy-poll" },
+		{ ReceiveMode::BusyPoll, SpinBackoff::Pause, "busy-poll, pause" },
+		{ ReceiveMode::BusyPoll, SpinBackoff::Yield, "busy-poll, yield" }
+	};
+
+	device.initialize();
+	device.setPortsInitialized(true);
+	device.setPortsEnabled(true);
+	device.setTracking(true);
+	EmulatedSerialDevice serial(device);
+	if (!serial.open())
+	{
+		std::printf("[HARNESS]: unable to open a pty for the receive benchmark\n");
+		return false;
+	}
+
+	int failures = checkPtyConnection(serial, device) ? 0 : 1;
+	for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+	{
+		LowLatencySerialConnection port;
+		if (!port.connect(serial.portName()) || !port.setReceiveMode(modes[m].mode, modes[m].backoff))
+		{
+			std::printf("[HARNESS]: unable to open %s %s\n", serial.portName(), modes[m].label);
+			return false;
+		}
+		CommandSession session(port);
+		LatencyHistogram turnaround;
+		LatencyHistogram transaction;
+		for (int i = 0; i < options.receiveBenchmark; i++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (session.trackingDataTX() != 0)
+			{
+				failures++;
+				continue;
+			}
+			transaction.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+			turnaround.record(static_cast<int64_t>(port.lastTurnaroundUs() * 1e3));
+		}
+		char label[64];
+		std::snprintf(label, sizeof(label), "%-16s turnaround", modes[m].label);
+		std::printf("[HARNESS]: %s\n", turnaround.summary(label).c_str());
+		std::snprintf(label, sizeof(label), "%-16s transaction", modes[m].label);
+		std::printf("[HARNESS]: %s\n", transaction.summary(label).c_str());
+	}
+	std::printf("[HARNESS]: %llu commands answered, %d transactions failed\n", static_cast<unsigned long long>(serial.answered()), failures);
+	return failures == 0;
+}
+#endif
+
+int main(int argc, char** argv)
+{
+	HarnessOptions options;
+	if (!parseArguments(argc, argv, options))
+	{
+		printUsage(argv[0]);
+		return 2;
+	}
+
+	EmulatedDevice& device = EmulatedDevice::instance();
+	device.setNumSensors(options.sensors);
+	device.setDropouts(options.dropouts);
+	device.setReplyLatency(options.latencyUs);
+	if (!options.replay.empty() && !device.loadReplay(options.replay))
+	{
+		std::printf("[HARNESS]: unable to read replies from %s\n", options.replay.c_str());
+		return 2;
+	}
+
+	if (options.receiveBenchmark > 0)
+	{
+#ifndef _WIN32
+		return runReceiveBenchmark(options, device) ? 0 : 1;
+#else
+		std::printf("[HARNESS]: the receive benchmark needs a POSIX pty\n");
+		return 2;
+#endif
+	}
+
+	std::ofstream timing;
+	if (!options.timingFile.empty())
+	{
+		timing.open(options.timingFile.c_str());
+		timing << "step,time,tracking,microseconds\n";
+	}
+
+	HarnessResult result;
+	bool succeeded = true;
+	for (int run = 1; run <= options.runs && succeeded; run++)
+	{
+		succeeded = runBlock(options, device, run, timing, result);
+	}
+
+	printTiming("bring-up", result.bringUpMicros);
+	printTiming("tracking", result.trackingMicros);
+	std::printf("[HARNESS]: %d frames checked, %d mismatched sensor outputs\n", result.framesChecked, result.mismatches);
+
+	return (result.mismatches == 0 && result.unrecovered == 0 && result.spuriousFaults == 0 && result.framesChecked > 0 && succeeded) ? 0 : 1;
+}
@@ -0,0 +1,9 @@
+#ifndef HARNESS_CG_SFUN_H
+#define HARNESS_CG_SFUN_H
+
+/*
+ * Stand-in for Simulink's code generation trailer. The harness driver calls the mdl* functions directly,
+ * so no registration is needed.
+ */
+
+#endif // HARNESS_CG_SFUN_H
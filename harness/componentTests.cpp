@@ -0,0 +1,840 @@
+/**
+ * Checks the acquisition components that the S-function harness does not reach, against stand-ins for the
+ * libraries they need. Each test prints what it checked, and the program exits with a non-zero status if
+ * any check failed.
+ *
+ * Build and run from the repository root:
+ *     g++ -std=c++11 -O2 -Iharness -INDIAuroraIncludeFiles harness/componentTests.cpp harness/EmulatedCombinedApi.cpp -pthread -o componentTests
+ *     ./componentTests
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "EmulatedDevice.h"
+#include "EmulatedKinova.h"
+#include "EmulatedSerialDevice.h"
+#include "FusedAcquisition.h"
+#include "GbfArenaTree.h"
+#include "GbfContainer.h"
+#include "GbfData6D.h"
+#include "GbfFrame.h"
+#include "KinovaActuatorTelemetry.h"
+#include "KinovaPacketBatch.h"
+#include "LinkReset.h"
+#include "PoseHistory.h"
+#include "PoseCalibration.h"
+#include "TrackerSupervisor.h"
+
+static int failures = 0;
+
+//! Counts and reports a failed check
+static void check(bool condition, const char* test, const char* what)
+{
+	if (!condition)
+	{
+		std::printf("[TEST]: %s: %s failed\n", test, what);
+		failures++;
+	}
+}
+
+//! Builds an RS-485 message from an actuator, with four floats
+static RS485_Message actuatorMessage(short command, int index, float a, float b, float c, float d)
+{
+	RS485_Message message;
+	std::memset(&message, 0, sizeof(message));
+	message.Command = command;
+	message.SourceAddress = static_cast<unsigned char>(ActuatorTelemetryState::FIRST_ACTUATOR_ADDRESS + index);
+	message.DataFloat[0] = a;
+	message.DataFloat[1] = b;
+	message.DataFloat[2] = c;
+	message.DataFloat[3] = d;
+	return message;
+}
+
+static void testTelemetryDecode()
+{
+	const char* test = "KinovaActuatorTelemetry::decode";
+	ActuatorTelemetryState state;
+	std::memset(&state, 0, sizeof(state));
+
+	check(KinovaActuatorTelemetry::decode(actuatorMessage(RS485_MSG_SEND_ACTUALPOSITION, 2, 1.5f, 90.0f, -3.0f, 0.25f), 100, state), test, "position accepted");
+	check(state.current[2] == 1.5f && state.position[2] == 90.0f && state.velocity[2] == -3.0f && state.torque[2] == 0.25f, test, "position fields");
+	check(state.timestamp[2] == 100 && state.timestamp[1] == 0, test, "position timestamp");
+
+	check(KinovaActuatorTelemetry::decode(actuatorMessage(RS485_MSG_SEND_ALL_VALUES_2, 0, 0.5f, 45.0f, 0.1f, 0.2f), 200, state), test, "values 2 accepted");
+	check(state.pwm[0] == 0.5f && state.encoderPosition[0] == 45.0f && state.accelerationX[0] == 0.1f && state.accelerationY[0] == 0.2f, test, "values 2 fields");
+
+	check(KinovaActuatorTelemetry::decode(actuatorMessage(RS485_MSG_SEND_ALL_VALUES_3, 6, 0.9f, 37.5f, 0.0f, 0.0f), 300, state), test, "values 3 accepted");
+	check(state.accelerationZ[6] == 0.9f && state.temperature[6] == 37.5f, test, "values 3 fields");
+
+	RS485_Message error = actuatorMessage(RS485_MSG_REPORT_ERROR, 1, 0.0f, 0.0f, 0.0f, 0.0f);
+	error.DataLong[0] = 0x42;
+	check(KinovaActuatorTelemetry::decode(error, 400, state), test, "error accepted");
+	check(state.errorCode[1] == 0x42, test, "error code");
+	check(state.messageCount == 4, test, "message count");
+
+	check(!KinovaActuatorTelemetry::decode(actuatorMessage(RS485_MSG_SEND_ACTUALPOSITION, ActuatorTelemetryState::MAX_ACTUATORS, 1.0f, 1.0f, 1.0f, 1.0f), 500, state), test, "address past the last actuator rejected");
+	check(!KinovaActuatorTelemetry::decode(actuatorMessage(RS485_MSG_SEND_ACTUALPOSITION, -1, 1.0f, 1.0f, 1.0f, 1.0f), 500, state), test, "address before the first actuator rejected");
+	check(!KinovaActuatorTelemetry::decode(actuatorMessage(RS485_MSG_ACK, 3, 1.0f, 1.0f, 1.0f, 1.0f), 500, state), test, "other command rejected");
+	check(state.messageCount == 4 && state.timestamp[3] == 0, test, "rejected messages leave the state alone");
+
+	std::printf("[TEST]: %s checked\n", test);
+}
+
+static void testTelemetryThread()
+{
+	const char* test = "KinovaActuatorTelemetry thread";
+	const int numActuators = 6;
+	const int pollPeriodUs = 5000;
+	const int durationMs = 300;
+
+	EmulatedKinovaArm& arm = EmulatedKinovaArm::instance();
+	KinovaActuatorTelemetry telemetry(EmulatedKinovaArm::rs485Functions(), numActuators);
+	telemetry.setPollPeriod(pollPeriodUs);
+	check(telemetry.start() == NO_ERROR_KINOVA, test, "start");
+	check(arm.isActivated(), test, "passthrough activated");
+
+	// Every reply to one poll carries the same value, so any state read with mixed values was torn
+	std::atomic<bool> reading(true);
+	std::atomic<uint64_t> reads(0);
+	std::atomic<uint64_t> torn(0);
+	std::thread reader([&]()
+	{
+		ActuatorTelemetryState state;
+		while (reading)
+		{
+			telemetry.latest(state);
+			for (int i = 0; i < numActuators; i++)
+			{
+				if (state.position[i] != state.position[0] || state.current[i] != state.position[0] ||
+					state.velocity[i] != state.position[0] || state.torque[i] != state.position[0])
+				{
+					torn++;
+					break;
+				}
+			}
+			reads++;
+		}
+	});
+
+	auto started = std::chrono::steady_clock::now();
+	std::this_thread::sleep_for(std::chrono::milliseconds(durationMs));
+	telemetry.stop();
+	double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+	reading = false;
+	reader.join();
+
+	ActuatorTelemetryState state;
+	telemetry.latest(state);
+	check(telemetry.version() > 0, test, "state published");
+	check(telemetry.readErrors() == 0, test, "no read errors");
+	check(torn == 0, test, "no torn state read");
+	check(state.position[0] > 0.0f && state.position[0] <= static_cast<float>(arm.writes()), test, "latest position from a poll");
+	for (int i = 0; i < numActuators; i++)
+	{
+		check(state.timestamp[i] > 0, test, "every actuator heard from");
+	}
+	check(state.timestamp[numActuators] == 0, test, "no actuator past the last polled");
+
+	// Polls keep to the period: at most one per period plus the first, and not starved either
+	double allowed = elapsedMs * 1000.0 / pollPeriodUs + 1.0;
+	check(telemetry.polls() == arm.writes(), test, "every poll written");
+	check(telemetry.polls() <= allowed, test, "polls limited to the poll period");
+	check(telemetry.polls() >= allowed / 4.0, test, "polls kept up with the poll period");
+
+	std::printf("[TEST]: %s checked: %llu polls in %.0f ms, %llu states read\n", test,
+		static_cast<unsigned long long>(telemetry.polls()), elapsedMs, static_cast<unsigned long long>(reads.load()));
+}
+
+static void testPacketBatch()
+{
+	const char* test = "KinovaPacketBatch";
+	const short torqueCommand = 0x35;
+	const short statusQuery = 0x10;
+	EmulatedKinovaArm& arm = EmulatedKinovaArm::instance();
+	KinovaPacketBatch batch(&EmulatedKinovaArm::sendPacketList);
+
+	// 20 floats take 80 bytes, so the torques are split over two USB packets
+	float torques[20];
+	for (int i = 0; i < 20; i++)
+	{
+		torques[i] = 0.5f * i;
+	}
+	batch.begin();
+	check(batch.addFloats(torqueCommand, torques, 20), test, "torques queued");
+	check(batch.add(statusQuery, NULL, 0), test, "status query queued");
+	check(batch.size() == 3, test, "three packets queued");
+	check(batch.replies().empty(), test, "no replies before flush");
+
+	int result = 0;
+	uint64_t packetLists = arm.packetLists();
+	check(batch.flush(result) == NO_ERROR_KINOVA && result == NO_ERROR_KINOVA, test, "flush");
+	check(arm.packetLists() == packetLists + 1, test, "one SendPacketList call");
+	check(batch.transactions() == 1 && batch.packetsSent() == 3, test, "transaction counted");
+
+	// The device saw the torques split as the command layer would, then the query
+	std::vector<Packet> sent = arm.packetsReceived();
+	check(sent.size() == 3, test, "three packets sent");
+	if (sent.size() == 3)
+	{
+		float received[20];
+		std::memcpy(received, sent[0].Data, PACKET_DATA_SIZE);
+		std::memcpy(reinterpret_cast<unsigned char*>(received) + PACKET_DATA_SIZE, sent[1].Data, sizeof(received) - PACKET_DATA_SIZE);
+		check(std::memcmp(received, torques, sizeof(torques)) == 0, test, "torques reassembled");
+		check(sent[0].IdCommand == torqueCommand && sent[0].IdPacket == 1 && sent[1].IdPacket == 2 && sent[0].TotalPacketCount == 2 &&
+			sent[0].TotalDataSize == sizeof(torques), test, "torque packet headers");
+		check(sent[2].IdCommand == statusQuery && sent[2].TotalPacketCount == 1 && sent[2].TotalDataSize == 0, test, "query packet header");
+	}
+
+	// The replies stay until the next cycle
+	const std::vector<Packet>& replies = batch.replies();
+	check(replies.size() == 3 && batch.size() == 0, test, "replies kept after flush");
+	if (replies.size() == 3 && sent.size() == 3)
+	{
+		check(replies[2].IdCommand == statusQuery && replies[0].Data[0] == static_cast<unsigned char>(~sent[0].Data[0]), test, "replies are the device's");
+	}
+	check(batch.flush(result) == NO_ERROR_KINOVA && arm.packetLists() == packetLists + 1, test, "replies not sent again");
+
+	check(batch.add(statusQuery, NULL, 0) && batch.size() == 1 && batch.replies().empty(), test, "add after flush starts a new cycle");
+	batch.begin();
+	check(batch.size() == 0 && batch.replies().empty(), test, "begin discards the cycle");
+
+	// Sizes outside what a Packet holds are clamped: no division by zero, no payload past Packet::Data
+	KinovaPacketBatch empty(&EmulatedKinovaArm::sendPacketList, 4, 0);
+	check(empty.addFloats(torqueCommand, torques, 1) && empty.size() == 4, test, "packet data size 0 is clamped to 1");
+	KinovaPacketBatch oversized(&EmulatedKinovaArm::sendPacketList, 4, PACKET_MAX_DATA_SIZE + 100);
+	std::vector<unsigned char> payload(PACKET_MAX_DATA_SIZE + 100, 0x5A);
+	check(oversized.add(torqueCommand, &payload[0], static_cast<int>(payload.size())) && oversized.size() == 2, test,
+		"packet data size above PACKET_MAX_DATA_SIZE is clamped");
+	KinovaPacketBatch negative(&EmulatedKinovaArm::sendPacketList, -3);
+	check(negative.add(statusQuery, NULL, 0) && !negative.add(statusQuery, NULL, 0), test, "a negative packet count keeps one packet");
+
+	std::printf("[TEST]: %s checked\n", test);
+}
+
+/**
+ * @brief An ArmReader that records when it was called, and numbers its samples in joints[0].
+ */
+class StubArm
+{
+public:
+	bool read(ArmSample& sample)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::memset(&sample, 0, sizeof(sample));
+		sample.joints[0] = static_cast<double>(readTimes_.size());
+		readTimes_.push_back(AcquisitionClock::now());
+		return true;
+	}
+
+	//! Returns the time of the read nearest to a timestamp [ns]
+	int64_t nearestRead(int64_t timestamp)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		int64_t nearest = readTimes_.empty() ? 0 : readTimes_[0];
+		for (size_t i = 1; i < readTimes_.size(); i++)
+		{
+			if (distance(readTimes_[i], timestamp) < distance(nearest, timestamp))
+			{
+				nearest = readTimes_[i];
+			}
+		}
+		return nearest;
+	}
+
+	static int64_t distance(int64_t a, int64_t b) { return a < b ? b - a : a - b; }
+
+private:
+	std::mutex mutex_;
+	std::vector<int64_t> readTimes_;
+};
+
+//! Brings the emulated SCU up to tracking, as the block's bring-up would
+static void startEmulatedTracking()
+{
+	EmulatedDevice& device = EmulatedDevice::instance();
+	device.initialize();
+	device.setPortsInitialized(true);
+	device.setPortsEnabled(true);
+	device.setTracking(true);
+}
+
+//! Waits up to timeoutMs for a number of matched pairs
+static bool waitForPairs(const FusedAcquisition& fused, uint64_t pairs, int timeoutMs)
+{
+	for (int waited = 0; waited < timeoutMs && fused.pairsMatched() < pairs; waited += 10)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return fused.pairsMatched() >= pairs;
+}
+
+static void testFusedPairing()
+{
+	const char* test = "FusedAcquisition pairing";
+	const int capacity = 4;
+	const int64_t toleranceNs = 12500000;
+	const int64_t slackNs = 2000000; // For the read's own duration and a stalled thread
+
+	startEmulatedTracking();
+	CombinedApi capi;
+	StubArm arm;
+	FusedAcquisition fused(capi, [&arm](ArmSample& sample) { return arm.read(sample); }, capacity);
+	fused.setMatchTolerance(toleranceNs);
+	check(fused.start(), test, "start");
+	check(waitForPairs(fused, 3 * capacity, 5000), test, "pairs matched");
+	fused.stop();
+
+	// Only the newest pairs are left, oldest first, and the last of them is the latest pair
+	FusedSample latest = FusedSample();
+	check(fused.latestPair(latest), test, "latest pair");
+	std::vector<FusedSample> pairs;
+	FusedSample pair;
+	while (fused.popPair(pair))
+	{
+		pairs.push_back(pair);
+	}
+	check(pairs.size() == static_cast<size_t>(capacity), test, "queue holds its capacity");
+	for (size_t i = 1; i < pairs.size(); i++)
+	{
+		check(pairs[i].sensors.timestamp > pairs[i - 1].sensors.timestamp, test, "pairs popped oldest first");
+	}
+	if (!pairs.empty())
+	{
+		check(pairs.back().sensors.timestamp == latest.sensors.timestamp && pairs.back().arm.joints[0] == latest.arm.joints[0],
+			test, "oldest pairs overwritten");
+	}
+
+	// Each frame went with the arm sample nearest to it in time
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		int64_t skew = pairs[i].arm.timestamp - pairs[i].sensors.timestamp;
+		check(pairs[i].skew == skew, test, "skew is the timestamp difference");
+		check(StubArm::distance(skew, 0) <= toleranceNs, test, "skew within the tolerance");
+		int64_t nearest = arm.nearestRead(pairs[i].sensors.timestamp);
+		check(StubArm::distance(skew, 0) <= StubArm::distance(nearest, pairs[i].sensors.timestamp) + slackNs, test, "paired with the nearest arm sample");
+	}
+
+	std::printf("[TEST]: %s checked: %llu pairs matched, %llu dropped\n", test,
+		static_cast<unsigned long long>(fused.pairsMatched()), static_cast<unsigned long long>(fused.pairsDropped()));
+}
+
+static void testFusedCapacity()
+{
+	const char* test = "FusedAcquisition capacity";
+	startEmulatedTracking();
+	CombinedApi capi;
+	StubArm arm;
+	const int capacities[] = { 0, -3 };
+	for (int c = 0; c < 2; c++)
+	{
+		FusedAcquisition fused(capi, [&arm](ArmSample& sample) { return arm.read(sample); }, capacities[c]);
+		check(fused.start(), test, "start");
+		check(waitForPairs(fused, 2, 5000), test, "pairs matched");
+		fused.stop();
+
+		FusedSample latest = FusedSample();
+		FusedSample pair;
+		check(fused.latestPair(latest), test, "latest pair");
+		check(fused.popPair(pair) && pair.sensors.timestamp == latest.sensors.timestamp, test, "one pair kept");
+		check(!fused.popPair(pair), test, "only one pair kept");
+	}
+	std::printf("[TEST]: %s checked\n", test);
+}
+
+//! A Connection that serves one reply from memory, for a BufferedReader
+class ReplyConnection : public Connection
+{
+public:
+	explicit ReplyConnection(const std::vector<byte_t>& reply) : reply_(reply), offset_(0)
+	{
+		std::snprintf(name_, sizeof(name_), "memory");
+	}
+
+	bool isConnected() const { return true; }
+	bool connect(const char*) { return true; }
+	void disconnect() {}
+	int read(char* buffer, int length) const { return read(reinterpret_cast<byte_t*>(buffer), length); }
+	int read(byte_t* buffer, int length) const
+	{
+		int count = static_cast<int>(reply_.size() - offset_) < length ? static_cast<int>(reply_.size() - offset_) : length;
+		std::memcpy(buffer, reply_.data() + offset_, count);
+		offset_ += count;
+		return count;
+	}
+	int write(const char*, int length) const { return length; }
+	int write(byte_t*, int length) const { return length; }
+	char* connectionName() { return name_; }
+
+private:
+	std::vector<byte_t> reply_;
+	mutable size_t offset_;
+	char name_[8];
+};
+
+//! Appends little-endian fields to a BX2 reply body
+struct Bx2Writer
+{
+	void u8(uint8_t value) { bytes.push_back(value); }
+	void u16(uint16_t value) { u8(value & 0xFF); u8(value >> 8); }
+	void u32(uint32_t value) { u16(value & 0xFFFF); u16(value >> 16); }
+	void f32(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		u32(bits);
+	}
+	void component(uint16_t type, uint32_t size, uint32_t itemCount)
+	{
+		u16(type);
+		u32(size);
+		u16(0);
+		u32(itemCount);
+	}
+	void transform(uint16_t handle, uint16_t status, float base)
+	{
+		u16(handle);
+		u16(status);
+		for (int i = 0; i < 8; i++)
+		{
+			f32(base + 0.25f * i);
+		}
+	}
+
+	std::vector<byte_t> bytes;
+};
+
+//! Builds the body of a BX2 reply to --6d=tools: a frame with two tools, one missing, followed by a UV component
+static std::vector<byte_t> bx2Reply()
+{
+	Bx2Writer writer;
+	const uint32_t data6DSize = 12 + 2 * 36;
+	writer.u16(1);
+	writer.u16(2);
+	writer.component(GbfComponentType::Frame, 12 + 16 + 4 + data6DSize, 1);
+	writer.u8(1);
+	writer.u8(3);
+	writer.u16(0x0040);
+	writer.u32(0x1234);
+	writer.u32(1700000000);
+	writer.u32(500000);
+	writer.u16(1);
+	writer.u16(1);
+	writer.component(GbfComponentType::Data6D, data6DSize, 2);
+	writer.transform(0x0A, 0x0000, 0.5f);
+	writer.transform(0x0B, 0x0100, -1.0f);
+	writer.component(GbfComponentType::UV, 12 + 8, 1);
+	writer.u32(0xDEADBEEF);
+	writer.u32(0xFEEDFACE);
+	return writer.bytes;
+}
+
+//! Compares the arena tree with the tree GbfContainer built from the same reply
+static bool sameTree(const GbfContainer& expected, const ArenaGbfContainer* actual)
+{
+	if (actual == NULL || actual->gbfVersion != expected.gbfVersion || actual->componentCount != expected.componentCount ||
+		expected.components.size() != expected.componentCount)
+	{
+		return false;
+	}
+	for (uint16_t i = 0; i < expected.componentCount; i++)
+	{
+		const GbfComponent* component = expected.components[i];
+		const ArenaGbfComponent* arenaComponent = actual->components[i];
+		if (arenaComponent == NULL || arenaComponent->componentType != component->componentType || arenaComponent->componentSize != component->componentSize ||
+			arenaComponent->itemOption != component->itemOption || arenaComponent->itemCount != component->itemCount)
+		{
+			return false;
+		}
+		if (component->componentType == GbfComponentType::Frame)
+		{
+			const GbfFrame* frame = static_cast<const GbfFrame*>(component);
+			const ArenaGbfFrame* arenaFrame = static_cast<const ArenaGbfFrame*>(arenaComponent);
+			for (size_t j = 0; j < frame->data.size(); j++)
+			{
+				const GbfFrameDataItem& item = *frame->data[j];
+				const ArenaGbfFrameDataItem& arenaItem = arenaFrame->data[j];
+				if (arenaItem.frameType != item.frameType || arenaItem.frameSequenceIndex != item.frameSequenceIndex ||
+					arenaItem.frameStatus != item.frameStatus || arenaItem.frameNumber != item.frameNumber ||
+					arenaItem.timespec_s != item.timespec_s || arenaItem.timespec_ns != item.timespec_ns ||
+					!sameTree(*item.frameData, arenaItem.frameData))
+				{
+					return false;
+				}
+			}
+		}
+		else if (component->componentType == GbfComponentType::Data6D)
+		{
+			const GbfData6D* data6D = static_cast<const GbfData6D*>(component);
+			const ArenaGbfData6D* arenaData6D = static_cast<const ArenaGbfData6D*>(arenaComponent);
+			for (size_t j = 0; j < data6D->toolTransforms.size(); j++)
+			{
+				const Transform& t = data6D->toolTransforms[j];
+				const ArenaGbfTransform& a = arenaData6D->toolTransforms[j];
+				if (a.toolHandle != t.toolHandle || a.status != t.status || a.isMissing() != t.isMissing() ||
+					a.q0 != t.q0 || a.qx != t.qx || a.qy != t.qy || a.qz != t.qz ||
+					a.tx != t.tx || a.ty != t.ty || a.tz != t.tz || a.error != t.error)
+				{
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+static void testGbfArenaTree()
+{
+	const char* test = "GbfArenaTree";
+	std::vector<byte_t> reply = bx2Reply();
+
+	ReplyConnection connection(reply);
+	BufferedReader reader(&connection);
+	reader.readBytes(static_cast<int>(reply.size()));
+	GbfContainer expected(reader);
+
+	GbfArenaTree tree;
+	const ArenaGbfContainer* root = tree.parse(reply.data(), reply.size());
+	check(root != NULL && root == tree.root(), test, "reply parsed");
+	check(sameTree(expected, root), test, "tree matches GbfContainer");
+
+	// Every truncation fails the parse instead of reading past the reply
+	bool truncatedRejected = true;
+	for (size_t length = 0; length < reply.size(); length++)
+	{
+		truncatedRejected = tree.parse(reply.data(), length) == NULL && truncatedRejected;
+	}
+	check(truncatedRejected, test, "truncated replies rejected");
+
+	// A tree parsed after a failure, in an arena now sized for the reply, still matches
+	check(sameTree(expected, tree.parse(reply.data(), reply.size())), test, "tree matches after a reset");
+
+	GbfArenaTree small(16);
+	check(sameTree(expected, small.parse(reply.data(), reply.size())), test, "tree matches from overflow blocks");
+	check(sameTree(expected, small.parse(reply.data(), reply.size())) && small.arena().capacity() >= small.arena().highWaterMark(), test, "arena regrown");
+
+	std::printf("[TEST]: %s checked\n", test);
+}
+
+/**
+ * @brief Registers a pose 100 mm along x with no rotation, and returns the registered pose.
+ */
+static void registerPose(PoseCalibration& calibration, double pose[7])
+{
+	const double measured[7] = { 1, 0, 0, 0, 100, 0, 0 };
+	TransformBatch batch(1);
+	batch.resize(1);
+	batch.setPose(0, 0x0A, measured, true);
+	calibration.apply(batch);
+	batch.copyPose(0, pose);
+}
+
+static void testPoseCalibration()
+{
+	const char* test = "PoseCalibration";
+	const double translation[3] = { 10, 20, 30 };
+
+	// 30 degrees about z typed with four decimals: accepted, and made exactly rigid
+	const double rounded[9] = { 0.8660, -0.5000, 0, 0.5000, 0.8660, 0, 0, 0, 1 };
+	PoseCalibration calibration(4);
+	check(calibration.setRegistration(rounded, translation), test, "a rotation within the tolerance is accepted");
+	double pose[7];
+	registerPose(calibration, pose);
+	double norm = std::sqrt(pose[0] * pose[0] + pose[1] * pose[1] + pose[2] * pose[2] + pose[3] * pose[3]);
+	double dx = pose[4] - translation[0], dy = pose[5] - translation[1], dz = pose[6] - translation[2];
+	check(std::fabs(norm - 1.0) < 1e-12, test, "the registered quaternion is a unit quaternion");
+	check(std::fabs(std::sqrt(dx * dx + dy * dy + dz * dz) - 100.0) < 1e-9, test, "the registered position is not scaled");
+	check(std::fabs(pose[3] - std::sin(M_PI / 12.0)) < 1e-4, test, "the registered rotation is kept");
+
+	// Scaled, reflected and sheared matrices are rejected, and leave the registration alone
+	const double scaled[9] = { 2, 0, 0, 0, 2, 0, 0, 0, 2 };
+	const double reflected[9] = { 1, 0, 0, 0, 1, 0, 0, 0, -1 };
+	const double sheared[9] = { 1, 0.1, 0, 0, 1, 0, 0, 0, 1 };
+	PoseCalibration rejected(4);
+	check(!rejected.setRegistration(scaled, translation) && !rejected.setRegistration(reflected, translation) &&
+		!rejected.setRegistration(sheared, translation) && rejected.isIdentity(), test, "a non-rigid rotation is rejected");
+	const double column4x4[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1.01, 0, 10, 20, 30, 1 };
+	check(!rejected.setRegistrationColumnMajor4x4(column4x4) && rejected.isIdentity(), test, "a scaled 4x4 registration is rejected");
+
+	// A typo in a calibration file is reported with its line
+	const char* path = "componentTestsCalibration.txt";
+	{
+		std::ofstream file(path);
+		file << "# registration with a typo in r22\n";
+		file << "registration 1 0 0 0  0 10 0 0  0 0 1 0\n";
+	}
+	check(rejected.loadFile(path) == 2 && rejected.isIdentity(), test, "a non-rigid registration in a file is rejected");
+	std::remove(path);
+
+	std::printf("[TEST]: %s checked\n", test);
+}
+
+/**
+ * @brief Builds frame k of a history: stamped k us, with tool 0x0A at (k, k, k) mm turned about z by 0.1 rad on
+ *        odd frames, and tool 0x0B tracked or not.
+ */
+static PoseSample historyFrame(int64_t k, bool secondTracked)
+{
+	PoseSample sample;
+	std::memset(&sample, 0, sizeof(sample));
+	sample.timestamp = k * 1000;
+	sample.frameNumber = static_cast<uint32_t>(k);
+	sample.numPoses = 2;
+	for (int i = 0; i < 2; i++)
+	{
+		TrackedPose& pose = sample.poses[i];
+		double angle = k % 2 == 1 ? 0.1 : 0.0;
+		pose.toolHandle = static_cast<uint16_t>(0x0A + i);
+		pose.valid = i == 0 || secondTracked ? 1 : 0;
+		pose.q[0] = std::cos(angle / 2.0);
+		pose.q[3] = std::sin(angle / 2.0);
+		pose.t[0] = pose.t[1] = pose.t[2] = static_cast<double>(k);
+		pose.error = static_cast<double>(k);
+	}
+	return sample;
+}
+
+static void testPoseHistory()
+{
+	const char* test = "PoseHistory";
+	TrackedPose pose;
+
+	PoseHistory empty(4);
+	check(empty.query(0x0A, 0, pose) == PoseHistory::TooNew, test, "an empty history is TooNew");
+	empty.push(historyFrame(5, true));
+	check(empty.query(0x0A, 4000, pose) == PoseHistory::TooOld && empty.query(0x0A, 5000, pose) == PoseHistory::TooNew, test,
+		"a single frame brackets nothing");
+	check(!empty.push(historyFrame(5, true)) && !empty.push(historyFrame(4, true)), test, "frames out of order are ignored");
+
+	// After wrapping, frames 6 to 9 are in the ring but frame 6 is left out: the writer may be replacing it
+	PoseHistory history(4);
+	for (int k = 0; k < 10; k++)
+	{
+		history.push(historyFrame(k, k != 9));
+	}
+	check(history.size() == 10, test, "every frame counted");
+	check(history.query(0x0A, 6500, pose) == PoseHistory::TooOld && pose.valid == 0, test, "the oldest slot is left out");
+	check(history.query(0x0A, 7000, pose) == PoseHistory::Ok && pose.valid && pose.t[0] == 7.0, test, "the oldest frame used");
+	check(history.query(0x0A, 9000, pose) == PoseHistory::Ok && pose.t[2] == 9.0, test, "the latest frame");
+	check(history.query(0x0A, 9001, pose) == PoseHistory::TooNew, test, "after the latest frame is TooNew");
+	check(history.query(0x0A, 7250, pose) == PoseHistory::Ok && std::fabs(pose.t[1] - 7.25) < 1e-12 &&
+		std::fabs(pose.error - 7.25) < 1e-12, test, "position and error interpolated");
+	check(std::fabs(2.0 * std::atan2(pose.q[3], pose.q[0]) - 0.075) < 1e-12, test, "orientation interpolated by SLERP");
+
+	// Tool 0x0B was not tracked in frame 9, and tool 0x0C never
+	check(history.query(0x0B, 7500, pose) == PoseHistory::Ok, test, "a tracked tool");
+	check(history.query(0x0B, 8500, pose) == PoseHistory::Missing && history.query(0x0B, 8000, pose) == PoseHistory::Missing, test,
+		"a tool untracked in a bracketing frame is Missing");
+	check(history.query(0x0C, 7500, pose) == PoseHistory::Missing, test, "an unknown tool is Missing");
+	PoseSample sample;
+	check(history.query(8500, sample) == PoseHistory::Ok && sample.numPoses == 2 && sample.poses[0].valid && !sample.poses[1].valid &&
+		sample.frameNumber == 9, test, "a sample marks the untracked tool invalid");
+
+	history.setMaxGap(1500);
+	history.push(historyFrame(12, true));
+	check(history.query(0x0A, 8500, pose) == PoseHistory::Ok, test, "frames within the maximum gap");
+	check(history.query(0x0A, 10000, pose) == PoseHistory::Gap, test, "frames further apart than the maximum gap");
+
+	// +90 and -270 degrees about z are the same rotation: SLERP halfway must take the shorter arc, to +45 degrees
+	const double identity[4] = { 1, 0, 0, 0 };
+	const double negated[4] = { -std::cos(M_PI / 4.0), 0, 0, -std::sin(M_PI / 4.0) };
+	double halfway[4];
+	PoseHistory::slerp(identity, negated, 0.5, halfway);
+	check(std::fabs(halfway[0] - std::cos(M_PI / 8.0)) < 1e-12 && std::fabs(halfway[3] - std::sin(M_PI / 8.0)) < 1e-12, test,
+		"SLERP takes the shorter arc");
+	const double nearly[4] = { std::cos(1e-5), 0, std::sin(1e-5), 0 };
+	PoseHistory::slerp(identity, nearly, 0.5, halfway);
+	check(std::fabs(halfway[0] * halfway[0] + halfway[2] * halfway[2] - 1.0) < 1e-12 && std::fabs(halfway[2] - std::sin(0.5e-5)) < 1e-9,
+		test, "SLERP of nearly equal quaternions stays a unit quaternion");
+
+	std::printf("[TEST]: %s checked\n", test);
+}
+
+/**
+ * @brief Queries a small history while the writer laps it as fast as it can: every answer must be Ok, Busy, or
+ *        TooOld for a frame the writer has since overwritten, and an Ok pose must never mix two frames.
+ */
+static void testPoseHistoryRace()
+{
+	const char* test = "PoseHistory race";
+	const int frames = 200000;
+	PoseHistory history(8);
+	history.push(historyFrame(0, true));
+	history.push(historyFrame(1, true));
+	std::atomic<bool> done(false);
+	std::thread writer([&]()
+	{
+		for (int k = 2; k < frames; k++)
+		{
+			history.push(historyFrame(k, true));
+		}
+		done = true;
+	});
+
+	int counts[6] = { 0, 0, 0, 0, 0, 0 };
+	int torn = 0;
+	int unexpected = 0;
+	while (!done)
+	{
+		// Halfway between the two latest frames, where every pose component is (k - 0.5) and the angle 0.05 rad
+		int64_t latest = static_cast<int64_t>(history.size()) - 1;
+		int64_t time = latest * 1000 - 500;
+		TrackedPose pose;
+		int result = history.query(0x0A, time, pose);
+		if (result == PoseHistory::Ok)
+		{
+			double k = latest - 0.5;
+			if (pose.t[0] != k || pose.t[1] != k || pose.t[2] != k || pose.error != k ||
+				std::fabs(2.0 * std::atan2(pose.q[3], pose.q[0]) - 0.05) > 1e-12)
+			{
+				torn++;
+			}
+		}
+		else if (result == PoseHistory::TooOld)
+		{
+			// Only once the writer has pushed past the frames that bracketed the time
+			if (time >= (static_cast<int64_t>(history.size()) - history.capacity() + 1) * 1000)
+			{
+				unexpected++;
+			}
+		}
+		else if (result != PoseHistory::Busy)
+		{
+			unexpected++;
+		}
+		counts[-result]++;
+	}
+	writer.join();
+	check(torn == 0, test, "no pose mixes two frames");
+	check(unexpected == 0, test, "every answer is Ok, Busy or TooOld once overwritten");
+	check(counts[0] > 0, test, "queries answered while the writer runs");
+	std::printf("[TEST]: %s checked: %d Ok, %d Busy, %d TooOld, %d torn\n", test, counts[0], counts[-PoseHistory::Busy],
+		counts[-PoseHistory::TooOld], torn);
+}
+
+#ifndef _WIN32
+//! Checks that the parts of a reset add up to the whole
+static bool timingAddsUp(const ResetTiming& timing)
+{
+	return std::fabs(timing.totalUs - (timing.softUs + timing.breakUs + timing.renegotiateUs)) < 1000.0;
+}
+
+static void testLinkReset()
+{
+	const char* test = "LinkReset";
+	EmulatedDevice& device = EmulatedDevice::instance();
+	startEmulatedTracking();
+	EmulatedSerialDevice serial(device);
+	EmulatedSerialPort port(serial);
+	if (!serial.open() || !port.connect(serial.portName()))
+	{
+		check(false, test, "opening the emulated SCU's pty");
+		return;
+	}
+	CommandSession session(port);
+	LinkReset<EmulatedSerialPort> linkReset(port, session);
+	check(linkReset.changeBaudRate(CommBaudRateEnum::Baud115200, 0) == 0 && serial.baudRate() == 115200, test, "COMM to 115200 baud");
+	const ResetTiming& timing = linkReset.lastTiming();
+
+	// The device answers RESET and INIT at the current rate
+	int result = linkReset.reset();
+	check(result == 0 && timing.method == ResetMethod::Soft, test, "a soft reset at the current rate");
+	check(timing.breakUs == 0 && timing.renegotiateUs == 0, test, "neither a break nor COMM for a soft reset");
+	check(timing.softUs > 0 && timing.totalUs < 50e3 && timingAddsUp(timing), test, "a soft reset within tens of milliseconds");
+	check(serial.baudRate() == 115200 && device.isInitialized() && !device.portsInitialized(), test, "the device reset and initialized at 115200 baud");
+	double softUs = timing.totalUs;
+
+	// The device answers RESET, then comes back at 9600 baud and ignores INIT until COMM moves it back
+	serial.setResetRestoresDefaultRate(true);
+	result = linkReset.reset();
+	check(result == 0 && timing.method == ResetMethod::Soft, test, "a soft reset of a device that came back at 9600 baud");
+	check(timing.renegotiateUs > 0 && timing.breakUs == 0 && timingAddsUp(timing), test, "COMM without a break");
+	check(serial.baudRate() == 115200 && device.isInitialized(), test, "the device renegotiated to 115200 baud");
+	double renegotiatedUs = timing.totalUs;
+	serial.setResetRestoresDefaultRate(false);
+
+	// The device doesn't answer at all: RESET goes unanswered, then a break restarts it at 9600 baud
+	device.injectFault(EmulatedDevice::LinkFault);
+	result = linkReset.reset();
+	check(result == 0 && timing.method == ResetMethod::Break && serial.breaks() == 1, test, "a break to an unresponsive device");
+	check(timing.softUs >= port.replyTimeout() * 1e3, test, "the soft reset waited out its reply timeout first");
+	check(timing.breakUs >= EmulatedSerialDevice::RESTART_MS * 1e3, test, "the break lasted until the device's RESET");
+	check(timing.renegotiateUs > 0 && timingAddsUp(timing), test, "COMM after the break");
+	check(serial.baudRate() == 115200 && device.isInitialized(), test, "the device back at 115200 baud after the break");
+	check(linkReset.softResets() == 2 && linkReset.breakResets() == 1 && linkReset.failures() == 0, test, "the reset counts");
+	std::printf("[TEST]: %s checked: soft %.1f ms, renegotiated %.1f ms, %s\n", test, softUs / 1e3, renegotiatedUs / 1e3,
+		linkReset.timingReport().c_str());
+}
+
+static void testSupervisorLinkReset()
+{
+	const char* test = "TrackerSupervisor link reset";
+	EmulatedDevice& device = EmulatedDevice::instance();
+	startEmulatedTracking();
+	EmulatedSerialDevice serial(device);
+	LowLatencySerialConnection shared;
+	if (!serial.open() || !shared.connect(serial.portName()))
+	{
+		check(false, test, "opening the emulated SCU's pty");
+		return;
+	}
+	// The connection the CombinedApi would hold, moved to 115200 baud during the bring-up
+	CommandSession sharedSession(shared);
+	check(sharedSession.setCommParams(CommBaudRateEnum::Baud115200, 0) == 0 && shared.setSerialPortParams(115200, 8, 0, 0, 0), test, "COMM to 115200 baud");
+
+	EmulatedSerialPort resetPort(serial);
+	SerialLinkReset<EmulatedSerialPort> linkReset(resetPort, serial.portName());
+	CombinedApi capi;
+	TrackerSupervisor supervisor(capi, serial.portName());
+	supervisor.setLinkReset([&]() { return linkReset.reset(); });
+
+	uint64_t reconnects = device.reconnects();
+	device.injectFault(EmulatedDevice::LinkFault);
+	for (int i = 0; i < TrackerSupervisor::FAILURES_BEFORE_RECOVERY; i++)
+	{
+		supervisor.report(false);
+	}
+	check(supervisor.needsRecovery() && supervisor.recover(), test, "recovering from a link fault");
+	check(supervisor.lastLevel() == RecoveryLevel::Link && device.isTracking(), test, "the device tracking again after a link recovery");
+	check(device.reconnects() == reconnects, test, "no reconnect through the CombinedApi");
+	check(linkReset.linkReset().breakResets() == 1 && serial.breaks() == 1, test, "the link reset with a break");
+	check(serial.baudRate() == 115200 && sharedSession.trackingDataTX() == 0, test, "the shared connection still answered at 115200 baud");
+
+	// Without a working link reset the supervisor still reconnects through the CombinedApi
+	LowLatencySerialConnection missingPort;
+	SerialLinkReset<LowLatencySerialConnection> missing(missingPort, "/dev/nonexistent-aurora-scu");
+	supervisor.setLinkReset([&]() { return missing.reset(); });
+	device.injectFault(EmulatedDevice::LinkFault);
+	check(supervisor.recover() && device.reconnects() == reconnects + 1, test, "reconnecting when the link reset fails");
+	std::printf("[TEST]: %s checked: %s\n", test, linkReset.linkReset().timingReport().c_str());
+}
+#endif
+
+int main()
+{
+	testTelemetryDecode();
+	testTelemetryThread();
+	testPacketBatch();
+	testFusedPairing();
+	testFusedCapacity();
+	testGbfArenaTree();
+	testPoseCalibration();
+	testPoseHistory();
+	testPoseHistoryRace();
+#ifndef _WIN32
+	testLinkReset();
+	testSupervisorLinkReset();
+#endif
+
+	std::printf("[TEST]: %d failed checks\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,196 @@
+#ifndef HARNESS_SIMSTRUC_H
+#define HARNESS_SIMSTRUC_H
+
+/**
+ * @brief A minimal stand-in for Simulink's simstruc.h, used to run auroraNDIComm.cpp without MATLAB.
+ * @details Only the ss* and mx* accessors used by the S-function are provided. The driver allocates the
+ *          work vectors, states and port signals with harnessAllocate() after mdlInitializeSizes(), the
+ *          same way the Simulink engine does before calling mdlStart().
+ */
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+typedef double real_T;
+typedef int int_T;
+typedef unsigned int uint_T;
+typedef char char_T;
+typedef int DTypeId;
+typedef const real_T* const* InputRealPtrsType;
+
+#ifndef TRUE
+#define TRUE (1)
+#endif
+#ifndef FALSE
+#define FALSE (0)
+#endif
+
+#define SS_DOUBLE 0
+#define COMPLEX_NO 0
+#define COMPLEX_YES 1
+#define SS_OPTION_ALLOW_PORT_SAMPLE_TIME_IN_TRIGSS 0x00000001
+#define INHERITED_SAMPLE_TIME (-1.0)
+#define ssSampleAndOffsetAreTriggered(st, ot) ((st) == INHERITED_SAMPLE_TIME && (ot) == INHERITED_SAMPLE_TIME)
+#define UNUSED_ARG(arg) ((void)(arg))
+
+/**
+ * @brief A block parameter: either a string or a real numeric array.
+ */
+struct mxArray
+{
+	bool isChar;
+	std::string text;
+	std::vector<double> values;
+};
+
+inline bool mxIsChar(const mxArray* array) { return array->isChar; }
+
+inline size_t mxGetNumberOfElements(const mxArray* array)
+{
+	return array->isChar ? array->text.size() : array->values.size();
+}
+
+inline double* mxGetPr(const mxArray* array)
+{
+	return array->values.empty() ? NULL : const_cast<double*>(&array->values[0]);
+}
+
+inline char* mxArrayToString(const mxArray* array)
+{
+	char* copy = static_cast<char*>(std::malloc(array->text.size() + 1));
+	std::memcpy(copy, array->text.c_str(), array->text.size() + 1);
+	return copy;
+}
+
+inline void mxFree(void* pointer) { std::free(pointer); }
+
+//! An input or output port of the block
+struct SimStructPort
+{
+	int_T width;
+	DTypeId dataType;
+	real_T sampleTime;
+	real_T offsetTime;
+	int_T directFeedThrough;
+	int_T complexSignal;
+
+	//! Whether a signal line is attached to the port. Every port is connected unless the driver says otherwise
+	int_T connected;
+
+	//! The signal values. For inputs the driver writes here before each step
+	std::vector<real_T> signal;
+
+	//! Pointers to each element of signal, as returned by ssGetInputPortRealSignalPtrs
+	std::vector<const real_T*> signalPtrs;
+};
+
+//! A DWork vector of the block
+struct SimStructDWork
+{
+	int_T width;
+	DTypeId dataType;
+	std::vector<real_T> data;
+};
+
+struct SimStruct
+{
+	SimStruct() : numSFcnParams(0), options(0), errorStatus(NULL) {}
+
+	int_T numSFcnParams;
+	std::vector<const mxArray*> params;
+
+	std::vector<int_T> iWork;
+	std::vector<void*> pWork;
+	std::vector<SimStructDWork> dWork;
+	std::vector<real_T> discStates;
+
+	std::vector<SimStructPort> inputs;
+	std::vector<SimStructPort> outputs;
+
+	uint_T options;
+	const char* errorStatus;
+};
+
+/*
+ * Sizes (mdlInitializeSizes)
+ */
+inline void ssSetNumSFcnParams(SimStruct* S, int_T n) { S->numSFcnParams = n; }
+inline void ssSetNumIWork(SimStruct* S, int_T n) { S->iWork.assign(n, 0); }
+inline void ssSetNumPWork(SimStruct* S, int_T n) { S->pWork.assign(n, NULL); }
+inline void ssSetNumDWork(SimStruct* S, int_T n) { S->dWork.resize(n); }
+inline void ssSetDWorkWidth(SimStruct* S, int_T index, int_T width) { S->dWork[index].width = width; }
+inline void ssSetDWorkDataType(SimStruct* S, int_T index, DTypeId type) { S->dWork[index].dataType = type; }
+inline void ssSetNumDiscStates(SimStruct* S, int_T n) { S->discStates.assign(n, 0.0); }
+inline void ssSetNumInputPorts(SimStruct* S, int_T n) { S->inputs.resize(n); }
+inline void ssSetNumOutputPorts(SimStruct* S, int_T n)
+{
+	S->outputs.resize(n);
+	for (int_T i = 0; i < n; i++)
+	{
+		S->outputs[i].connected = 1;
+	}
+}
+inline void ssSetOptions(SimStruct* S, uint_T options) { S->options = options; }
+
+inline void ssSetInputPortSampleTime(SimStruct* S, int_T port, real_T t) { S->inputs[port].sampleTime = t; }
+inline void ssSetInputPortOffsetTime(SimStruct* S, int_T port, real_T t) { S->inputs[port].offsetTime = t; }
+inline void ssSetInputPortWidth(SimStruct* S, int_T port, int_T width) { S->inputs[port].width = width; }
+inline void ssSetInputPortDataType(SimStruct* S, int_T port, DTypeId type) { S->inputs[port].dataType = type; }
+inline void ssSetInputPortDirectFeedThrough(SimStruct* S, int_T port, int_T feed) { S->inputs[port].directFeedThrough = feed; }
+inline void ssSetInputPortComplexSignal(SimStruct* S, int_T port, int_T complexity) { S->inputs[port].complexSignal = complexity; }
+
+inline void ssSetOutputPortSampleTime(SimStruct* S, int_T port, real_T t) { S->outputs[port].sampleTime = t; }
+inline void ssSetOutputPortOffsetTime(SimStruct* S, int_T port, real_T t) { S->outputs[port].offsetTime = t; }
+inline void ssSetOutputPortWidth(SimStruct* S, int_T port, int_T width) { S->outputs[port].width = width; }
+inline void ssSetOutputPortDataType(SimStruct* S, int_T port, DTypeId type) { S->outputs[port].dataType = type; }
+inline void ssSetOutputPortComplexSignal(SimStruct* S, int_T port, int_T complexity) { S->outputs[port].complexSignal = complexity; }
+
+/*
+ * Run time access
+ */
+inline int_T ssGetSFcnParamsCount(SimStruct* S) { return static_cast<int_T>(S->params.size()); }
+inline const mxArray* ssGetSFcnParam(SimStruct* S, int_T index) { return S->params[index]; }
+
+inline void ssSetIWorkValue(SimStruct* S, int_T index, int_T value) { S->iWork[index] = value; }
+inline int_T ssGetIWorkValue(SimStruct* S, int_T index) { return S->iWork[index]; }
+inline void ssSetPWorkValue(SimStruct* S, int_T index, void* value) { S->pWork[index] = value; }
+inline void* ssGetPWorkValue(SimStruct* S, int_T index) { return S->pWork[index]; }
+inline void* ssGetDWork(SimStruct* S, int_T index) { return &S->dWork[index].data[0]; }
+inline real_T* ssGetRealDiscStates(SimStruct* S) { return S->discStates.empty() ? NULL : &S->discStates[0]; }
+
+inline InputRealPtrsType ssGetInputPortRealSignalPtrs(SimStruct* S, int_T port) { return &S->inputs[port].signalPtrs[0]; }
+inline real_T* ssGetOutputPortRealSignal(SimStruct* S, int_T port) { return &S->outputs[port].signal[0]; }
+inline int_T ssGetOutputPortConnected(SimStruct* S, int_T port) { return S->outputs[port].connected; }
+
+inline void ssSetErrorStatus(SimStruct* S, const char* message) { S->errorStatus = message; }
+inline const char* ssGetErrorStatus(SimStruct* S) { return S->errorStatus; }
+
+/**
+ * @brief Allocates the memory described by mdlInitializeSizes, as the engine does before mdlStart.
+ */
+inline void harnessAllocate(SimStruct* S)
+{
+	for (size_t i = 0; i < S->dWork.size(); i++)
+	{
+		S->dWork[i].data.assign(S->dWork[i].width, 0.0);
+	}
+	for (size_t i = 0; i < S->inputs.size(); i++)
+	{
+		SimStructPort& port = S->inputs[i];
+		port.signal.assign(port.width, 0.0);
+		port.signalPtrs.resize(port.width);
+		for (int_T k = 0; k < port.width; k++)
+		{
+			port.signalPtrs[k] = &port.signal[k];
+		}
+	}
+	for (size_t i = 0; i < S->outputs.size(); i++)
+	{
+		S->outputs[i].signal.assign(S->outputs[i].width, 0.0);
+	}
+}
+
+#endif // HARNESS_SIMSTRUC_H